@@ -0,0 +1,41 @@
+#include "DeletionQueue.h"
+
+void DeletionQueue::Push(uint64_t frameCount, TransferToken uploadToken, std::function<void()>&& destroy)
+{
+	m_Entries.push_back({ frameCount, uploadToken, std::move(destroy) });
+}
+
+void DeletionQueue::Retire(uint64_t completedFrameCount, uint64_t recordingFrameCount, TransferContext* transferContext)
+{
+	for (size_t i{}; i < m_Entries.size();)
+	{
+		Entry& entry = m_Entries[i];
+
+		// Upload still pending, its acquire barrier may land in the frame being recorded
+		if (!transferContext->IsComplete(entry.uploadToken))
+		{
+			entry.frameCount = recordingFrameCount;
+			++i;
+			continue;
+		}
+
+		if (entry.frameCount > completedFrameCount)
+		{
+			++i;
+			continue;
+		}
+
+		entry.destroy();
+		m_Entries.erase(m_Entries.begin() + i);
+	}
+}
+
+void DeletionQueue::Flush()
+{
+	for (auto& entry : m_Entries)
+	{
+		entry.destroy();
+	}
+
+	m_Entries.clear();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+
+#include "TransferContext.h"
+
+// Resources the GPU may still read are queued here instead of destroyed on the spot.
+// Every entry remembers how many frames had been submitted when it was queued and is only
+// destroyed once all of those frames completed, so unloading never waits on the device.
+class DeletionQueue final
+{
+public:
+	DeletionQueue() = default;
+	~DeletionQueue() = default;
+
+	DeletionQueue(const DeletionQueue&) = delete;
+	DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+	// frameCount: frames submitted so far (all of them may use the resource)
+	// uploadToken: transfer that writes the resource, it is kept alive until that transfer has been acquired
+	void Push(uint64_t frameCount, TransferToken uploadToken, std::function<void()>&& destroy);
+
+	// Destroy everything no longer used by the GPU, called once the frame's timeline value has been waited on
+	// completedFrameCount: frames known to have finished (graphics timeline value), recordingFrameCount: frames submitted including the one being recorded
+	void Retire(uint64_t completedFrameCount, uint64_t recordingFrameCount, TransferContext* transferContext);
+
+	// Destroy all entries, device must be idle
+	void Flush();
+
+	size_t GetPendingCount() const { return m_Entries.size(); }
+
+private:
+	struct Entry
+	{
+		uint64_t frameCount{};
+		TransferToken uploadToken{};
+		std::function<void()> destroy{};
+	};
+
+	std::deque<Entry> m_Entries{};
+};
@@ -0,0 +1,390 @@
+#include "DepthPyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// Invocations per workgroup side, same as depth_pyramid.comp
+const uint32_t DEPTH_PYRAMID_GROUP_SIZE = 8;
+
+static uint32_t PreviousPowerOfTwo(uint32_t value)
+{
+	uint32_t result = 1;
+	while (result * 2 <= value)
+	{
+		result *= 2;
+	}
+	return result;
+}
+
+void DepthPyramid::Init(VkDevice device, MemoryAllocator* allocator, VkDescriptorSetLayout cullSetLayout, VkImageView depthView, VkExtent2D depthExtent)
+{
+	m_Device = device;
+	m_pAllocator = allocator;
+	m_CullSetLayout = cullSetLayout;
+
+	CreateSetLayout();
+	CreateSampler();
+	CreateTargets(depthView, depthExtent);
+	CreatePipeline();
+}
+
+void DepthPyramid::Destroy()
+{
+	DestroyTargets(m_Targets);
+
+	vkDestroyPipeline(m_Device, m_Pipeline, nullptr);
+	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_Device, m_SetLayout, nullptr);
+	vkDestroySampler(m_Device, m_Sampler, nullptr);
+	m_Pipeline = VK_NULL_HANDLE;
+}
+
+std::function<void()> DepthPyramid::Resize(VkImageView depthView, VkExtent2D depthExtent)
+{
+	Targets previousTargets = std::move(m_Targets);
+	m_Targets = Targets{};
+
+	CreateTargets(depthView, depthExtent);
+
+	return [this, previousTargets]() mutable
+	{
+		DestroyTargets(previousTargets);
+	};
+}
+
+void DepthPyramid::RecordInitialization(VkCommandBuffer commandBuffer)
+{
+	if (!m_NeedsInitialization)
+	{
+		return;
+	}
+	m_NeedsInitialization = false;
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_Targets.image;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_Targets.levelCount, 0, 1 };
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	// Far plane everywhere, nothing can be behind it
+	VkClearColorValue clearColor{};
+	clearColor.float32[0] = 1.f;
+	vkCmdClearColorImage(commandBuffer, m_Targets.image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &barrier.subresourceRange);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void DepthPyramid::RecordBuild(VkCommandBuffer commandBuffer)
+{
+	// Culling of earlier frames (and this frame's first phase) read the levels about to be overwritten
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_Targets.image;
+
+	for (uint32_t level{}; level < m_Targets.levelCount; ++level)
+	{
+		const uint32_t width = std::max(m_Targets.extent.width >> level, 1u);
+		const uint32_t height = std::max(m_Targets.extent.height >> level, 1u);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &m_Targets.descriptorSets[level], 0, nullptr);
+		vkCmdDispatch(commandBuffer, (width + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+			(height + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE, 1);
+
+		// Next level reads this one, after the last level the cull shader reads all of them
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+}
+
+void DepthPyramid::CreateSampler()
+{
+	// Only ever read with texelFetch, which ignores filtering, the lod range covers any pyramid size
+	VkSamplerCreateInfo samplerCreateInfo{};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.minLod = 0.f;
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	const VkResult result = vkCreateSampler(m_Device, &samplerCreateInfo, nullptr, &m_Sampler);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid sampler");
+	}
+}
+
+void DepthPyramid::CreateTargets(VkImageView depthView, VkExtent2D depthExtent)
+{
+	// Power of two keeps every level exactly half of the one below, only level 0 covers up to 3x3 depth texels
+	m_Targets.extent.width = PreviousPowerOfTwo(depthExtent.width);
+	m_Targets.extent.height = PreviousPowerOfTwo(depthExtent.height);
+
+	m_Targets.levelCount = 1;
+	while ((m_Targets.extent.width >> m_Targets.levelCount) > 0 || (m_Targets.extent.height >> m_Targets.levelCount) > 0)
+	{
+		m_Targets.levelCount++;
+	}
+
+	CreateImage();
+	CreateDescriptorSets(depthView);
+
+	m_NeedsInitialization = true;
+}
+
+void DepthPyramid::DestroyTargets(Targets& targets) const
+{
+	// Sets are freed with their pool
+	vkDestroyDescriptorPool(m_Device, targets.descriptorPool, nullptr);
+	targets.descriptorSets.clear();
+
+	for (const VkImageView levelView : targets.levelViews)
+	{
+		vkDestroyImageView(m_Device, levelView, nullptr);
+	}
+	targets.levelViews.clear();
+	vkDestroyImageView(m_Device, targets.imageView, nullptr);
+
+	vkDestroyImage(m_Device, targets.image, nullptr);
+	m_pAllocator->Free(targets.imageAllocation);
+}
+
+void DepthPyramid::CreateImage()
+{
+	VkImageCreateInfo imageCreateInfo{};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.extent = { m_Targets.extent.width, m_Targets.extent.height, 1 };
+	imageCreateInfo.mipLevels = m_Targets.levelCount;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	const VkResult result = vkCreateImage(m_Device, &imageCreateInfo, nullptr, &m_Targets.image);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid image");
+	}
+
+	VkMemoryRequirements memoryRequirements{};
+	vkGetImageMemoryRequirements(m_Device, m_Targets.image, &memoryRequirements);
+
+	m_Targets.imageAllocation = m_pAllocator->Allocate(memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationType::Image, MemoryCategory::RenderTarget);
+	vkBindImageMemory(m_Device, m_Targets.image, m_Targets.imageAllocation.memory, m_Targets.imageAllocation.offset);
+
+	// Whole pyramid for the cull shader, single levels to write (and read the level below from)
+	m_Targets.imageView = CreateView(0, m_Targets.levelCount);
+	for (uint32_t level{}; level < m_Targets.levelCount; ++level)
+	{
+		m_Targets.levelViews.push_back(CreateView(level, 1));
+	}
+}
+
+void DepthPyramid::CreateSetLayout()
+{
+	std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings{};
+	layoutBindings[0].binding = 0;
+	layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layoutBindings[0].descriptorCount = 1;
+	layoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[1].binding = 1;
+	layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	layoutBindings[1].descriptorCount = 1;
+	layoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+	layoutCreateInfo.pBindings = layoutBindings.data();
+
+	const VkResult result = vkCreateDescriptorSetLayout(m_Device, &layoutCreateInfo, nullptr, &m_SetLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error creating depth pyramid descriptor layout");
+	}
+}
+
+void DepthPyramid::CreateDescriptorSets(VkImageView depthView)
+{
+	const uint32_t levelCount = m_Targets.levelCount;
+
+	// Level sets plus the cull shader's
+	const std::array<VkDescriptorPoolSize, 2> poolSizes = { {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelCount + 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelCount }
+	} };
+
+	VkDescriptorPoolCreateInfo poolCreateInfo{};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = levelCount + 1;
+	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolCreateInfo.pPoolSizes = poolSizes.data();
+
+	VkResult result = vkCreateDescriptorPool(m_Device, &poolCreateInfo, nullptr, &m_Targets.descriptorPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid descriptor pool");
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(levelCount, m_SetLayout);
+	setLayouts.push_back(m_CullSetLayout);
+
+	VkDescriptorSetAllocateInfo setAllocInfo{};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = m_Targets.descriptorPool;
+	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(setLayouts.size());
+	setAllocInfo.pSetLayouts = setLayouts.data();
+
+	std::vector<VkDescriptorSet> descriptorSets(setLayouts.size());
+	result = vkAllocateDescriptorSets(m_Device, &setAllocInfo, descriptorSets.data());
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error allocating depth pyramid descriptor sets");
+	}
+
+	m_Targets.cullDescriptorSet = descriptorSets.back();
+	descriptorSets.pop_back();
+	m_Targets.descriptorSets = std::move(descriptorSets);
+
+	// Cull shader reads every level
+	VkDescriptorImageInfo pyramidInfo{};
+	pyramidInfo.sampler = m_Sampler;
+	pyramidInfo.imageView = m_Targets.imageView;
+	pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet pyramidWrite{};
+	pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	pyramidWrite.dstSet = m_Targets.cullDescriptorSet;
+	pyramidWrite.dstBinding = 0;
+	pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidWrite.descriptorCount = 1;
+	pyramidWrite.pImageInfo = &pyramidInfo;
+
+	vkUpdateDescriptorSets(m_Device, 1, &pyramidWrite, 0, nullptr);
+
+	for (uint32_t level{}; level < levelCount; ++level)
+	{
+		// Level 0 reduces the depth buffer, every other level the one below it
+		VkDescriptorImageInfo sourceInfo{};
+		sourceInfo.sampler = m_Sampler;
+		sourceInfo.imageView = level == 0 ? depthView : m_Targets.levelViews[level - 1];
+		sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo destinationInfo{};
+		destinationInfo.imageView = m_Targets.levelViews[level];
+		destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> setWrites{};
+		setWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[0].dstSet = m_Targets.descriptorSets[level];
+		setWrites[0].dstBinding = 0;
+		setWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		setWrites[0].descriptorCount = 1;
+		setWrites[0].pImageInfo = &sourceInfo;
+
+		setWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[1].dstSet = m_Targets.descriptorSets[level];
+		setWrites[1].dstBinding = 1;
+		setWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		setWrites[1].descriptorCount = 1;
+		setWrites[1].pImageInfo = &destinationInfo;
+
+		vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
+}
+
+void DepthPyramid::CreatePipeline()
+{
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &m_SetLayout;
+
+	VkResult result = vkCreatePipelineLayout(m_Device, &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid pipeline layout");
+	}
+
+	const std::vector<char> shaderCode = ReadFile("Shaders/depth_pyramid.spv");
+
+	VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCreateInfo.codeSize = shaderCode.size();
+	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	VkShaderModule shaderModule{};
+	result = vkCreateShaderModule(m_Device, &shaderModuleCreateInfo, nullptr, &shaderModule);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shader module");
+	}
+
+	VkComputePipelineCreateInfo pipelineCreateInfo{};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = shaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = m_PipelineLayout;
+
+	result = vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_Pipeline);
+
+	// Module is only needed to create the pipeline
+	vkDestroyShaderModule(m_Device, shaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid pipeline");
+	}
+}
+
+VkImageView DepthPyramid::CreateView(uint32_t baseLevel, uint32_t levelCount)
+{
+	VkImageViewCreateInfo viewCreateInfo{};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = m_Targets.image;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 1 };
+
+	VkImageView imageView{};
+	const VkResult result = vkCreateImageView(m_Device, &viewCreateInfo, nullptr, &imageView);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid image view");
+	}
+
+	return imageView;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <functional>
+#include <vector>
+
+#include "MemoryAllocator.h"
+
+// Hierarchical depth (HiZ) of the depth buffer for occlusion culling, built with one compute dispatch per level.
+// Level 0 is the depth extent rounded down to powers of two, every texel holds the furthest depth of the texels it
+// covers one level below. So the few texels of the level where a screen rect spans at most 2x2 tell whether anything
+// in that rect could be in front of the stored depth.
+// The image stays in VK_IMAGE_LAYOUT_GENERAL, read by the cull shader and written here.
+// Everything sized by the depth buffer is replaced as a whole on resize, the pipeline stays.
+class DepthPyramid final
+{
+public:
+	DepthPyramid() = default;
+	~DepthPyramid() = default;
+
+	DepthPyramid(const DepthPyramid&) = delete;
+	DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+	// depthView is sampled (depth aspect only) in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL.
+	// cullSetLayout is the set the cull shader samples every level through (combined image sampler at binding 0)
+	void Init(VkDevice device, MemoryAllocator* allocator, VkDescriptorSetLayout cullSetLayout, VkImageView depthView, VkExtent2D depthExtent);
+	void Destroy();
+
+	// Creates a pyramid for the new depth buffer, it is cleared again before its first build.
+	// Frames in flight may still use the previous image and sets, the returned function destroys them once those finished
+	std::function<void()> Resize(VkImageView depthView, VkExtent2D depthExtent);
+
+	// Moves the pyramid to its layout and clears it to the far plane so nothing is occluded before the first build.
+	// Only records something the first time after Init, must be outside a render pass
+	void RecordInitialization(VkCommandBuffer commandBuffer);
+
+	// Reduces the depth buffer into every level. The depth must be written and in read only layout by then (the render pass
+	// before ends with a dependency to compute), ends with the pyramid visible to compute shaders
+	void RecordBuild(VkCommandBuffer commandBuffer);
+
+	VkDescriptorSet GetCullDescriptorSet() const { return m_Targets.cullDescriptorSet; }
+	bool IsInitialized() const { return m_Pipeline != VK_NULL_HANDLE; }
+
+private:
+	VkDevice m_Device{};
+	MemoryAllocator* m_pAllocator{};
+	bool m_NeedsInitialization{ false };
+
+	// Everything sized by the depth buffer
+	struct Targets
+	{
+		VkImage image{};
+		Allocation imageAllocation{};
+		VkExtent2D extent{};
+		uint32_t levelCount{};
+		VkImageView imageView{};						// Every level
+		std::vector<VkImageView> levelViews{};
+
+		// One set per level (source and destination level) and the one the cull shader reads every level through
+		VkDescriptorPool descriptorPool{};
+		std::vector<VkDescriptorSet> descriptorSets{};
+		VkDescriptorSet cullDescriptorSet{};
+	};
+	Targets m_Targets{};
+
+	VkSampler m_Sampler{};
+
+	// One set per level: source (depth or level below) and destination level
+	VkDescriptorSetLayout m_SetLayout{};
+	VkDescriptorSetLayout m_CullSetLayout{};		// Owned by the cull pass
+	VkPipelineLayout m_PipelineLayout{};
+	VkPipeline m_Pipeline{};
+
+	void CreateSetLayout();
+	void CreateSampler();
+	void CreateTargets(VkImageView depthView, VkExtent2D depthExtent);
+	void CreateImage();
+	void CreateDescriptorSets(VkImageView depthView);
+	void CreatePipeline();
+	void DestroyTargets(Targets& targets) const;
+	VkImageView CreateView(uint32_t baseLevel, uint32_t levelCount);
+};
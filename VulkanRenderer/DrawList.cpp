@@ -0,0 +1,127 @@
+#include "DrawList.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+	constexpr uint32_t DEPTH_BITS = 24;
+	constexpr uint32_t RADIX_BITS = 8;
+	constexpr uint32_t RADIX_PASSES = 64 / RADIX_BITS;
+	constexpr uint32_t RADIX_BUCKETS = 1u << RADIX_BITS;
+}
+
+void DrawList::Clear()
+{
+	m_Items.clear();
+	m_Batches.clear();
+}
+
+void DrawList::Add(uint32_t pipelineId, uint32_t geometryId, int textureId, float depth01, MeshModel* pModel, Mesh* pMesh,
+	uint32_t transformIndex, uint32_t instanceCount, uint32_t firstInstance)
+{
+	DrawItem item{};
+	item.sortKey = MakeSortKey(pipelineId, geometryId, textureId, depth01);
+	item.pipelineId = pipelineId;
+	item.geometryId = geometryId;
+	item.textureId = textureId;
+	item.pModel = pModel;
+	item.pMesh = pMesh;
+	item.transformIndex = transformIndex;
+	item.instanceCount = instanceCount;
+	item.firstInstance = firstInstance;
+
+	m_Items.push_back(item);
+}
+
+void DrawList::Sort()
+{
+	const size_t count = m_Items.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	// Histograms of every byte in one pass over the keys
+	std::array<std::array<uint32_t, RADIX_BUCKETS>, RADIX_PASSES> histograms{};
+	for (const auto& item : m_Items)
+	{
+		for (uint32_t pass{}; pass < RADIX_PASSES; ++pass)
+		{
+			histograms[pass][(item.sortKey >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+		}
+	}
+
+	m_SortScratch.resize(count);
+	std::vector<DrawItem>* pSource = &m_Items;
+	std::vector<DrawItem>* pDestination = &m_SortScratch;
+
+	for (uint32_t pass{}; pass < RADIX_PASSES; ++pass)
+	{
+		const uint32_t shift = pass * RADIX_BITS;
+		std::array<uint32_t, RADIX_BUCKETS>& histogram = histograms[pass];
+
+		// Every key has the same byte here, the pass wouldn't change the order
+		if (histogram[(pSource->front().sortKey >> shift) & (RADIX_BUCKETS - 1)] == count)
+		{
+			continue;
+		}
+
+		// Bucket counts to start offsets
+		uint32_t offset{};
+		for (auto& bucket : histogram)
+		{
+			const uint32_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		for (const auto& item : *pSource)
+		{
+			(*pDestination)[histogram[(item.sortKey >> shift) & (RADIX_BUCKETS - 1)]++] = item;
+		}
+
+		std::swap(pSource, pDestination);
+	}
+
+	if (pSource != &m_Items)
+	{
+		m_Items.swap(m_SortScratch);
+	}
+}
+
+void DrawList::BuildBatches()
+{
+	m_Batches.clear();
+
+	for (uint32_t i{}; i < static_cast<uint32_t>(m_Items.size()); ++i)
+	{
+		const DrawItem& item = m_Items[i];
+		if (!m_Batches.empty())
+		{
+			DrawBatch& batch = m_Batches.back();
+			if (batch.pipelineId == item.pipelineId && batch.geometryId == item.geometryId)
+			{
+				batch.drawCount++;
+				continue;
+			}
+		}
+
+		DrawBatch batch{};
+		batch.firstDraw = i;
+		batch.drawCount = 1;
+		batch.pipelineId = item.pipelineId;
+		batch.geometryId = item.geometryId;
+		m_Batches.push_back(batch);
+	}
+}
+
+uint64_t DrawList::MakeSortKey(uint32_t pipelineId, uint32_t geometryId, int textureId, float depth01)
+{
+	const uint64_t depth = static_cast<uint64_t>(std::clamp(depth01, 0.f, 1.f) * static_cast<float>((1u << DEPTH_BITS) - 1));
+
+	return (static_cast<uint64_t>(pipelineId & 0xFF) << 56) |
+		(static_cast<uint64_t>(geometryId & 0xFF) << 48) |
+		(static_cast<uint64_t>(static_cast<uint32_t>(textureId) & 0xFFFF) << 32) |
+		(depth << 8);
+}
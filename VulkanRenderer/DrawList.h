@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "MeshModel.h"
+
+// One instanced indexed draw of a mesh, refers to the scene instead of copying it
+struct DrawItem
+{
+	uint64_t sortKey{};
+	uint32_t pipelineId{};			// Index of the pipeline to bind
+	uint32_t geometryId{};			// Index of the geometry buffer to bind
+	int textureId{};
+	MeshModel* pModel{};
+	Mesh* pMesh{};
+	uint32_t transformIndex{};		// Model transform in the frame's transform buffer
+	uint32_t instanceCount{};
+	uint32_t firstInstance{};		// First of the model's instances in the instance buffer
+};
+
+// Transforms of one model, matches ObjectTransform in the shaders (std430).
+// Products are only filled in with PRECOMPUTE_TRANSFORMS, vertex shaders then skip the matrix products
+struct ObjectTransform
+{
+	glm::mat4 model{ 1.f };
+	glm::mat4 modelViewProjection{ 1.f };
+	glm::mat3x4 normalMatrix{ 1.f };		// Inverse transpose of the model's 3x3, columns padded like a std430 mat3
+};
+
+// Per-draw data the vertex shader fetches with its draw index, matches DrawData in the shaders (std430)
+struct DrawData
+{
+	uint32_t transformIndex{};
+	uint32_t textureIndex{};
+	uint32_t batchIndex{};					// Culling compacts the visible draws of a batch to the front of its range
+	uint32_t batchFirstDraw{};
+	VertexQuantization quantization{};		// Only read by compact formats
+	glm::vec4 boundingSphere{};				// Mesh space center (xyz) and radius (w), read by culling
+};
+
+// Run of sorted draws sharing pipeline and geometry buffer, recorded as one indirect call.
+// Textures don't split batches, shaders index the texture array with the draw's texture id
+struct DrawBatch
+{
+	uint32_t firstDraw{};
+	uint32_t drawCount{};
+	uint32_t pipelineId{};
+	uint32_t geometryId{};
+
+	bool operator==(const DrawBatch& other) const = default;
+};
+
+// Push constant of an indirect batch, draw i of the batch reads draws[drawBase + gl_DrawID]
+struct DrawPushConstants
+{
+	uint32_t drawBase{};
+};
+
+// Bind work done while recording a draw list, skipped binds are state changes avoided because the state was already bound
+struct DrawListStatistics
+{
+	uint32_t drawCount{};			// Draws submitted, GPU culling may still drop some
+	uint32_t instanceCount{};		// Instances drawn by all draws
+	uint32_t indirectCalls{};		// Draws are submitted in batches sharing state
+	uint32_t pipelineBinds{};
+	uint32_t geometryBinds{};
+	uint32_t textureBinds{};		// Texture array, once per command buffer
+	uint32_t skippedBinds{};		// Pipeline or geometry already bound by the previous batch
+	uint32_t secondaryCommandBuffers{};	// Recorded in parallel and executed by the frame's primary
+
+	DrawListStatistics& operator+=(const DrawListStatistics& other)
+	{
+		drawCount += other.drawCount;
+		instanceCount += other.instanceCount;
+		indirectCalls += other.indirectCalls;
+		pipelineBinds += other.pipelineBinds;
+		geometryBinds += other.geometryBinds;
+		textureBinds += other.textureBinds;
+		skippedBinds += other.skippedBinds;
+		secondaryCommandBuffers += other.secondaryCommandBuffers;
+		return *this;
+	}
+};
+
+// Flat list of the frame's draws, radix sorted on a 64-bit key so draws sharing state end up next to each other.
+// Key, most significant first: pipeline (8) | geometry buffer (8) | texture (16) | depth (24) | unused (8)
+// Texture only groups draws sampling the same image, it no longer ends a batch
+class DrawList final
+{
+public:
+	DrawList() = default;
+	~DrawList() = default;
+
+	DrawList(const DrawList&) = delete;
+	DrawList& operator=(const DrawList&) = delete;
+
+	// Keeps capacity so rebuilding every frame doesn't allocate
+	void Clear();
+
+	// depth01: view depth scaled to [0,1], smaller is drawn first inside a state group (front to back)
+	void Add(uint32_t pipelineId, uint32_t geometryId, int textureId, float depth01, MeshModel* pModel, Mesh* pMesh,
+		uint32_t transformIndex, uint32_t instanceCount, uint32_t firstInstance);
+
+	// LSD radix sort, stable, bytes all keys share are skipped
+	void Sort();
+
+	// Split the sorted draws into runs of equal state
+	void BuildBatches();
+
+	const std::vector<DrawItem>& GetItems() const { return m_Items; }
+	const std::vector<DrawBatch>& GetBatches() const { return m_Batches; }
+
+	static uint64_t MakeSortKey(uint32_t pipelineId, uint32_t geometryId, int textureId, float depth01);
+
+private:
+	std::vector<DrawItem> m_Items{};
+	std::vector<DrawItem> m_SortScratch{};
+	std::vector<DrawBatch> m_Batches{};
+};
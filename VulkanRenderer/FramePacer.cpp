@@ -0,0 +1,90 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+// Spin margin bounds, the upper one covers the default 15.6ms timer tick on Windows
+const FramePacer::Clock::duration MIN_SPIN_THRESHOLD = std::chrono::microseconds(500);
+const FramePacer::Clock::duration MAX_SPIN_THRESHOLD = std::chrono::milliseconds(16);
+
+// Just in time frames start this much before their predicted work would end at the deadline
+const FramePacer::Clock::duration JUST_IN_TIME_MARGIN = std::chrono::milliseconds(1);
+
+void FramePacer::Init(FramePacing pacing, double targetFrameRate)
+{
+	if (targetFrameRate < 0.0)
+	{
+		throw std::runtime_error("Target frame rate can't be negative");
+	}
+
+	m_Pacing = pacing;
+	m_TargetFrameTime = targetFrameRate > 0.0
+		? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFrameRate))
+		: Clock::duration::zero();
+	m_NextDeadline = {};
+	m_FrameStart = {};
+	m_PredictedWork = Clock::duration::zero();
+	m_SpinThreshold = std::chrono::milliseconds(2);
+}
+
+float FramePacer::BeginFrame()
+{
+	if (m_Pacing != FramePacing::Unlimited && m_TargetFrameTime > Clock::duration::zero())
+	{
+		// Just in time frames start early enough to finish their predicted work by the deadline
+		Clock::time_point wakeTime = m_NextDeadline;
+		if (m_Pacing == FramePacing::JustInTime)
+		{
+			wakeTime -= m_PredictedWork + JUST_IN_TIME_MARGIN;
+		}
+		WaitUntil(wakeTime);
+
+		// A missed deadline restarts the cadence from now instead of rushing the following frames to catch up
+		m_NextDeadline = std::max(m_NextDeadline, Clock::now()) + m_TargetFrameTime;
+	}
+
+	const Clock::time_point now = Clock::now();
+	const float deltaTime = m_FrameStart == Clock::time_point{} ? 0.f : std::chrono::duration<float>(now - m_FrameStart).count();
+	m_FrameStart = now;
+
+	return deltaTime;
+}
+
+void FramePacer::EndFrame()
+{
+	// Rises at once and decays slowly, a frame taking longer than predicted misses its deadline
+	const Clock::duration work = Clock::now() - m_FrameStart;
+	m_PredictedWork = std::max(work, m_PredictedWork - m_PredictedWork / 16);
+}
+
+double FramePacer::GetPredictedWorkMilliseconds() const
+{
+	return std::chrono::duration<double, std::milli>(m_PredictedWork).count();
+}
+
+void FramePacer::WaitUntil(Clock::time_point deadline)
+{
+	Clock::time_point now = Clock::now();
+
+	// Sleep through most of the wait
+	if (deadline - now > m_SpinThreshold)
+	{
+		const Clock::duration sleepTime = deadline - now - m_SpinThreshold;
+		std::this_thread::sleep_for(sleepTime);
+
+		// Margin follows the worst recent oversleep, grows at once and shrinks slowly
+		const Clock::time_point wokeUp = Clock::now();
+		const Clock::duration overshoot = wokeUp - now - sleepTime;
+		m_SpinThreshold = std::clamp(std::max(overshoot + MIN_SPIN_THRESHOLD, m_SpinThreshold - m_SpinThreshold / 16),
+			MIN_SPIN_THRESHOLD, MAX_SPIN_THRESHOLD);
+		now = wokeUp;
+	}
+
+	// Spin the rest, yielding lets other ready threads run without sleeping for a whole tick
+	while (now < deadline)
+	{
+		std::this_thread::yield();
+		now = Clock::now();
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+
+// When the main loop starts its frames
+enum class FramePacing
+{
+	Unlimited,		// As soon as the renderer lets it, frames in flight and the present mode throttle
+	Limited,		// One frame per target frame time
+	JustInTime		// Limited, but input is sampled as late as the predicted frame work allows and no frame waits queued on the GPU
+};
+
+// Waits sleep until a margin before the deadline and spin the rest: sleeps alone wake up as late as the scheduler likes
+// (a whole timer tick on some systems), spinning alone burns a core for the whole wait.
+// The margin follows how late sleeps actually woke up
+class FramePacer final
+{
+public:
+	using Clock = std::chrono::high_resolution_clock;
+
+	FramePacer() = default;
+	~FramePacer() = default;
+
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+
+	// targetFrameRate 0 leaves the frame times to the renderer, just in time pacing then only keeps the GPU queue empty
+	void Init(FramePacing pacing, double targetFrameRate);
+
+	// Blocks until the next frame should sample its input, returns the seconds since the previous frame started
+	float BeginFrame();
+
+	// Frame was submitted, its duration predicts how late just in time frames can start
+	void EndFrame();
+
+	FramePacing GetPacing() const { return m_Pacing; }
+	double GetPredictedWorkMilliseconds() const;
+
+private:
+	FramePacing m_Pacing{ FramePacing::Unlimited };
+	Clock::duration m_TargetFrameTime{};			// Zero without a target frame rate
+
+	// Limited frames start at the deadline, just in time ones are submitted by it
+	Clock::time_point m_NextDeadline{};
+	Clock::time_point m_FrameStart{};
+
+	Clock::duration m_PredictedWork{};				// Input sampling to submit
+	Clock::duration m_SpinThreshold{};				// Waits spin for this long at their end
+
+	void WaitUntil(Clock::time_point deadline);
+};
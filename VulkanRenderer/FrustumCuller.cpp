@@ -0,0 +1,111 @@
+#include "FrustumCuller.h"
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#else
+#include <xmmintrin.h>
+#endif
+
+void FrustumCuller::Clear()
+{
+	m_BoxCount = 0;
+	m_CenterX.clear();
+	m_CenterY.clear();
+	m_CenterZ.clear();
+	m_ExtentX.clear();
+	m_ExtentY.clear();
+	m_ExtentZ.clear();
+}
+
+uint32_t FrustumCuller::AddBox(const MeshBounds& bounds, const glm::mat4& transform)
+{
+	// Center moves with the transform, extent is projected on the world axes with the absolute rotation/scale part
+	const glm::vec3 center = glm::vec3(transform * glm::vec4(bounds.center, 1.f));
+	const glm::vec3 extent = glm::abs(glm::vec3(transform[0])) * bounds.extent.x +
+		glm::abs(glm::vec3(transform[1])) * bounds.extent.y +
+		glm::abs(glm::vec3(transform[2])) * bounds.extent.z;
+
+	m_CenterX.push_back(center.x);
+	m_CenterY.push_back(center.y);
+	m_CenterZ.push_back(center.z);
+	m_ExtentX.push_back(extent.x);
+	m_ExtentY.push_back(extent.y);
+	m_ExtentZ.push_back(extent.z);
+
+	return m_BoxCount++;
+}
+
+void FrustumCuller::Cull(const std::array<glm::vec4, 6>& frustumPlanes)
+{
+	// Pad with empty boxes so every iteration loads full lanes, their results are never read
+	const uint32_t paddedCount = (m_BoxCount + FRUSTUM_CULL_LANES - 1) / FRUSTUM_CULL_LANES * FRUSTUM_CULL_LANES;
+	m_CenterX.resize(paddedCount);
+	m_CenterY.resize(paddedCount);
+	m_CenterZ.resize(paddedCount);
+	m_ExtentX.resize(paddedCount);
+	m_ExtentY.resize(paddedCount);
+	m_ExtentZ.resize(paddedCount);
+	m_Visible.resize(paddedCount);
+
+	// Box is outside a plane when even its corner furthest along the normal is behind it:
+	// dot(n, center) + w + dot(|n|, extent) < 0
+	for (uint32_t i{}; i < paddedCount; i += FRUSTUM_CULL_LANES)
+	{
+#if defined(__AVX__)
+		const __m256 centerX = _mm256_loadu_ps(&m_CenterX[i]);
+		const __m256 centerY = _mm256_loadu_ps(&m_CenterY[i]);
+		const __m256 centerZ = _mm256_loadu_ps(&m_CenterZ[i]);
+		const __m256 extentX = _mm256_loadu_ps(&m_ExtentX[i]);
+		const __m256 extentY = _mm256_loadu_ps(&m_ExtentY[i]);
+		const __m256 extentZ = _mm256_loadu_ps(&m_ExtentZ[i]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const auto& plane : frustumPlanes)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), centerX),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.y), centerY),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), centerZ), _mm256_set1_ps(plane.w))));
+
+			const __m256 radius = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), extentX),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), extentY),
+				_mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), extentZ)));
+
+			distance = _mm256_add_ps(distance, radius);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		const int mask = _mm256_movemask_ps(inside);
+#else
+		const __m128 centerX = _mm_loadu_ps(&m_CenterX[i]);
+		const __m128 centerY = _mm_loadu_ps(&m_CenterY[i]);
+		const __m128 centerZ = _mm_loadu_ps(&m_CenterZ[i]);
+		const __m128 extentX = _mm_loadu_ps(&m_ExtentX[i]);
+		const __m128 extentY = _mm_loadu_ps(&m_ExtentY[i]);
+		const __m128 extentZ = _mm_loadu_ps(&m_ExtentZ[i]);
+
+		__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+		for (const auto& plane : frustumPlanes)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), centerX),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.y), centerY),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), centerZ), _mm_set1_ps(plane.w))));
+
+			const __m128 radius = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), extentX),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), extentY),
+				_mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), extentZ)));
+
+			distance = _mm_add_ps(distance, radius);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+#endif
+
+		for (uint32_t lane{}; lane < FRUSTUM_CULL_LANES; ++lane)
+		{
+			m_Visible[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// Boxes tested per SIMD iteration, 8 when compiled with AVX (/arch:AVX), 4 with SSE otherwise
+#if defined(__AVX__)
+const uint32_t FRUSTUM_CULL_LANES = 8;
+#else
+const uint32_t FRUSTUM_CULL_LANES = 4;
+#endif
+
+// Visible and culled meshes of the last frame
+struct CullingStatistics
+{
+	uint32_t testedCount{};			// World-space boxes tested on the CPU (one per mesh instance)
+	uint32_t visibleCount{};		// Meshes drawn (without CPU culling: meshes submitted)
+	uint32_t culledCount{};			// Meshes skipped because every instance was outside the frustum
+	uint32_t occludedCount{};		// Meshes inside the frustum but hidden behind the depth pyramid (GPU occlusion culling)
+};
+
+// World-space bounding boxes of a frame, stored structure of arrays so a batch of boxes is tested
+// against a frustum plane with a few SIMD instructions instead of one box at a time
+class FrustumCuller final
+{
+public:
+	FrustumCuller() = default;
+	~FrustumCuller() = default;
+
+	FrustumCuller(const FrustumCuller&) = delete;
+	FrustumCuller& operator=(const FrustumCuller&) = delete;
+
+	// Keeps capacity so refilling every frame doesn't allocate
+	void Clear();
+
+	// Transforms the model space box to a world space box around it, returns its index
+	uint32_t AddBox(const MeshBounds& bounds, const glm::mat4& transform);
+
+	// Test every box against the planes (from ExtractFrustumPlanes)
+	void Cull(const std::array<glm::vec4, 6>& frustumPlanes);
+
+	bool IsVisible(uint32_t index) const { return m_Visible[index] != 0; }
+	uint32_t GetBoxCount() const { return m_BoxCount; }
+
+private:
+	uint32_t m_BoxCount{};
+
+	// Arrays are padded to a multiple of FRUSTUM_CULL_LANES when culling
+	std::vector<float> m_CenterX{};
+	std::vector<float> m_CenterY{};
+	std::vector<float> m_CenterZ{};
+	std::vector<float> m_ExtentX{};
+	std::vector<float> m_ExtentY{};
+	std::vector<float> m_ExtentZ{};
+	std::vector<uint8_t> m_Visible{};
+};
@@ -0,0 +1,334 @@
+#include "GeometryBuffer.h"
+
+#include <stdexcept>
+
+void GeometryBuffer::Init(VkDevice device, MemoryAllocator* allocator, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	m_Device = device;
+	m_pAllocator = allocator;
+	m_VertexStride = vertexStride;
+
+	// Device local buffers filled through the transfer context
+	CreateBuffer(
+		m_Device,
+		m_pAllocator,
+		static_cast<VkDeviceSize>(m_VertexStride) * vertexCapacity,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Geometry,
+		&m_VertexBuffer,
+		&m_VertexBufferAllocation
+	);
+
+	CreateBuffer(
+		m_Device,
+		m_pAllocator,
+		sizeof(GeometryIndex) * static_cast<VkDeviceSize>(indexCapacity),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Geometry,
+		&m_IndexBuffer,
+		&m_IndexBufferAllocation
+	);
+
+	m_VertexRanges.Init(vertexCapacity);
+	m_IndexRanges.Init(indexCapacity);
+
+	m_Allocations.clear();
+	m_FreeHandles.clear();
+}
+
+void GeometryBuffer::Destroy()
+{
+	DestroyBuffer(m_Device, m_pAllocator, m_IndexBuffer, &m_IndexBufferAllocation);
+	DestroyBuffer(m_Device, m_pAllocator, m_VertexBuffer, &m_VertexBufferAllocation);
+
+	m_IndexBuffer = VK_NULL_HANDLE;
+	m_VertexBuffer = VK_NULL_HANDLE;
+}
+
+GeometryHandle GeometryBuffer::Upload(TransferContext* transferContext, const std::vector<uint8_t>& vertexData, const std::vector<GeometryIndex>& indices)
+{
+	GeometryRange range{};
+	range.vertexCount = static_cast<uint32_t>(vertexData.size() / m_VertexStride);
+	range.indexCount = static_cast<uint32_t>(indices.size());
+
+	uint32_t vertexOffset{};
+	if (!m_VertexRanges.Allocate(range.vertexCount, &vertexOffset))
+	{
+		throw std::runtime_error("Geometry vertex buffer is full");
+	}
+
+	if (!m_IndexRanges.Allocate(range.indexCount, &range.firstIndex))
+	{
+		m_VertexRanges.Free(vertexOffset, range.vertexCount);
+		throw std::runtime_error("Geometry index buffer is full");
+	}
+
+	range.vertexOffset = static_cast<int32_t>(vertexOffset);
+
+	// Stage data and record copies into this mesh's part of the shared buffers
+	transferContext->UploadToBuffer(m_VertexBuffer, vertexData.data(), vertexData.size(), static_cast<VkDeviceSize>(m_VertexStride) * vertexOffset);
+	transferContext->UploadToBuffer(m_IndexBuffer, indices.data(), sizeof(GeometryIndex) * indices.size(), sizeof(GeometryIndex) * static_cast<VkDeviceSize>(range.firstIndex));
+
+	// Reuse released handles so the table doesn't grow when content is swapped
+	GeometryHandle handle{};
+	if (!m_FreeHandles.empty())
+	{
+		handle = m_FreeHandles.back();
+		m_FreeHandles.pop_back();
+	}
+	else
+	{
+		handle = static_cast<GeometryHandle>(m_Allocations.size());
+		m_Allocations.emplace_back();
+	}
+
+	GeometryAllocation& allocation = m_Allocations[handle];
+	allocation.range = range;
+	allocation.uploadToken = transferContext->GetRecordingToken();
+	allocation.isLive = true;
+
+	return handle;
+}
+
+void GeometryBuffer::Free(GeometryHandle handle)
+{
+	if (handle == INVALID_GEOMETRY_HANDLE || !m_Allocations[handle].isLive)
+	{
+		return;
+	}
+
+	FreeRange(m_Allocations[handle].range);
+
+	m_Allocations[handle] = GeometryAllocation{};
+	m_FreeHandles.push_back(handle);
+}
+
+void GeometryBuffer::FreeRange(const GeometryRange& range)
+{
+	m_VertexRanges.Free(static_cast<uint32_t>(range.vertexOffset), range.vertexCount);
+	m_IndexRanges.Free(range.firstIndex, range.indexCount);
+}
+
+void GeometryBuffer::RecordCompaction(VkCommandBuffer commandBuffer, TransferContext* transferContext, std::vector<GeometryRange>* retiredRanges,
+	uint32_t maxMoves)
+{
+	if (!m_VertexRanges.IsFragmented() && !m_IndexRanges.IsFragmented())
+	{
+		return;
+	}
+
+	std::vector<VkBufferCopy> vertexCopies{};
+	std::vector<VkBufferCopy> indexCopies{};
+
+	for (uint32_t move{}; move < maxMoves; ++move)
+	{
+		bool moved{ false };
+
+		// Vertex part: only indices are relative to vertexOffset, so the data is copied as is
+		const GeometryHandle vertexHandle = FindHighestAllocation(transferContext, true);
+		if (vertexHandle != INVALID_GEOMETRY_HANDLE)
+		{
+			GeometryRange& range = m_Allocations[vertexHandle].range;
+			const uint32_t oldOffset = static_cast<uint32_t>(range.vertexOffset);
+
+			uint32_t newOffset{};
+			if (m_VertexRanges.Allocate(range.vertexCount, &newOffset, oldOffset))
+			{
+				const VkDeviceSize stride = m_VertexStride;
+				vertexCopies.push_back({ stride * oldOffset, stride * newOffset, stride * range.vertexCount });
+
+				GeometryRange retired{};
+				retired.vertexOffset = range.vertexOffset;
+				retired.vertexCount = range.vertexCount;
+				retiredRanges->push_back(retired);
+
+				range.vertexOffset = static_cast<int32_t>(newOffset);
+				moved = true;
+			}
+		}
+
+		const GeometryHandle indexHandle = FindHighestAllocation(transferContext, false);
+		if (indexHandle != INVALID_GEOMETRY_HANDLE)
+		{
+			GeometryRange& range = m_Allocations[indexHandle].range;
+
+			uint32_t newFirstIndex{};
+			if (m_IndexRanges.Allocate(range.indexCount, &newFirstIndex, range.firstIndex))
+			{
+				indexCopies.push_back({ sizeof(GeometryIndex) * static_cast<VkDeviceSize>(range.firstIndex), sizeof(GeometryIndex) * static_cast<VkDeviceSize>(newFirstIndex),
+					sizeof(GeometryIndex) * static_cast<VkDeviceSize>(range.indexCount) });
+
+				GeometryRange retired{};
+				retired.firstIndex = range.firstIndex;
+				retired.indexCount = range.indexCount;
+				retiredRanges->push_back(retired);
+
+				range.firstIndex = newFirstIndex;
+				moved = true;
+			}
+		}
+
+		// Highest ranges don't fit any lower hole, nothing left to gain
+		if (!moved)
+		{
+			break;
+		}
+	}
+
+	if (vertexCopies.empty() && indexCopies.empty())
+	{
+		return;
+	}
+
+	// Sources were last written by uploads (acquired for vertex input) or earlier compactions
+	VkMemoryBarrier copyBarrier{};
+	copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	copyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	copyBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+
+	// Old and new ranges never overlap, new one was free
+	if (!vertexCopies.empty())
+	{
+		vkCmdCopyBuffer(commandBuffer, m_VertexBuffer, m_VertexBuffer, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+	}
+
+	if (!indexCopies.empty())
+	{
+		vkCmdCopyBuffer(commandBuffer, m_IndexBuffer, m_IndexBuffer, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+	}
+
+	// Moved data must be visible to the draws recorded after this
+	VkMemoryBarrier drawBarrier{};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
+
+GeometryHandle GeometryBuffer::FindHighestAllocation(TransferContext* transferContext, bool vertices) const
+{
+	GeometryHandle highest = INVALID_GEOMETRY_HANDLE;
+	uint32_t highestOffset{};
+
+	for (size_t i{}; i < m_Allocations.size(); ++i)
+	{
+		const GeometryAllocation& allocation = m_Allocations[i];
+		const uint32_t count = vertices ? allocation.range.vertexCount : allocation.range.indexCount;
+		if (!allocation.isLive || count == 0)
+		{
+			continue;
+		}
+
+		const uint32_t offset = vertices ? static_cast<uint32_t>(allocation.range.vertexOffset) : allocation.range.firstIndex;
+		if (highest != INVALID_GEOMETRY_HANDLE && offset < highestOffset)
+		{
+			continue;
+		}
+
+		// Still being written by the transfer queue
+		if (!transferContext->IsComplete(allocation.uploadToken))
+		{
+			continue;
+		}
+
+		highest = static_cast<GeometryHandle>(i);
+		highestOffset = offset;
+	}
+
+	return highest;
+}
+
+void GeometryBuffer::Bind(VkCommandBuffer commandBuffer) const
+{
+	const VkBuffer vertexBuffers[] = { m_VertexBuffer };	// Buffers to bind
+	const VkDeviceSize offsets[] = { 0 };					// Offsets into buffers being bound
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+	// Indices are relative to each mesh, draws add their vertex offset
+	vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer, 0, GEOMETRY_INDEX_TYPE);
+}
+
+void GeometryBuffer::RangeAllocator::Init(uint32_t capacity)
+{
+	m_Capacity = capacity;
+	m_FreeRanges.clear();
+	m_FreeRanges.push_back({ 0, capacity });
+}
+
+bool GeometryBuffer::RangeAllocator::Allocate(uint32_t count, uint32_t* offset, uint32_t limit)
+{
+	for (size_t i{}; i < m_FreeRanges.size() && m_FreeRanges[i].offset < limit; ++i)
+	{
+		FreeRange& freeRange = m_FreeRanges[i];
+		if (freeRange.count < count)
+		{
+			continue;
+		}
+
+		*offset = freeRange.offset;
+
+		// Take from the front of the range, drop it once used up
+		freeRange.offset += count;
+		freeRange.count -= count;
+		if (freeRange.count == 0)
+		{
+			m_FreeRanges.erase(m_FreeRanges.begin() + i);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+void GeometryBuffer::RangeAllocator::Free(uint32_t offset, uint32_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Find first free range after the freed one
+	size_t next{};
+	while (next < m_FreeRanges.size() && m_FreeRanges[next].offset < offset)
+	{
+		++next;
+	}
+
+	const bool mergePrev = next > 0 && m_FreeRanges[next - 1].offset + m_FreeRanges[next - 1].count == offset;
+	const bool mergeNext = next < m_FreeRanges.size() && offset + count == m_FreeRanges[next].offset;
+
+	if (mergePrev && mergeNext)
+	{
+		m_FreeRanges[next - 1].count += count + m_FreeRanges[next].count;
+		m_FreeRanges.erase(m_FreeRanges.begin() + next);
+	}
+	else if (mergePrev)
+	{
+		m_FreeRanges[next - 1].count += count;
+	}
+	else if (mergeNext)
+	{
+		m_FreeRanges[next].offset = offset;
+		m_FreeRanges[next].count += count;
+	}
+	else
+	{
+		m_FreeRanges.insert(m_FreeRanges.begin() + next, { offset, count });
+	}
+}
+
+bool GeometryBuffer::RangeAllocator::IsFragmented() const
+{
+	if (m_FreeRanges.empty())
+	{
+		return false;
+	}
+
+	return m_FreeRanges.size() > 1 || m_FreeRanges.back().offset + m_FreeRanges.back().count != m_Capacity;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "Utilities.h"
+#include "TransferContext.h"
+
+// Index type of the shared index buffer, meshes are split into chunks that fit it at import
+using GeometryIndex = uint16_t;
+const VkIndexType GEOMETRY_INDEX_TYPE = VK_INDEX_TYPE_UINT16;
+
+// Default number of vertices / indices the shared geometry buffers can hold
+const uint32_t DEFAULT_GEOMETRY_VERTEX_CAPACITY = 1u << 20;
+const uint32_t DEFAULT_GEOMETRY_INDEX_CAPACITY = 1u << 22;
+
+// Place of a mesh's data inside the shared geometry buffers (in elements, not bytes)
+struct GeometryRange
+{
+	int32_t vertexOffset{};			// Added to each index by vkCmdDrawIndexed
+	uint32_t vertexCount{};
+	uint32_t firstIndex{};
+	uint32_t indexCount{};
+};
+
+// Stable id of a mesh's geometry, its range may move when the buffers are compacted
+using GeometryHandle = uint32_t;
+const GeometryHandle INVALID_GEOMETRY_HANDLE = ~0u;
+
+// Default number of ranges moved per frame when compacting
+const uint32_t DEFAULT_GEOMETRY_COMPACTION_MOVES = 4;
+
+// One large vertex and one large index buffer all meshes sub-allocate from,
+// so geometry is bound once and draws only differ in offsets.
+class GeometryBuffer final
+{
+public:
+	GeometryBuffer() = default;
+	~GeometryBuffer() = default;
+
+	GeometryBuffer(const GeometryBuffer&) = delete;
+	GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+
+	// vertexStride: size of one vertex in bytes, every mesh in the buffer uses the same vertex format
+	void Init(VkDevice device, MemoryAllocator* allocator, uint32_t vertexStride,
+		uint32_t vertexCapacity = DEFAULT_GEOMETRY_VERTEX_CAPACITY, uint32_t indexCapacity = DEFAULT_GEOMETRY_INDEX_CAPACITY);
+	void Destroy();
+
+	// Reserve space and record the upload of the mesh data (indices stay relative to the mesh's first vertex)
+	GeometryHandle Upload(TransferContext* transferContext, const std::vector<uint8_t>& vertexData, const std::vector<GeometryIndex>& indices);
+
+	// Return the ranges immediately, caller makes sure the GPU no longer reads them
+	void Free(GeometryHandle handle);
+	void FreeRange(const GeometryRange& range);
+
+	const GeometryRange& GetRange(GeometryHandle handle) const { return m_Allocations[handle].range; }
+
+	// Move the highest ranges down into free holes so freed space ends up at the end of the buffers.
+	// Copies are recorded on the graphics queue (outside a render pass) and draws recorded after it already use the new ranges.
+	// The ranges moved away from are returned and must be freed once the command buffer has completed.
+	void RecordCompaction(VkCommandBuffer commandBuffer, TransferContext* transferContext, std::vector<GeometryRange>* retiredRanges,
+		uint32_t maxMoves = DEFAULT_GEOMETRY_COMPACTION_MOVES);
+
+	// Bind shared buffers once before issuing draws
+	void Bind(VkCommandBuffer commandBuffer) const;
+
+	VkBuffer GetVertexBuffer() const { return m_VertexBuffer; }
+	VkBuffer GetIndexBuffer() const { return m_IndexBuffer; }
+	uint32_t GetVertexStride() const { return m_VertexStride; }
+	bool IsInitialized() const { return m_VertexBuffer != VK_NULL_HANDLE; }
+
+private:
+	// First-fit free list over element ranges, neighbours are merged on free
+	class RangeAllocator final
+	{
+	public:
+		void Init(uint32_t capacity);
+		bool Allocate(uint32_t count, uint32_t* offset, uint32_t limit = ~0u);		// Only ranges starting below limit are used
+		void Free(uint32_t offset, uint32_t count);
+
+		// Free space is not one range at the end
+		bool IsFragmented() const;
+
+	private:
+		struct FreeRange
+		{
+			uint32_t offset{};
+			uint32_t count{};
+		};
+
+		std::vector<FreeRange> m_FreeRanges{};		// Sorted by offset
+		uint32_t m_Capacity{};
+	};
+
+	struct GeometryAllocation
+	{
+		GeometryRange range{};
+		TransferToken uploadToken{};		// Data can't be moved before its upload completed
+		bool isLive{ false };
+	};
+
+	VkDevice m_Device{};
+	MemoryAllocator* m_pAllocator{};
+
+	uint32_t m_VertexStride{};
+
+	VkBuffer m_VertexBuffer{};
+	Allocation m_VertexBufferAllocation{};
+	RangeAllocator m_VertexRanges{};
+
+	VkBuffer m_IndexBuffer{};
+	Allocation m_IndexBufferAllocation{};
+	RangeAllocator m_IndexRanges{};
+
+	std::vector<GeometryAllocation> m_Allocations{};	// Indexed by handle
+	std::vector<GeometryHandle> m_FreeHandles{};
+
+	// Highest live, fully uploaded allocation in the vertex or index buffer (INVALID_GEOMETRY_HANDLE if none)
+	GeometryHandle FindHighestAllocation(TransferContext* transferContext, bool vertices) const;
+};
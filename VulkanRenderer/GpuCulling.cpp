@@ -0,0 +1,363 @@
+#include "GpuCulling.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+void GpuCulling::Init(VkDevice device, MemoryAllocator* allocator, VkDeviceSize storageAlignment, uint32_t frameCount, uint32_t maxDraws)
+{
+	m_Device = device;
+	m_pAllocator = allocator;
+	m_FrameCount = frameCount;
+	m_MaxDraws = maxDraws;
+	m_MaxGroups = (m_MaxDraws + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+
+	// Graphics binds the draw data output with a dynamic offset per frame and phase
+	if (GetDrawDataRange() % storageAlignment != 0)
+	{
+		throw std::runtime_error("Culled draw data slice isn't a multiple of the storage buffer offset alignment");
+	}
+
+	const uint32_t sliceCount = m_FrameCount * CULL_PHASE_COUNT;
+
+	CreateBuffer(m_Device, m_pAllocator, sizeof(VkDrawIndexedIndirectCommand) * m_MaxDraws * sliceCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Other, &m_CommandBuffer, &m_CommandAllocation);
+
+	CreateBuffer(m_Device, m_pAllocator, GetDrawDataRange() * sliceCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Other, &m_DrawDataBuffer, &m_DrawDataAllocation);
+
+	// A batch holds at least one draw, so there are never more batches than draws
+	CreateBuffer(m_Device, m_pAllocator, sizeof(uint32_t) * m_MaxDraws * sliceCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Other, &m_CountBuffer, &m_CountAllocation);
+
+	CreateBuffer(m_Device, m_pAllocator, sizeof(uint32_t) * m_MaxDraws * m_FrameCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Other, &m_OcclusionBuffer, &m_OcclusionAllocation);
+
+	CreateBuffer(m_Device, m_pAllocator, sizeof(uint32_t) * m_MaxDraws * m_FrameCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Other, &m_ScanBuffer, &m_ScanAllocation);
+
+	CreateBuffer(m_Device, m_pAllocator, sizeof(uint32_t) * m_MaxGroups * m_FrameCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Other, &m_GroupSumBuffer, &m_GroupSumAllocation);
+
+	// Read on the host without staging, a frame's counts are tiny
+	CreateBuffer(m_Device, m_pAllocator, sizeof(GpuCullingStatistics) * m_FrameCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		MemoryCategory::Other, &m_StatisticsBuffer, &m_StatisticsAllocation);
+	std::memset(m_StatisticsAllocation.mappedData, 0, sizeof(GpuCullingStatistics) * m_FrameCount);
+
+	CreateDescriptorSet();
+	CreatePipelineLayout();
+	m_CullPipeline = CreatePipeline("Shaders/cull.spv");
+	m_ScanPipeline = CreatePipeline("Shaders/cull_scan.spv");
+	m_CompactPipeline = CreatePipeline("Shaders/cull_compact.spv");
+}
+
+void GpuCulling::Destroy()
+{
+	vkDestroyPipeline(m_Device, m_CullPipeline, nullptr);
+	vkDestroyPipeline(m_Device, m_ScanPipeline, nullptr);
+	vkDestroyPipeline(m_Device, m_CompactPipeline, nullptr);
+	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+	vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_Device, m_SetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_Device, m_DepthPyramidSetLayout, nullptr);
+	m_CullPipeline = VK_NULL_HANDLE;
+	m_ScanPipeline = VK_NULL_HANDLE;
+	m_CompactPipeline = VK_NULL_HANDLE;
+
+	DestroyBuffer(m_Device, m_pAllocator, m_CommandBuffer, &m_CommandAllocation);
+	DestroyBuffer(m_Device, m_pAllocator, m_DrawDataBuffer, &m_DrawDataAllocation);
+	DestroyBuffer(m_Device, m_pAllocator, m_CountBuffer, &m_CountAllocation);
+	DestroyBuffer(m_Device, m_pAllocator, m_OcclusionBuffer, &m_OcclusionAllocation);
+	DestroyBuffer(m_Device, m_pAllocator, m_ScanBuffer, &m_ScanAllocation);
+	DestroyBuffer(m_Device, m_pAllocator, m_GroupSumBuffer, &m_GroupSumAllocation);
+	DestroyBuffer(m_Device, m_pAllocator, m_StatisticsBuffer, &m_StatisticsAllocation);
+}
+
+void GpuCulling::WriteInputDescriptors(VkBuffer transformBuffer, VkDeviceSize transformRange, VkBuffer drawDataBuffer, VkDeviceSize drawDataRange,
+	VkBuffer commandBuffer, VkDeviceSize commandRange, VkBuffer instanceBuffer, VkBuffer viewProjectionBuffer, VkDeviceSize viewProjectionRange)
+{
+	// Bindings in shader order: transforms, draw data, commands, instances, visible commands, visible draw data, counts, view projection,
+	// occlusion results, statistics, scan results, workgroup sums
+	const std::array<VkDescriptorBufferInfo, 12> bufferInfos = { {
+		{ transformBuffer, 0, transformRange },
+		{ drawDataBuffer, 0, drawDataRange },
+		{ commandBuffer, 0, commandRange },
+		{ instanceBuffer, 0, VK_WHOLE_SIZE },			// Draws address instances by absolute firstInstance
+		{ m_CommandBuffer, 0, VK_WHOLE_SIZE },
+		{ m_DrawDataBuffer, 0, VK_WHOLE_SIZE },
+		{ m_CountBuffer, 0, VK_WHOLE_SIZE },
+		{ viewProjectionBuffer, 0, viewProjectionRange },
+		{ m_OcclusionBuffer, 0, VK_WHOLE_SIZE },
+		{ m_StatisticsBuffer, 0, VK_WHOLE_SIZE },
+		{ m_ScanBuffer, 0, VK_WHOLE_SIZE },
+		{ m_GroupSumBuffer, 0, VK_WHOLE_SIZE }
+	} };
+
+	std::array<VkWriteDescriptorSet, 12> setWrites{};
+	for (uint32_t i{}; i < static_cast<uint32_t>(setWrites.size()); ++i)
+	{
+		setWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[i].dstSet = m_DescriptorSet;
+		setWrites[i].dstBinding = i;
+		setWrites[i].dstArrayElement = 0;
+		setWrites[i].descriptorType = GetDescriptorType(i);
+		setWrites[i].descriptorCount = 1;
+		setWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+}
+
+void GpuCulling::RecordCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t phase, bool occlusion, const std::vector<DrawBatch>& batches,
+	uint32_t transformOffset, uint32_t drawDataOffset, uint32_t commandOffset, uint32_t viewProjectionOffset)
+{
+	const uint32_t frameSlot = frameIndex % m_FrameCount;
+
+	if (phase == 0)
+	{
+		// Counted with atomics by both phases
+		vkCmdFillBuffer(commandBuffer, m_StatisticsBuffer, sizeof(GpuCullingStatistics) * frameSlot, sizeof(GpuCullingStatistics), 0);
+
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// All three passes share the layout, so the sets stay bound across pipeline switches.
+	// In binding order, only the buffer set has dynamic bindings
+	const std::array<VkDescriptorSet, 2> descriptorSets = { m_DescriptorSet, m_DepthPyramidSet };
+	const std::array<uint32_t, 4> dynamicOffsets = { transformOffset, drawDataOffset, commandOffset, viewProjectionOffset };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(),
+		static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+	// Batches are contiguous runs of the sorted draws, so the passes run over all draws at once
+	const uint32_t drawCount = batches.empty() ? 0 : batches.back().firstDraw + batches.back().drawCount;
+	const uint32_t groupCount = (drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+
+	PushCull pushCull{};
+	pushCull.drawCount = drawCount;
+	pushCull.outputBase = GetSliceIndex(frameIndex, phase) * m_MaxDraws;
+	pushCull.occlusionBase = frameSlot * m_MaxDraws;
+	pushCull.scanBase = frameSlot * m_MaxDraws;
+	pushCull.groupSumBase = frameSlot * m_MaxGroups;
+	pushCull.frameIndex = frameSlot;
+	pushCull.phase = phase;
+	pushCull.occlusion = occlusion ? 1 : 0;
+	vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushCull), &pushCull);
+
+	if (groupCount > 0)
+	{
+		// Each pass reads what the previous one wrote
+		VkMemoryBarrier scanBarrier{};
+		scanBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		scanBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		scanBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipeline);
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &scanBarrier, 0, nullptr, 0, nullptr);
+
+		// One workgroup scans every workgroup sum, there are at most MAX_DRAWS / CULL_GROUP_SIZE of them
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ScanPipeline);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &scanBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CompactPipeline);
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+	}
+
+	// Visible commands and counts are read by indirect draws, draw data by vertex shaders.
+	// Occlusion results by the second phase and the statistics by the host once the frame's fence signalled
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+GpuCullingStatistics GpuCulling::GetStatistics(uint32_t frameIndex) const
+{
+	const auto* pStatistics = static_cast<const GpuCullingStatistics*>(m_StatisticsAllocation.mappedData);
+	return pStatistics[frameIndex % m_FrameCount];
+}
+
+uint32_t GpuCulling::GetSliceIndex(uint32_t frameIndex, uint32_t phase) const
+{
+	return (frameIndex % m_FrameCount) * CULL_PHASE_COUNT + phase;
+}
+
+VkDeviceSize GpuCulling::GetCommandOffset(uint32_t frameIndex, uint32_t phase) const
+{
+	return sizeof(VkDrawIndexedIndirectCommand) * m_MaxDraws * GetSliceIndex(frameIndex, phase);
+}
+
+VkDeviceSize GpuCulling::GetCountOffset(uint32_t frameIndex, uint32_t phase) const
+{
+	return sizeof(uint32_t) * m_MaxDraws * GetSliceIndex(frameIndex, phase);
+}
+
+VkDeviceSize GpuCulling::GetDrawDataRange() const
+{
+	return sizeof(DrawData) * m_MaxDraws;
+}
+
+uint32_t GpuCulling::GetDrawDataOffset(uint32_t frameIndex, uint32_t phase) const
+{
+	return static_cast<uint32_t>(GetDrawDataRange() * GetSliceIndex(frameIndex, phase));
+}
+
+VkDescriptorType GpuCulling::GetDescriptorType(uint32_t binding)
+{
+	// Ring slices are dynamic: transforms, draw data and commands are storage, the view projection is uniform
+	if (binding == 7)
+	{
+		return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	}
+
+	return binding < 3 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+}
+
+void GpuCulling::CreateDescriptorSet()
+{
+	// Inputs are frame slices of the rings (dynamic), instances and outputs are addressed with absolute indices
+	std::array<VkDescriptorSetLayoutBinding, 12> layoutBindings{};
+	for (uint32_t i{}; i < static_cast<uint32_t>(layoutBindings.size()); ++i)
+	{
+		layoutBindings[i].binding = i;
+		layoutBindings[i].descriptorType = GetDescriptorType(i);
+		layoutBindings[i].descriptorCount = 1;
+		layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+	layoutCreateInfo.pBindings = layoutBindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(m_Device, &layoutCreateInfo, nullptr, &m_SetLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error creating culling descriptor layout");
+	}
+
+	// Sets of this layout are allocated by the depth pyramid
+	VkDescriptorSetLayoutBinding pyramidBinding{};
+	pyramidBinding.binding = 0;
+	pyramidBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidBinding.descriptorCount = 1;
+	pyramidBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	layoutCreateInfo.bindingCount = 1;
+	layoutCreateInfo.pBindings = &pyramidBinding;
+
+	result = vkCreateDescriptorSetLayout(m_Device, &layoutCreateInfo, nullptr, &m_DepthPyramidSetLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error creating culling depth pyramid descriptor layout");
+	}
+
+	const std::array<VkDescriptorPoolSize, 3> poolSizes = { {
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 3 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 }
+	} };
+
+	VkDescriptorPoolCreateInfo poolCreateInfo{};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolCreateInfo.pPoolSizes = poolSizes.data();
+
+	result = vkCreateDescriptorPool(m_Device, &poolCreateInfo, nullptr, &m_DescriptorPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling descriptor pool");
+	}
+
+	VkDescriptorSetAllocateInfo setAllocInfo{};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = m_DescriptorPool;
+	setAllocInfo.descriptorSetCount = 1;
+	setAllocInfo.pSetLayouts = &m_SetLayout;
+
+	result = vkAllocateDescriptorSets(m_Device, &setAllocInfo, &m_DescriptorSet);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error allocating culling descriptor set");
+	}
+}
+
+void GpuCulling::CreatePipelineLayout()
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PushCull);
+
+	const std::array<VkDescriptorSetLayout, 2> setLayouts = { m_SetLayout, m_DepthPyramidSetLayout };
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	VkResult result = vkCreatePipelineLayout(m_Device, &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling pipeline layout");
+	}
+}
+
+VkPipeline GpuCulling::CreatePipeline(const std::string& shaderFile)
+{
+	const std::vector<char> shaderCode = ReadFile(shaderFile);
+
+	VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCreateInfo.codeSize = shaderCode.size();
+	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	VkShaderModule shaderModule{};
+	VkResult result = vkCreateShaderModule(m_Device, &shaderModuleCreateInfo, nullptr, &shaderModule);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shader module");
+	}
+
+	VkComputePipelineCreateInfo pipelineCreateInfo{};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = shaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = m_PipelineLayout;
+
+	VkPipeline pipeline{};
+	result = vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+	// Module is only needed to create the pipeline
+	vkDestroyShaderModule(m_Device, shaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling pipeline");
+	}
+
+	return pipeline;
+}
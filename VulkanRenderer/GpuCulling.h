@@ -0,0 +1,140 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "MemoryAllocator.h"
+#include "DrawList.h"
+
+// Occlusion culling runs two phases per frame, each drawn in its own render pass: the first tests every draw against the
+// frustum and last frame's depth pyramid (with last frame's camera), the second re-tests only the draws the first found
+// occluded against the pyramid built from the first phase's depth
+const uint32_t CULL_PHASE_COUNT = 2;
+
+// The cull shader samples the depth pyramid through a second set, owned by the pyramid so a resized pyramid comes with its
+// own set while frames in flight keep the previous one
+const uint32_t DEPTH_PYRAMID_SET = 1;
+
+// Draws culled on the GPU in a frame, read back once the frame's submit finished
+struct GpuCullingStatistics
+{
+	uint32_t frustumCulledCount{};		// Every instance outside the frustum
+	uint32_t occludedCount{};			// Inside the frustum but behind the depth pyramid in both phases
+};
+
+// Invocations per workgroup of the culling passes, matches GROUP_SIZE in the cull shaders
+const uint32_t CULL_GROUP_SIZE = 256;
+
+// Frustum and occlusion culling of the frame's indirect draws in three compute passes over all of its draws:
+// - cull.comp tests one draw per invocation (every instance until one is visible) and scans the visibility flags per workgroup
+// - cull_scan.comp scans the workgroups' visible counts, giving every draw its prefix over the whole frame
+// - cull_compact.comp moves the visible draws to the front of their batch's output range, keeping their sorted order,
+//   and writes the visible count of each batch for vkCmdDrawIndexedIndirectCount
+// Outputs are device local and split in a slice per frame in flight and phase, addressed by the same index as the input draws.
+class GpuCulling final
+{
+public:
+	GpuCulling() = default;
+	~GpuCulling() = default;
+
+	GpuCulling(const GpuCulling&) = delete;
+	GpuCulling& operator=(const GpuCulling&) = delete;
+
+	void Init(VkDevice device, MemoryAllocator* allocator, VkDeviceSize storageAlignment, uint32_t frameCount, uint32_t maxDraws);
+	void Destroy();
+
+	// Inputs are the per-frame rings, each range is one frame slice selected with dynamic offsets when recording.
+	// The frustum is extracted in the shader from the frame's view projection (projection, view, then last frame's view projection)
+	void WriteInputDescriptors(VkBuffer transformBuffer, VkDeviceSize transformRange, VkBuffer drawDataBuffer, VkDeviceSize drawDataRange,
+		VkBuffer commandBuffer, VkDeviceSize commandRange, VkBuffer instanceBuffer, VkBuffer viewProjectionBuffer, VkDeviceSize viewProjectionRange);
+
+	// Layout of DEPTH_PYRAMID_SET: every level of the pyramid (VK_IMAGE_LAYOUT_GENERAL) as a combined image sampler at binding 0
+	VkDescriptorSetLayout GetDepthPyramidSetLayout() const { return m_DepthPyramidSetLayout; }
+
+	// Pyramid occlusion is tested against, must be set before culling is recorded and again whenever the pyramid is resized
+	void SetDepthPyramid(VkDescriptorSet depthPyramidSet) { m_DepthPyramidSet = depthPyramidSet; }
+
+	// Must be recorded outside a render pass, ends with a barrier making the outputs visible to indirect draws and vertex shaders.
+	// Only buffer offsets are recorded, so the commands stay valid while the camera moves.
+	// Without occlusion only phase 0 is recorded and it only tests the frustum
+	void RecordCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t phase, bool occlusion, const std::vector<DrawBatch>& batches,
+		uint32_t transformOffset, uint32_t drawDataOffset, uint32_t commandOffset, uint32_t viewProjectionOffset);
+
+	// Counted by the last frame that used the slot, only valid once its submit finished
+	GpuCullingStatistics GetStatistics(uint32_t frameIndex) const;
+
+	// - Outputs of a frame's phase, visible draws of batch b start at its firstDraw and their count is at b
+	VkBuffer GetCommandBuffer() const { return m_CommandBuffer; }
+	VkDeviceSize GetCommandOffset(uint32_t frameIndex, uint32_t phase) const;
+	VkBuffer GetCountBuffer() const { return m_CountBuffer; }
+	VkDeviceSize GetCountOffset(uint32_t frameIndex, uint32_t phase) const;
+	VkBuffer GetDrawDataBuffer() const { return m_DrawDataBuffer; }
+	VkDeviceSize GetDrawDataRange() const;								// Size of one slice
+	uint32_t GetDrawDataOffset(uint32_t frameIndex, uint32_t phase) const;	// Dynamic offset of the slice
+
+	bool IsInitialized() const { return m_CullPipeline != VK_NULL_HANDLE; }
+
+private:
+	struct PushCull
+	{
+		uint32_t drawCount;				// All of the frame's draws
+		uint32_t outputBase;			// First element of the frame's and phase's output slices
+		uint32_t occlusionBase;			// First element of the frame's occlusion results
+		uint32_t scanBase;				// First element of the frame's scan results
+		uint32_t groupSumBase;			// First element of the frame's workgroup sums
+		uint32_t frameIndex;			// Statistics of the frame
+		uint32_t phase;
+		uint32_t occlusion;				// Test against the depth pyramid as well
+	};
+
+	VkDevice m_Device{};
+	MemoryAllocator* m_pAllocator{};
+	uint32_t m_FrameCount{};
+	uint32_t m_MaxDraws{};
+	uint32_t m_MaxGroups{};				// Cull workgroups needed for m_MaxDraws
+
+	VkDescriptorSetLayout m_SetLayout{};
+	VkDescriptorPool m_DescriptorPool{};
+	VkDescriptorSet m_DescriptorSet{};
+	VkDescriptorSetLayout m_DepthPyramidSetLayout{};
+	VkDescriptorSet m_DepthPyramidSet{};
+	VkPipelineLayout m_PipelineLayout{};
+	VkPipeline m_CullPipeline{};
+	VkPipeline m_ScanPipeline{};
+	VkPipeline m_CompactPipeline{};
+
+	// Visible draws (commands and draw data) and per-batch visible counts
+	VkBuffer m_CommandBuffer{};
+	Allocation m_CommandAllocation{};
+	VkBuffer m_DrawDataBuffer{};
+	Allocation m_DrawDataAllocation{};
+	VkBuffer m_CountBuffer{};
+	Allocation m_CountAllocation{};
+
+	// Per draw whether the first phase found it occluded, the second phase re-tests only those
+	VkBuffer m_OcclusionBuffer{};
+	Allocation m_OcclusionAllocation{};
+
+	// Per draw its visibility and prefix within its workgroup, per workgroup its visible count (then the prefix of the counts).
+	// Only live between the passes of one phase, sliced per frame in flight since frames can overlap on the GPU
+	VkBuffer m_ScanBuffer{};
+	Allocation m_ScanAllocation{};
+	VkBuffer m_GroupSumBuffer{};
+	Allocation m_GroupSumAllocation{};
+
+	// GpuCullingStatistics per frame in flight, host visible and cleared when the frame's first phase is recorded
+	VkBuffer m_StatisticsBuffer{};
+	Allocation m_StatisticsAllocation{};
+
+	uint32_t GetSliceIndex(uint32_t frameIndex, uint32_t phase) const;
+
+	static VkDescriptorType GetDescriptorType(uint32_t binding);
+	void CreateDescriptorSet();
+	void CreatePipelineLayout();
+	VkPipeline CreatePipeline(const std::string& shaderFile);
+};
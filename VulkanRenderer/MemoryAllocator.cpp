@@ -0,0 +1,549 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+	// Alignment padding smaller than this is counted as wasted instead of kept as a free range
+	constexpr VkDeviceSize MIN_FREE_RANGE_SIZE = 256;
+
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Check if the end of resource A and start of resource B land on the same bufferImageGranularity "page"
+	bool IsOnSamePage(VkDeviceSize offsetA, VkDeviceSize sizeA, VkDeviceSize offsetB, VkDeviceSize pageSize)
+	{
+		const VkDeviceSize endPageA = (offsetA + sizeA - 1) & ~(pageSize - 1);
+		const VkDeviceSize startPageB = offsetB & ~(pageSize - 1);
+		return endPageA == startPageB;
+	}
+
+	// Buffers (linear) and optimal images are not allowed to alias within the same page
+	bool HasGranularityConflict(AllocationType a, AllocationType b)
+	{
+		return a != AllocationType::Free && b != AllocationType::Free && a != b;
+	}
+
+	// Without VK_EXT_memory_budget assume the process can use most of a heap
+	constexpr VkDeviceSize ESTIMATED_BUDGET_PERCENT = 80;
+}
+
+const char* GetMemoryCategoryName(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MemoryCategory::Geometry:		return "Geometry";
+	case MemoryCategory::Texture:		return "Texture";
+	case MemoryCategory::RenderTarget:	return "RenderTarget";
+	case MemoryCategory::Uniform:		return "Uniform";
+	case MemoryCategory::Staging:		return "Staging";
+	default:							return "Other";
+	}
+}
+
+void MemoryAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudgetEnabled, VkDeviceSize preferredBlockSize)
+{
+	m_PhysicalDevice = physicalDevice;
+	m_Device = device;
+	m_MemoryBudgetEnabled = memoryBudgetEnabled;
+	m_PreferredBlockSize = preferredBlockSize;
+
+	// Cache memory properties so we don't query the driver on every allocation
+	vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &m_MemoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties{};
+	vkGetPhysicalDeviceProperties(m_PhysicalDevice, &deviceProperties);
+	m_BufferImageGranularity = std::max<VkDeviceSize>(1, deviceProperties.limits.bufferImageGranularity);
+	m_MaxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+
+	m_Pools.resize(m_MemoryProperties.memoryTypeCount);
+	m_HeapBytes.resize(m_MemoryProperties.memoryHeapCount);
+}
+
+void MemoryAllocator::Destroy()
+{
+	for (auto& pool : m_Pools)
+	{
+		for (auto& block : pool.blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE)
+			{
+				continue;
+			}
+
+			if (block.allocationCount > 0)
+			{
+				std::cerr << "[WARNING]: Memory block destroyed with " << block.allocationCount << " live allocations\n";
+			}
+
+			// Freeing memory implicitly unmaps it
+			vkFreeMemory(m_Device, block.memory, nullptr);
+		}
+
+		if (pool.dedicatedCount > 0)
+		{
+			std::cerr << "[WARNING]: " << pool.dedicatedCount << " dedicated allocations leaked\n";
+		}
+	}
+
+	m_Pools.clear();
+	m_HeapBytes.clear();
+	m_DeviceMemoryCount = 0;
+}
+
+Allocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationType type,
+	MemoryCategory category, bool dedicated)
+{
+	Allocation allocation{};
+	allocation.memoryTypeIndex = FindMemoryTypeIndex(requirements.memoryTypeBits, properties);
+	allocation.size = requirements.size;
+	allocation.category = category;
+
+	m_CategoryBytes[static_cast<size_t>(category)] += requirements.size;
+	m_CategoryAllocationCount[static_cast<size_t>(category)]++;
+
+	MemoryPool& pool = m_Pools[allocation.memoryTypeIndex];
+	const VkDeviceSize blockSize = GetBlockSize(allocation.memoryTypeIndex);
+
+	// Big resources would waste most of a block, so give them their own memory
+	if (dedicated || requirements.size > blockSize / 2)
+	{
+		allocation.memory = AllocateDeviceMemory(requirements.size, allocation.memoryTypeIndex, &allocation.mappedData);
+		allocation.offset = 0;
+		allocation.blockIndex = -1;
+
+		pool.dedicatedCount++;
+		pool.dedicatedBytes += requirements.size;
+
+		return allocation;
+	}
+
+	// Try to fit it in an existing block
+	VkDeviceSize offset{};
+	int32_t emptySlot = -1;
+	for (size_t i{}; i < pool.blocks.size(); ++i)
+	{
+		MemoryBlock& block = pool.blocks[i];
+		if (block.memory == VK_NULL_HANDLE)
+		{
+			emptySlot = static_cast<int32_t>(i);
+			continue;
+		}
+
+		if (TryAllocateFromBlock(block, requirements, type, &offset))
+		{
+			allocation.blockIndex = static_cast<int32_t>(i);
+			break;
+		}
+	}
+
+	// No room left, create a new block (reusing a released slot so block indices stay stable)
+	if (allocation.blockIndex < 0)
+	{
+		MemoryBlock newBlock{};
+		newBlock.size = blockSize;
+		newBlock.memory = AllocateDeviceMemory(blockSize, allocation.memoryTypeIndex, &newBlock.mappedData);
+		newBlock.suballocations.push_back({ 0, blockSize, 0, AllocationType::Free });
+
+		if (emptySlot >= 0)
+		{
+			pool.blocks[emptySlot] = std::move(newBlock);
+			allocation.blockIndex = emptySlot;
+		}
+		else
+		{
+			pool.blocks.push_back(std::move(newBlock));
+			allocation.blockIndex = static_cast<int32_t>(pool.blocks.size() - 1);
+		}
+
+		if (!TryAllocateFromBlock(pool.blocks[allocation.blockIndex], requirements, type, &offset))
+		{
+			throw std::runtime_error("Failed to sub-allocate from a fresh memory block");
+		}
+	}
+
+	const MemoryBlock& block = pool.blocks[allocation.blockIndex];
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	if (block.mappedData)
+	{
+		allocation.mappedData = static_cast<char*>(block.mappedData) + offset;
+	}
+
+	return allocation;
+}
+
+void MemoryAllocator::Free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	MemoryPool& pool = m_Pools[allocation.memoryTypeIndex];
+
+	m_CategoryBytes[static_cast<size_t>(allocation.category)] -= allocation.size;
+	m_CategoryAllocationCount[static_cast<size_t>(allocation.category)]--;
+
+	if (allocation.blockIndex < 0)
+	{
+		FreeDeviceMemory(allocation.memory, allocation.size, allocation.memoryTypeIndex);
+
+		pool.dedicatedCount--;
+		pool.dedicatedBytes -= allocation.size;
+	}
+	else
+	{
+		MemoryBlock& block = pool.blocks[allocation.blockIndex];
+		FreeFromBlock(block, allocation.offset);
+
+		// Release empty blocks, but keep one around so a load/unload pattern doesn't thrash vkAllocateMemory
+		if (block.allocationCount == 0)
+		{
+			uint32_t emptyBlocks{};
+			for (const auto& other : pool.blocks)
+			{
+				if (other.memory != VK_NULL_HANDLE && other.allocationCount == 0)
+				{
+					emptyBlocks++;
+				}
+			}
+
+			if (emptyBlocks > 1)
+			{
+				FreeDeviceMemory(block.memory, block.size, allocation.memoryTypeIndex);
+				block = MemoryBlock{};
+			}
+		}
+	}
+
+	allocation = Allocation{};
+}
+
+AllocatorStatistics MemoryAllocator::GetStatistics() const
+{
+	AllocatorStatistics stats{};
+	stats.deviceMemoryCount = m_DeviceMemoryCount;
+
+	for (const auto& pool : m_Pools)
+	{
+		stats.dedicatedAllocationCount += pool.dedicatedCount;
+		stats.allocationCount += pool.dedicatedCount;
+		stats.bytesReserved += pool.dedicatedBytes;
+		stats.bytesUsed += pool.dedicatedBytes;
+
+		for (const auto& block : pool.blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE)
+			{
+				continue;
+			}
+
+			stats.blockCount++;
+			stats.allocationCount += block.allocationCount;
+			stats.bytesReserved += block.size;
+
+			for (const auto& suballocation : block.suballocations)
+			{
+				if (suballocation.type == AllocationType::Free)
+				{
+					stats.bytesFree += suballocation.size;
+				}
+				else
+				{
+					stats.bytesUsed += suballocation.size - suballocation.padding;
+					stats.bytesWasted += suballocation.padding;
+				}
+			}
+		}
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::PrintStatistics() const
+{
+	const AllocatorStatistics stats = GetStatistics();
+	constexpr double toMiB = 1.0 / (1024.0 * 1024.0);
+
+	std::cout << "Device memory: " << stats.deviceMemoryCount << "/" << m_MaxAllocationCount << " allocations, "
+		<< stats.blockCount << " blocks, " << stats.dedicatedAllocationCount << " dedicated" << '\n';
+	std::cout << "  reserved: " << stats.bytesReserved * toMiB << " MiB, used: " << stats.bytesUsed * toMiB
+		<< " MiB, wasted: " << stats.bytesWasted * toMiB << " MiB, free: " << stats.bytesFree * toMiB << " MiB" << '\n';
+}
+
+MemoryBudget MemoryAllocator::GetBudget() const
+{
+	MemoryBudget budget{};
+	budget.heaps.resize(m_MemoryProperties.memoryHeapCount);
+
+	for (uint32_t i{}; i < m_MemoryProperties.memoryHeapCount; ++i)
+	{
+		HeapBudget& heap = budget.heaps[i];
+		heap.flags = m_MemoryProperties.memoryHeaps[i].flags;
+		heap.size = m_MemoryProperties.memoryHeaps[i].size;
+		heap.allocatorBytes = i < m_HeapBytes.size() ? m_HeapBytes[i] : 0;
+
+		// Estimate, replaced below when the driver reports the real values
+		heap.budget = heap.size * ESTIMATED_BUDGET_PERCENT / 100;
+		heap.usage = heap.allocatorBytes;
+	}
+
+	if (m_MemoryBudgetEnabled)
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+		memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		memoryProperties.pNext = &budgetProperties;
+
+		// Values change as memory is allocated by anyone in the process (and OS), so query every time
+		vkGetPhysicalDeviceMemoryProperties2(m_PhysicalDevice, &memoryProperties);
+
+		for (uint32_t i{}; i < m_MemoryProperties.memoryHeapCount; ++i)
+		{
+			budget.heaps[i].budget = budgetProperties.heapBudget[i];
+			budget.heaps[i].usage = budgetProperties.heapUsage[i];
+		}
+
+		budget.isDriverReported = true;
+	}
+
+	budget.categoryBytes = m_CategoryBytes;
+	budget.categoryAllocationCount = m_CategoryAllocationCount;
+
+	return budget;
+}
+
+void MemoryAllocator::PrintBudget() const
+{
+	const MemoryBudget budget = GetBudget();
+	constexpr double toMiB = 1.0 / (1024.0 * 1024.0);
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "Memory budget (" << (budget.isDriverReported ? "VK_EXT_memory_budget" : "estimated") << "):" << '\n';
+
+	for (size_t i{}; i < budget.heaps.size(); ++i)
+	{
+		const HeapBudget& heap = budget.heaps[i];
+		std::cout << "  heap " << i << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : " (host)")
+			<< " usage: " << heap.usage * toMiB << " / " << heap.budget * toMiB << " MiB budget, "
+			<< heap.allocatorBytes * toMiB << " MiB by renderer, heap size " << heap.size * toMiB << " MiB" << '\n';
+
+		if (heap.usage > heap.budget)
+		{
+			std::cerr << "[WARNING]: Memory heap " << i << " is over budget" << '\n';
+		}
+	}
+
+	for (size_t i{}; i < budget.categoryBytes.size(); ++i)
+	{
+		std::cout << "  " << GetMemoryCategoryName(static_cast<MemoryCategory>(i)) << ": " << budget.categoryBytes[i] * toMiB
+			<< " MiB in " << budget.categoryAllocationCount[i] << " allocations" << '\n';
+	}
+
+	std::cout << std::defaultfloat;
+}
+
+uint32_t MemoryAllocator::FindMemoryTypeIndex(uint32_t allowedTypes, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i{}; i < m_MemoryProperties.memoryTypeCount; i++)
+	{
+		// Index of memory type must match corresponding bit in allowed types
+		// Desired property bit flags are part of memory bit flags
+		if ((allowedTypes & (1 << i)) && (m_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find a suitable memory type");
+}
+
+VkDeviceSize MemoryAllocator::GetBlockSize(uint32_t memoryTypeIndex) const
+{
+	// Small heaps (e.g. the 256MB host visible device local heap) get smaller blocks
+	const uint32_t heapIndex = m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	const VkDeviceSize heapSize = m_MemoryProperties.memoryHeaps[heapIndex].size;
+
+	return std::min(m_PreferredBlockSize, heapSize / 8);
+}
+
+VkDeviceMemory MemoryAllocator::AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mappedData)
+{
+	if (m_MaxAllocationCount > 0 && m_DeviceMemoryCount >= m_MaxAllocationCount)
+	{
+		throw std::runtime_error("Exceeded maxMemoryAllocationCount");
+	}
+
+	VkMemoryAllocateInfo memAllocInfo{};
+	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAllocInfo.allocationSize = size;
+	memAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory{};
+	VkResult result = vkAllocateMemory(m_Device, &memAllocInfo, nullptr, &memory);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate device memory");
+	}
+
+	m_DeviceMemoryCount++;
+	m_HeapBytes[m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+
+	// Host visible memory stays mapped for its whole lifetime
+	*mappedData = nullptr;
+	if (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		result = vkMapMemory(m_Device, memory, 0, size, 0, mappedData);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to map device memory");
+		}
+	}
+
+	return memory;
+}
+
+void MemoryAllocator::FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex)
+{
+	// Freeing memory implicitly unmaps it
+	vkFreeMemory(m_Device, memory, nullptr);
+
+	m_DeviceMemoryCount--;
+	m_HeapBytes[m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex] -= size;
+}
+
+bool MemoryAllocator::TryAllocateFromBlock(MemoryBlock& block, const VkMemoryRequirements& requirements, AllocationType type, VkDeviceSize* offset)
+{
+	const VkDeviceSize alignment = std::max<VkDeviceSize>(1, requirements.alignment);
+
+	// Best fit: smallest free range that can hold the request
+	size_t bestIndex = block.suballocations.size();
+	VkDeviceSize bestOffset{};
+	VkDeviceSize bestSize = ~0ull;
+
+	for (size_t i{}; i < block.suballocations.size(); ++i)
+	{
+		const Suballocation& freeRange = block.suballocations[i];
+		if (freeRange.type != AllocationType::Free || freeRange.size < requirements.size || freeRange.size >= bestSize)
+		{
+			continue;
+		}
+
+		VkDeviceSize alignedOffset = AlignUp(freeRange.offset, alignment);
+
+		// Previous neighbour of different resource kind on the same page, push to next page
+		if (m_BufferImageGranularity > 1 && i > 0)
+		{
+			const Suballocation& previous = block.suballocations[i - 1];
+			if (HasGranularityConflict(previous.type, type) && IsOnSamePage(previous.offset, previous.size, alignedOffset, m_BufferImageGranularity))
+			{
+				alignedOffset = AlignUp(alignedOffset, m_BufferImageGranularity);
+			}
+		}
+
+		if (alignedOffset + requirements.size > freeRange.offset + freeRange.size)
+		{
+			continue;
+		}
+
+		// Next neighbour of different resource kind on the same page, can't use this range
+		if (m_BufferImageGranularity > 1 && i + 1 < block.suballocations.size())
+		{
+			const Suballocation& next = block.suballocations[i + 1];
+			if (HasGranularityConflict(next.type, type) && IsOnSamePage(alignedOffset, requirements.size, next.offset, m_BufferImageGranularity))
+			{
+				continue;
+			}
+		}
+
+		bestIndex = i;
+		bestOffset = alignedOffset;
+		bestSize = freeRange.size;
+	}
+
+	if (bestIndex == block.suballocations.size())
+	{
+		return false;
+	}
+
+	// Split free range into [free front gap] [used (with front padding)] [remaining free]
+	const Suballocation freeRange = block.suballocations[bestIndex];
+	const VkDeviceSize remaining = freeRange.size - (bestOffset - freeRange.offset) - requirements.size;
+
+	Suballocation used{};
+	used.offset = freeRange.offset;
+	used.padding = bestOffset - freeRange.offset;
+	used.size = used.padding + requirements.size;
+	used.type = type;
+
+	// Big alignment gaps (e.g. granularity pages) stay usable for smaller resources
+	if (used.padding >= MIN_FREE_RANGE_SIZE)
+	{
+		Suballocation gap{};
+		gap.offset = freeRange.offset;
+		gap.size = used.padding;
+		block.suballocations.insert(block.suballocations.begin() + bestIndex, gap);
+		bestIndex++;
+
+		used.offset = bestOffset;
+		used.size = requirements.size;
+		used.padding = 0;
+	}
+
+	block.suballocations[bestIndex] = used;
+
+	if (remaining > 0)
+	{
+		Suballocation rest{};
+		rest.offset = used.offset + used.size;
+		rest.size = remaining;
+		block.suballocations.insert(block.suballocations.begin() + bestIndex + 1, rest);
+	}
+
+	block.allocationCount++;
+	*offset = bestOffset;
+
+	return true;
+}
+
+void MemoryAllocator::FreeFromBlock(MemoryBlock& block, VkDeviceSize offset)
+{
+	for (size_t i{}; i < block.suballocations.size(); ++i)
+	{
+		Suballocation& suballocation = block.suballocations[i];
+		if (suballocation.type == AllocationType::Free || suballocation.offset + suballocation.padding != offset)
+		{
+			continue;
+		}
+
+		suballocation.type = AllocationType::Free;
+		suballocation.padding = 0;
+		block.allocationCount--;
+
+		// Merge with next free range
+		if (i + 1 < block.suballocations.size() && block.suballocations[i + 1].type == AllocationType::Free)
+		{
+			suballocation.size += block.suballocations[i + 1].size;
+			block.suballocations.erase(block.suballocations.begin() + i + 1);
+		}
+
+		// Merge with previous free range
+		if (i > 0 && block.suballocations[i - 1].type == AllocationType::Free)
+		{
+			block.suballocations[i - 1].size += block.suballocations[i].size;
+			block.suballocations.erase(block.suballocations.begin() + i);
+		}
+
+		return;
+	}
+
+	throw std::runtime_error("Tried to free memory that was not allocated from this block");
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <vector>
+
+// Default size of a single device memory block that sub-allocations are carved from
+const VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+// Kind of resource bound to an allocation, buffers and linear images may not share a
+// bufferImageGranularity "page" with optimal tiled images.
+enum class AllocationType
+{
+	Free,
+	Buffer,
+	Image
+};
+
+// What an allocation is used for, tracked so usage can be compared against the budget per category
+enum class MemoryCategory
+{
+	Geometry,
+	Texture,
+	RenderTarget,
+	Uniform,
+	Staging,
+	Other,
+	Count
+};
+
+const char* GetMemoryCategoryName(MemoryCategory category);
+
+// Handle to a piece of device memory, either sub-allocated from a block or dedicated
+struct Allocation
+{
+	VkDeviceMemory memory{};		// Memory object the resource must be bound to
+	VkDeviceSize offset{};			// Offset inside memory object to bind at
+	VkDeviceSize size{};			// Size requested by the resource
+	void* mappedData{};				// Host pointer to offset if memory is host visible (persistently mapped)
+
+	uint32_t memoryTypeIndex{};
+	int32_t blockIndex{ -1 };		// Index of block in memory type pool, -1 means dedicated allocation
+	MemoryCategory category{ MemoryCategory::Other };
+};
+
+struct AllocatorStatistics
+{
+	uint32_t blockCount{};					// Number of shared blocks
+	uint32_t dedicatedAllocationCount{};	// Number of allocations that own their VkDeviceMemory
+	uint32_t allocationCount{};				// Number of live allocations (sub + dedicated)
+	uint32_t deviceMemoryCount{};			// Number of vkAllocateMemory calls alive (blocks + dedicated)
+
+	VkDeviceSize bytesReserved{};			// Total device memory allocated from the driver
+	VkDeviceSize bytesUsed{};				// Bytes handed out to resources
+	VkDeviceSize bytesWasted{};				// Bytes lost to alignment and granularity padding
+	VkDeviceSize bytesFree{};				// Bytes still available inside blocks
+};
+
+struct HeapBudget
+{
+	VkMemoryHeapFlags flags{};
+	VkDeviceSize size{};					// Total size of the heap
+	VkDeviceSize budget{};					// How much the process can use before risking eviction or failure
+	VkDeviceSize usage{};					// Process usage of the heap (whole process if reported by the driver)
+	VkDeviceSize allocatorBytes{};			// Device memory this allocator holds in the heap
+};
+
+struct MemoryBudget
+{
+	bool isDriverReported{};				// VK_EXT_memory_budget available, otherwise budget is estimated
+	std::vector<HeapBudget> heaps{};
+
+	// Bytes and allocation count handed out per MemoryCategory
+	std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::Count)> categoryBytes{};
+	std::array<uint32_t, static_cast<size_t>(MemoryCategory::Count)> categoryAllocationCount{};
+};
+
+class MemoryAllocator final
+{
+public:
+	MemoryAllocator() = default;
+	~MemoryAllocator() = default;
+
+	MemoryAllocator(const MemoryAllocator&) = delete;
+	MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+	// memoryBudgetEnabled: VK_EXT_memory_budget was enabled on the device
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudgetEnabled, VkDeviceSize preferredBlockSize = DEFAULT_MEMORY_BLOCK_SIZE);
+	void Destroy();
+
+	// Sub-allocate memory matching the requirements, large requests (or dedicated = true) get their own VkDeviceMemory
+	Allocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationType type,
+		MemoryCategory category, bool dedicated = false);
+	void Free(Allocation& allocation);
+
+	AllocatorStatistics GetStatistics() const;
+	void PrintStatistics() const;
+
+	// Per-heap budget/usage and per-category accounting
+	MemoryBudget GetBudget() const;
+	void PrintBudget() const;
+
+	uint32_t FindMemoryTypeIndex(uint32_t allowedTypes, VkMemoryPropertyFlags properties) const;
+	const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const { return m_MemoryProperties; }
+
+private:
+	// Range inside a block, the list of ranges always covers the whole block
+	struct Suballocation
+	{
+		VkDeviceSize offset{};
+		VkDeviceSize size{};
+		VkDeviceSize padding{};				// Bytes at the front of range skipped for alignment
+		AllocationType type{ AllocationType::Free };
+	};
+
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory{};
+		VkDeviceSize size{};
+		void* mappedData{};
+		std::vector<Suballocation> suballocations{};	// Sorted by offset
+		uint32_t allocationCount{};
+	};
+
+	struct MemoryPool
+	{
+		std::vector<MemoryBlock> blocks{};
+		uint32_t dedicatedCount{};
+		VkDeviceSize dedicatedBytes{};
+	};
+
+	VkPhysicalDevice m_PhysicalDevice{};
+	VkDevice m_Device{};
+	VkPhysicalDeviceMemoryProperties m_MemoryProperties{};
+	VkDeviceSize m_BufferImageGranularity{ 1 };
+	uint32_t m_MaxAllocationCount{};
+	VkDeviceSize m_PreferredBlockSize{ DEFAULT_MEMORY_BLOCK_SIZE };
+	bool m_MemoryBudgetEnabled{ false };
+
+	std::vector<MemoryPool> m_Pools{};			// One pool per memory type
+	uint32_t m_DeviceMemoryCount{};
+
+	std::vector<VkDeviceSize> m_HeapBytes{};	// Device memory allocated per heap
+	std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::Count)> m_CategoryBytes{};
+	std::array<uint32_t, static_cast<size_t>(MemoryCategory::Count)> m_CategoryAllocationCount{};
+
+	VkDeviceSize GetBlockSize(uint32_t memoryTypeIndex) const;
+	VkDeviceMemory AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mappedData);
+	void FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex);
+
+	bool TryAllocateFromBlock(MemoryBlock& block, const VkMemoryRequirements& requirements, AllocationType type, VkDeviceSize* offset);
+	void FreeFromBlock(MemoryBlock& block, VkDeviceSize offset);
+};
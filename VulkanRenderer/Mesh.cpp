@@ -1,24 +1,24 @@
 #include "Mesh.h"
 
 Mesh::Mesh(
-	VkPhysicalDevice newPhysicalDevice, 
-	VkDevice newDevice, 
-	VkQueue transferQueue, 
-	VkCommandPool transferCommandPool, 
-	std::vector<Vertex>* vertices, 
-	std::vector<uint32_t>* indices,
-	int nexTexId
+	GeometryBuffer* geometryBuffer,
+	TransferContext* transferContext,
+	std::vector<uint8_t>* vertexData,
+	std::vector<GeometryIndex>* indices,
+	int nexTexId,
+	const VertexQuantization& quantization
 )
 {
-	m_VertexCount = (int32_t)vertices->size();
-	m_PhysicalDevice = newPhysicalDevice;
-	m_IndexCount = indices->size();
-	m_Device = newDevice;
-	CreateVertexBuffer(transferQueue, transferCommandPool, vertices);
-	CreateIndexBuffer(transferQueue, transferCommandPool, indices);
+	m_pGeometryBuffer = geometryBuffer;
+
+	// Sub-allocate from the shared vertex/index buffers, copies are only recorded here
+	// and execute when the context is flushed
+	m_GeometryHandle = m_pGeometryBuffer->Upload(transferContext, *vertexData, *indices);
+	m_UploadToken = transferContext->GetRecordingToken();
 
 	m_Model.model = glm::mat4(1.0f);
 	m_TexId = nexTexId;
+	m_Quantization = quantization;
 }
 
 void Mesh::SetModel(glm::mat4 newModel)
@@ -33,12 +33,7 @@ Model Mesh::GetModel()
 
 uint32_t Mesh::GetVertexCount()
 {
-	return m_VertexCount;
-}
-
-VkBuffer Mesh::GetVertexBuffer()
-{
-	return m_VertexBuffer;
+	return m_pGeometryBuffer->GetRange(m_GeometryHandle).vertexCount;
 }
 
 int Mesh::GetTexId()
@@ -46,122 +41,44 @@ int Mesh::GetTexId()
 	return m_TexId;
 }
 
-uint32_t Mesh::GetIndexCount()
+const VertexQuantization& Mesh::GetQuantization()
 {
-	return m_IndexCount;
+	return m_Quantization;
 }
 
-VkBuffer Mesh::GetIndexBuffer()
+const MeshBounds& Mesh::GetBounds()
 {
-	return m_IndexBuffer;
+	return m_Bounds;
 }
 
-void Mesh::DestroyBuffers()
+void Mesh::SetBounds(const MeshBounds& bounds)
 {
-	// Destroy buffer
-	vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
-	vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
-
-	// Free memory
-	vkFreeMemory(m_Device, m_VertexBufferMemory, nullptr);
-	vkFreeMemory(m_Device, m_IndexBufferMemory, nullptr);
+	m_Bounds = bounds;
 }
 
-void Mesh::CreateVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
+uint32_t Mesh::GetIndexCount()
 {
-	/************************************************************************/
-	// We can't copy data directly on the GPU, we can only directly place
-	// it through the CPU, which means it will use non-optimized
-	// memory, so here we make the buffer on CPU and copy it over
-	// and then copy the CPU buffer to a dedicated GPU buffer.
-	/************************************************************************/
-
-	const VkDeviceSize bufferSize = sizeof(Vertex) * vertices->size(); // Get size of buffer needed for vertices
-
-	// Temporary buffer to stage vertex data before transferring to GPU
-	VkBuffer stagingBuffer{};
-	VkDeviceMemory stagingBufferMemory{};
-
-	// Create staging buffer and allocate memory to it
-	CreateBuffer(
-		m_PhysicalDevice,
-		m_Device,
-		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer,
-		&stagingBufferMemory
-	);
-
-	// MAP MEMORY TO VERTEX BUFFER
-	void * data;																								// 1: Create pointer to a point in normal memory
-	vkMapMemory(m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);			// 2: Map vertex buffer memory to that point
-	memcpy(data, vertices->data(), (size_t)bufferSize);										// 3: Copy vertices to point
-	vkUnmapMemory(m_Device, stagingBufferMemory);																// 4: Unmap the vertex buffer memory
-
-
-	// Create buffer with TRANSFER_DST_BIT to mark as recipient of transfer data (also VERTEX_BUFFER)
-	// Buffer memory is to be device local bit which means memory is on GPU and only accessible to it and not the CPU (host)
-	CreateBuffer(
-		m_PhysicalDevice,
-		m_Device,
-		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&m_VertexBuffer,
-		&m_VertexBufferMemory
-	);
-
-	// Copy staging buffer to vertex buffer on GPU
-	CopyBuffer(m_Device, transferQueue, transferCommandPool, stagingBuffer, m_VertexBuffer, bufferSize);
-
-	// Destroy staging buffer
-	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
+	return m_pGeometryBuffer->GetRange(m_GeometryHandle).indexCount;
 }
 
-void Mesh::CreateIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
+int32_t Mesh::GetVertexOffset()
 {
-	// Get size of buffer needed for indices
-	const VkDeviceSize bufferSize = sizeof(uint32_t) * indices->size();
-
-	// Temporary buffer to stage vertex data before transferring to GPU
-	VkBuffer stagingBuffer{};
-	VkDeviceMemory stagingBufferMemory{};
-
-	// Create staging buffer and allocate memory to it
-	CreateBuffer(
-		m_PhysicalDevice,
-		m_Device,
-		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer,
-		&stagingBufferMemory
-	);
-
-	// MAP MEMORY TO VERTEX BUFFER
-	void* data;																						
-	vkMapMemory(m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);			
-	memcpy(data, indices->data(), (size_t)bufferSize);								
-	vkUnmapMemory(m_Device, stagingBufferMemory);
+	return m_pGeometryBuffer->GetRange(m_GeometryHandle).vertexOffset;
+}
 
-	// Create buffer with TRANSFER_DST_BIT to mark as recipient of transfer data (also VERTEX_BUFFER)
-	// Buffer memory is to be device local bit which means memory is on GPU and only accessible to it and not the CPU (host)
-	CreateBuffer(
-		m_PhysicalDevice,
-		m_Device,
-		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&m_IndexBuffer,
-		&m_IndexBufferMemory
-	);
+uint32_t Mesh::GetFirstIndex()
+{
+	return m_pGeometryBuffer->GetRange(m_GeometryHandle).firstIndex;
+}
 
-	// Copy staging buffer to vertex buffer on GPU
-	CopyBuffer(m_Device, transferQueue, transferCommandPool, stagingBuffer, m_IndexBuffer, bufferSize);
+TransferToken Mesh::GetUploadToken()
+{
+	return m_UploadToken;
+}
 
-	// Destroy staging buffer
-	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
+void Mesh::DestroyBuffers()
+{
+	// Return mesh's ranges to the shared geometry buffers
+	m_pGeometryBuffer->Free(m_GeometryHandle);
+	m_GeometryHandle = INVALID_GEOMETRY_HANDLE;
 }
@@ -5,24 +5,34 @@
 
 #include <vector>
 #include "Utilities.h"
+#include "TransferContext.h"
+#include "GeometryBuffer.h"
+#include "VertexFormat.h"
 
 struct Model
 {
 	glm::mat4 model{};
 };
 
+// Bounding box (center +- extent) and bounding sphere around the same center, in model space
+struct MeshBounds
+{
+	glm::vec3 center{ 0.f };
+	float radius{};
+	glm::vec3 extent{ 0.f };
+};
+
 class Mesh
 {
 public:
 	Mesh() = default;
 	Mesh(
-		VkPhysicalDevice newPhysicalDevice, 
-		VkDevice newDevice, 
-		VkQueue transferQueue, 
-		VkCommandPool transferCommandPool, 
-		std::vector<Vertex>* vertices,
-		std::vector<uint32_t>* indices,
-		int newTexId
+		GeometryBuffer* geometryBuffer,
+		TransferContext* transferContext,
+		std::vector<uint8_t>* vertexData,			// Encoded in the geometry buffer's vertex format
+		std::vector<GeometryIndex>* indices,
+		int newTexId,
+		const VertexQuantization& quantization
 	);
 
 	void SetModel(glm::mat4 newModel);
@@ -30,10 +40,20 @@ public:
 
 	int GetTexId();
 
+	// Pushed before drawing compact vertex formats
+	const VertexQuantization& GetQuantization();
+
+	const MeshBounds& GetBounds();
+	void SetBounds(const MeshBounds& bounds);
+
+	// Location of mesh data in the shared geometry buffers
 	uint32_t GetVertexCount();
 	uint32_t GetIndexCount();
-	VkBuffer GetVertexBuffer();
-	VkBuffer GetIndexBuffer();
+	int32_t GetVertexOffset();
+	uint32_t GetFirstIndex();
+
+	// Token of the transfer batch uploading this mesh, it must not be drawn before it completes
+	TransferToken GetUploadToken();
 
 	void DestroyBuffers();
 
@@ -41,19 +61,11 @@ private:
 	Model m_Model{};
 
 	int m_TexId{};
+	VertexQuantization m_Quantization{};
+	MeshBounds m_Bounds{};
 
-	int32_t m_VertexCount{};
-	VkBuffer m_VertexBuffer{};
-	VkDeviceMemory m_VertexBufferMemory{};
-
-	uint32_t m_IndexCount{};
-	VkBuffer m_IndexBuffer{}; 
-	VkDeviceMemory m_IndexBufferMemory{};
+	GeometryHandle m_GeometryHandle{ INVALID_GEOMETRY_HANDLE };		// Range is looked up on use, compaction may move it
+	GeometryBuffer* m_pGeometryBuffer{};
 
-	VkPhysicalDevice m_PhysicalDevice{};
-	VkDevice m_Device{};
-
-	void CreateVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices);
-	void CreateIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices);
+	TransferToken m_UploadToken{};
 };
-
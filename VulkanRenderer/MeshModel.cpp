@@ -1,8 +1,12 @@
 #include "MeshModel.h"
+#include <algorithm>
 #include <string>
+#include <stdexcept>
 
-MeshModel::MeshModel(std::vector<Mesh> newMeshList)
-	:m_MeshList{ newMeshList }, m_Model{glm::mat4(1.f)}
+#include "MeshOptimizer.h"
+
+MeshModel::MeshModel(std::vector<Mesh> newMeshList, VertexFormat vertexFormat)
+	:m_MeshList{ newMeshList }, m_Model{glm::mat4(1.f)}, m_VertexFormat{ vertexFormat }
 {
 }
 
@@ -11,6 +15,11 @@ size_t MeshModel::GetMeshCount()
 	return m_MeshList.size();
 }
 
+VertexFormat MeshModel::GetVertexFormat()
+{
+	return m_VertexFormat;
+}
+
 Mesh* MeshModel::GetMesh(size_t index)
 {
 	if (index >= 0 && index < m_MeshList.size())
@@ -29,6 +38,90 @@ void MeshModel::SetModel(glm::mat4 newModel)
 	m_Model = newModel;
 }
 
+TransferToken MeshModel::GetUploadToken()
+{
+	return m_UploadToken;
+}
+
+void MeshModel::SetUploadToken(TransferToken uploadToken)
+{
+	m_UploadToken = uploadToken;
+}
+
+void MeshModel::AddInstance(InstanceId instanceId, const glm::mat4& transform)
+{
+	if (instanceId == INVALID_INSTANCE_ID)
+	{
+		throw std::runtime_error("Invalid instance id");
+	}
+
+	if (instanceId >= m_InstanceSlots.size())
+	{
+		m_InstanceSlots.resize(instanceId + 1, ~0u);
+	}
+	else if (m_InstanceSlots[instanceId] != ~0u)
+	{
+		throw std::runtime_error("Instance id is already used");
+	}
+
+	m_InstanceSlots[instanceId] = static_cast<uint32_t>(m_Instances.size());
+	m_Instances.push_back({ transform });
+	m_InstanceIds.push_back(instanceId);
+}
+
+void MeshModel::SetInstanceTransform(InstanceId instanceId, const glm::mat4& transform)
+{
+	m_Instances[GetInstanceSlot(instanceId)].transform = transform;
+}
+
+void MeshModel::RemoveInstance(InstanceId instanceId)
+{
+	const uint32_t slot = GetInstanceSlot(instanceId);
+
+	// Move the last instance into the hole to keep the array dense
+	const uint32_t lastSlot = static_cast<uint32_t>(m_Instances.size() - 1);
+	if (slot != lastSlot)
+	{
+		m_Instances[slot] = m_Instances[lastSlot];
+		m_InstanceIds[slot] = m_InstanceIds[lastSlot];
+		m_InstanceSlots[m_InstanceIds[slot]] = slot;
+	}
+
+	m_Instances.pop_back();
+	m_InstanceIds.pop_back();
+	m_InstanceSlots[instanceId] = ~0u;
+}
+
+uint32_t MeshModel::GetInstanceCount()
+{
+	return static_cast<uint32_t>(m_Instances.size());
+}
+
+const std::vector<InstanceData>& MeshModel::GetInstances()
+{
+	return m_Instances;
+}
+
+uint32_t MeshModel::GetInstanceSlot(InstanceId instanceId)
+{
+	if (instanceId >= m_InstanceSlots.size() || m_InstanceSlots[instanceId] == ~0u)
+	{
+		throw std::runtime_error("Invalid instance id");
+	}
+
+	return m_InstanceSlots[instanceId];
+}
+
+const std::vector<int>& MeshModel::GetTextureIds()
+{
+	return m_TextureIds;
+}
+
+void MeshModel::SetTextureIds(std::vector<int> textureIds)
+{
+	m_TextureIds = textureIds;
+}
+
 std::vector<std::string> MeshModel::LoadMaterials(const aiScene* scene)
 {
 	// Create 1:1 sized list of textures
@@ -62,7 +155,7 @@ std::vector<std::string> MeshModel::LoadMaterials(const aiScene* scene)
 	return textureList;
 }
 
-std::vector<Mesh> MeshModel::LoadNode(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool, aiNode* node, const aiScene* scene, std::vector<int> mat2Tex)
+std::vector<Mesh> MeshModel::LoadNode(GeometryBuffer* geometryBuffer, TransferContext* transferContext, const MeshImportSettings& settings, aiNode* node, const aiScene* scene, std::vector<int> mat2Tex)
 {
 	std::vector<Mesh> meshList{};
 
@@ -70,27 +163,39 @@ std::vector<Mesh> MeshModel::LoadNode(VkPhysicalDevice newPhysicalDevice, VkDevi
 	for (size_t i{}; i < node->mNumMeshes; i++)
 	{
 		// Load mesh here
-		meshList.push_back(LoadMesh(newPhysicalDevice, newDevice, transferQueue, transferCommandPool, scene->mMeshes[node->mMeshes[i]], scene, mat2Tex));
+		std::vector<Mesh> newList = LoadMesh(geometryBuffer, transferContext, settings, scene->mMeshes[node->mMeshes[i]], scene, mat2Tex);
+		meshList.insert(meshList.end(), newList.begin(), newList.end());
 	}
 	
 	// Go through each node attached to this node, load it and append their meshes to this node's mesh list.
 	for (size_t i{}; i < node->mNumChildren; ++i)
 	{
-		std::vector<Mesh> newList = LoadNode(newPhysicalDevice, newDevice, transferQueue, transferCommandPool, node->mChildren[i], scene, mat2Tex);
+		std::vector<Mesh> newList = LoadNode(geometryBuffer, transferContext, settings, node->mChildren[i], scene, mat2Tex);
 		meshList.insert(meshList.end(), newList.begin(), newList.end());
 	}
 
 	return meshList;
 }
 
-Mesh MeshModel::LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool, aiMesh* mesh, const aiScene* scene, std::vector<int> mat2Tex)
+std::vector<Mesh> MeshModel::LoadMesh(GeometryBuffer* geometryBuffer, TransferContext* transferContext, const MeshImportSettings& settings, aiMesh* mesh, const aiScene* scene, std::vector<int> mat2Tex)
 {
 	std::vector<Vertex> vertices{};
+	std::vector<glm::vec3> normals{};
 	std::vector<uint32_t> indices{};
 
 	// Resize vertex to hold all vertices
 	vertices.resize(mesh->mNumVertices);
 
+	// Normals are only stored by formats that have them
+	if (settings.vertexFormat == VertexFormat::CompactNormal && mesh->HasNormals())
+	{
+		normals.resize(mesh->mNumVertices);
+		for (size_t i{}; i < mesh->mNumVertices; ++i)
+		{
+			normals[i] = { mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z };
+		}
+	}
+
 	// Go through each vertex and copy
 	for (size_t i{}; i < mesh->mNumVertices; ++i)
 	{
@@ -126,6 +231,12 @@ Mesh MeshModel::LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice,
 	{
 		aiFace face = mesh->mFaces[i];
 
+		// Pipeline draws triangle lists, leftover points and lines can't be part of it
+		if (face.mNumIndices != 3)
+		{
+			continue;
+		}
+
 		// Go through face's indices
 		for (size_t j{}; j < face.mNumIndices; ++j)
 		{
@@ -133,10 +244,68 @@ Mesh MeshModel::LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice,
 		}
 	}
 
-	// Create new mesh with details and return it
-	Mesh newMesh = Mesh(newPhysicalDevice, newDevice, transferQueue, transferCommandPool, &vertices, &indices, mat2Tex[mesh->mMaterialIndex]);
+	// Reorder triangles so vertices are reused while still in the post-transform cache
+	if (settings.optimizeVertexCache || settings.optimizeOverdraw)
+	{
+		std::vector<uint32_t> clusterStarts{};
+		OptimizeVertexCache(&indices, mesh->mNumVertices, DEFAULT_VERTEX_CACHE_SIZE, &clusterStarts);
+
+		if (settings.optimizeOverdraw)
+		{
+			std::vector<glm::vec3> positions(vertices.size());
+			for (size_t i{}; i < vertices.size(); ++i)
+			{
+				positions[i] = vertices[i].pos;
+			}
+
+			OptimizeOverdraw(&indices, positions, clusterStarts);
+		}
+	}
+
+	// Split in chunks that fit 16-bit indices, vertices get renumbered in fetch order
+	std::vector<Mesh> meshList{};
+	for (const auto& chunk : BuildMeshChunks(indices, mesh->mNumVertices))
+	{
+		std::vector<Vertex> chunkVertices(chunk.vertexRemap.size());
+		std::vector<glm::vec3> chunkNormals(normals.empty() ? 0 : chunk.vertexRemap.size());
+		for (size_t i{}; i < chunk.vertexRemap.size(); ++i)
+		{
+			chunkVertices[i] = vertices[chunk.vertexRemap[i]];
+			if (!normals.empty())
+			{
+				chunkNormals[i] = normals[chunk.vertexRemap[i]];
+			}
+		}
+
+		std::vector<GeometryIndex> chunkIndices = chunk.indices;
 
-	return newMesh;
+		// Pack vertices in the model's format
+		VertexQuantization quantization{};
+		std::vector<uint8_t> vertexData = EncodeVertices(settings.vertexFormat, chunkVertices, chunkNormals, &quantization);
+
+		// Create new mesh with details and add it
+		meshList.push_back(Mesh(geometryBuffer, transferContext, &vertexData, &chunkIndices, mat2Tex[mesh->mMaterialIndex], quantization));
+
+		// Chunk's box and the sphere around it, used for culling and sorting by depth
+		glm::vec3 boundsMin{ chunkVertices.front().pos };
+		glm::vec3 boundsMax{ chunkVertices.front().pos };
+		for (const auto& vertex : chunkVertices)
+		{
+			boundsMin = glm::min(boundsMin, vertex.pos);
+			boundsMax = glm::max(boundsMax, vertex.pos);
+		}
+
+		MeshBounds bounds{};
+		bounds.center = (boundsMin + boundsMax) * 0.5f;
+		bounds.extent = (boundsMax - boundsMin) * 0.5f;
+		for (const auto& vertex : chunkVertices)
+		{
+			bounds.radius = std::max(bounds.radius, glm::length(vertex.pos - bounds.center));
+		}
+		meshList.back().SetBounds(bounds);
+	}
+
+	return meshList;
 }
 
 void MeshModel::DestroyMeshModel()
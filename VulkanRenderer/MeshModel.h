@@ -6,24 +6,57 @@
 
 #include "Mesh.h"
 
+// How a model's meshes are processed and stored when imported
+struct MeshImportSettings
+{
+	VertexFormat vertexFormat{ VertexFormat::Standard };
+	bool optimizeVertexCache{ true };		// Reorder triangles for post-transform vertex cache hits
+	bool optimizeOverdraw{ false };			// Then draw outward facing triangle clusters first (trades a little cache efficiency)
+};
+
+// Stable id of one instance of a model, ids of removed instances get reused
+using InstanceId = uint32_t;
+const InstanceId INVALID_INSTANCE_ID = ~0u;
+
 class MeshModel
 {
 public:
 	MeshModel() = default;
 	~MeshModel() = default;
 
-	MeshModel(std::vector<Mesh> newMeshList);
+	MeshModel(std::vector<Mesh> newMeshList, VertexFormat vertexFormat = VertexFormat::Standard);
 
 	size_t GetMeshCount();
+	VertexFormat GetVertexFormat();
 	Mesh* GetMesh(size_t index);
 
+	// Parent transform applied on top of every instance transform
 	glm::mat4 GetModel();
 	void SetModel(glm::mat4 newModel);
 
+	// Instances share the model's meshes and are drawn in one instanced draw per mesh.
+	// Ids are handed out by the caller, so they can be known before the instance is added here
+	void AddInstance(InstanceId instanceId, const glm::mat4& transform);
+	void SetInstanceTransform(InstanceId instanceId, const glm::mat4& transform);
+	void RemoveInstance(InstanceId instanceId);
+	uint32_t GetInstanceCount();
+	const std::vector<InstanceData>& GetInstances();		// Tightly packed, ready to copy into an instance buffer
+
+	// Transfer token covering all mesh (and texture) uploads of this model
+	TransferToken GetUploadToken();
+	void SetUploadToken(TransferToken uploadToken);
+
+	// Textures this model holds a reference on, released when the model is unloaded
+	const std::vector<int>& GetTextureIds();
+	void SetTextureIds(std::vector<int> textureIds);
+
 	static std::vector<std::string> LoadMaterials(const aiScene* scene);
-	static std::vector<Mesh> LoadNode(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
+	// geometryBuffer must hold vertices of settings.vertexFormat
+	static std::vector<Mesh> LoadNode(GeometryBuffer* geometryBuffer, TransferContext* transferContext, const MeshImportSettings& settings,
 		aiNode* node, const aiScene* scene, std::vector<int> mat2Tex);
-	static Mesh LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
+
+	// Meshes with more vertices than 16-bit indices can address are split into several Meshes
+	static std::vector<Mesh> LoadMesh(GeometryBuffer* geometryBuffer, TransferContext* transferContext, const MeshImportSettings& settings,
 		aiMesh* mesh, const aiScene* scene, std::vector<int> mat2Tex);
 
 	void DestroyMeshModel();
@@ -32,4 +65,14 @@ public:
 private:
 	std::vector<Mesh> m_MeshList{};
 	glm::mat4 m_Model;
+	VertexFormat m_VertexFormat{ VertexFormat::Standard };
+	TransferToken m_UploadToken{};
+	std::vector<int> m_TextureIds{};
+
+	// Live instances are kept dense so they upload with one copy, removal swaps the last one in
+	std::vector<InstanceData> m_Instances{};
+	std::vector<InstanceId> m_InstanceIds{};			// Id of each dense instance
+	std::vector<uint32_t> m_InstanceSlots{};			// Dense index of each id, ~0u when free
+
+	uint32_t GetInstanceSlot(InstanceId instanceId);
 };
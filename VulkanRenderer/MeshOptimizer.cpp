@@ -0,0 +1,285 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+
+namespace
+{
+	constexpr uint32_t INVALID_INDEX = ~0u;
+
+	// Next vertex with live triangles: most recently touched dead-end vertex, else scan forward from the cursor
+	int64_t SkipDeadEnd(const std::vector<uint32_t>& liveTriangles, std::vector<uint32_t>* deadEnds, uint32_t* cursor)
+	{
+		while (!deadEnds->empty())
+		{
+			const uint32_t vertex = deadEnds->back();
+			deadEnds->pop_back();
+
+			if (liveTriangles[vertex] > 0)
+			{
+				return vertex;
+			}
+		}
+
+		while (*cursor < liveTriangles.size())
+		{
+			if (liveTriangles[*cursor] > 0)
+			{
+				return *cursor;
+			}
+
+			++(*cursor);
+		}
+
+		return -1;
+	}
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>* indices, uint32_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>* clusterStarts)
+{
+	const size_t triangleCount = indices->size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Vertex -> triangle adjacency as offsets into one list
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (const uint32_t index : *indices)
+	{
+		liveTriangles[index]++;
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t i{}; i < vertexCount; ++i)
+	{
+		adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveTriangles[i];
+	}
+
+	std::vector<uint32_t> adjacency(indices->size());
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i{}; i < indices->size(); ++i)
+	{
+		const uint32_t vertex = (*indices)[i];
+		adjacency[fill[vertex]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);	// Time stamp vertex entered the cache
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds{};
+	std::vector<uint32_t> candidates{};
+
+	std::vector<uint32_t> output{};
+	output.reserve(indices->size());
+
+	uint32_t time = cacheSize + 1;
+	uint32_t cursor{};
+	int64_t fanVertex = SkipDeadEnd(liveTriangles, &deadEnds, &cursor);
+
+	if (clusterStarts)
+	{
+		clusterStarts->clear();
+		clusterStarts->push_back(0);
+	}
+
+	while (fanVertex >= 0)
+	{
+		candidates.clear();
+
+		// Emit every remaining triangle around the fanning vertex
+		for (uint32_t a = adjacencyOffsets[fanVertex]; a < adjacencyOffsets[fanVertex + 1]; ++a)
+		{
+			const uint32_t triangle = adjacency[a];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+
+			for (uint32_t corner{}; corner < 3; ++corner)
+			{
+				const uint32_t vertex = (*indices)[triangle * 3 + corner];
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+
+				// Cache miss, vertex (re)enters the cache
+				if (time - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = time;
+					time++;
+				}
+			}
+
+			emitted[triangle] = true;
+		}
+
+		// Pick the candidate that will still be in the cache after its remaining triangles, oldest first
+		int64_t nextVertex = -1;
+		int64_t bestPriority = -1;
+		for (const uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)
+			{
+				continue;
+			}
+
+			int64_t priority{};
+			if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+			{
+				priority = time - cacheTime[vertex];
+			}
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				nextVertex = vertex;
+			}
+		}
+
+		if (nextVertex < 0)
+		{
+			nextVertex = SkipDeadEnd(liveTriangles, &deadEnds, &cursor);
+
+			// No candidate stays cached, the next fan may start anywhere so a new cluster begins here
+			if (clusterStarts && nextVertex >= 0)
+			{
+				clusterStarts->push_back(static_cast<uint32_t>(output.size() / 3));
+			}
+		}
+
+		fanVertex = nextVertex;
+	}
+
+	*indices = std::move(output);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>* indices, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& clusterStarts)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices->size() / 3);
+	if (clusterStarts.size() < 2)
+	{
+		return;
+	}
+
+	struct Cluster
+	{
+		uint32_t firstTriangle{};
+		uint32_t triangleCount{};
+		float sortKey{};
+	};
+
+	// Area weighted centroid of the whole mesh
+	glm::vec3 meshCentroid{ 0.f };
+	float meshArea{};
+	for (uint32_t t{}; t < triangleCount; ++t)
+	{
+		const glm::vec3& a = positions[(*indices)[t * 3 + 0]];
+		const glm::vec3& b = positions[(*indices)[t * 3 + 1]];
+		const glm::vec3& c = positions[(*indices)[t * 3 + 2]];
+
+		const float area = glm::length(glm::cross(b - a, c - a));
+		meshCentroid += (a + b + c) * (area / 3.f);
+		meshArea += area;
+	}
+
+	if (meshArea > 0.f)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	std::vector<Cluster> clusters(clusterStarts.size());
+	for (size_t i{}; i < clusterStarts.size(); ++i)
+	{
+		Cluster& cluster = clusters[i];
+		cluster.firstTriangle = clusterStarts[i];
+		cluster.triangleCount = (i + 1 < clusterStarts.size() ? clusterStarts[i + 1] : triangleCount) - cluster.firstTriangle;
+
+		glm::vec3 centroid{ 0.f };
+		glm::vec3 normal{ 0.f };
+		float area{};
+		for (uint32_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; ++t)
+		{
+			const glm::vec3& a = positions[(*indices)[t * 3 + 0]];
+			const glm::vec3& b = positions[(*indices)[t * 3 + 1]];
+			const glm::vec3& c = positions[(*indices)[t * 3 + 2]];
+
+			// Unnormalized cross product weighs the normal by triangle area
+			const glm::vec3 faceNormal = glm::cross(b - a, c - a);
+			const float faceArea = glm::length(faceNormal);
+
+			centroid += (a + b + c) * (faceArea / 3.f);
+			normal += faceNormal;
+			area += faceArea;
+		}
+
+		if (area > 0.f)
+		{
+			centroid /= area;
+		}
+
+		// Clusters on the outside facing away from the center are likely to occlude the rest
+		cluster.sortKey = glm::dot(centroid - meshCentroid, normal);
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> output{};
+	output.reserve(indices->size());
+	for (const auto& cluster : clusters)
+	{
+		output.insert(output.end(), indices->begin() + cluster.firstTriangle * 3, indices->begin() + (cluster.firstTriangle + cluster.triangleCount) * 3);
+	}
+
+	*indices = std::move(output);
+}
+
+std::vector<MeshChunk> BuildMeshChunks(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t maxVertexCount)
+{
+	std::vector<MeshChunk> chunks{};
+	std::vector<uint32_t> localIndex(vertexCount, INVALID_INDEX);	// Source vertex -> vertex in current chunk
+
+	MeshChunk chunk{};
+	for (size_t t{}; t + 2 < indices.size(); t += 3)
+	{
+		// Close the chunk when the triangle's new vertices wouldn't fit anymore
+		uint32_t newVertices{};
+		for (size_t corner{}; corner < 3; ++corner)
+		{
+			if (localIndex[indices[t + corner]] == INVALID_INDEX)
+			{
+				newVertices++;
+			}
+		}
+
+		if (chunk.vertexRemap.size() + newVertices > maxVertexCount)
+		{
+			for (const uint32_t vertex : chunk.vertexRemap)
+			{
+				localIndex[vertex] = INVALID_INDEX;
+			}
+
+			chunks.push_back(std::move(chunk));
+			chunk = MeshChunk{};
+		}
+
+		// Number vertices in order of first use so fetches walk memory linearly
+		for (size_t corner{}; corner < 3; ++corner)
+		{
+			const uint32_t vertex = indices[t + corner];
+			if (localIndex[vertex] == INVALID_INDEX)
+			{
+				localIndex[vertex] = static_cast<uint32_t>(chunk.vertexRemap.size());
+				chunk.vertexRemap.push_back(vertex);
+			}
+
+			chunk.indices.push_back(static_cast<uint16_t>(localIndex[vertex]));
+		}
+	}
+
+	if (!chunk.indices.empty())
+	{
+		chunks.push_back(std::move(chunk));
+	}
+
+	return chunks;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Size of the simulated post-transform vertex cache triangles are ordered for
+const uint32_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+// Vertices a chunk may reference so its indices fit in 16 bits
+const uint32_t MAX_CHUNK_VERTEX_COUNT = 65536;
+
+// Part of a mesh small enough for 16-bit indices
+struct MeshChunk
+{
+	std::vector<uint32_t> vertexRemap{};	// Source vertex of every chunk vertex, in first use order
+	std::vector<uint16_t> indices{};		// Triangle list into the chunk vertices
+};
+
+// Import time reordering of triangle lists, all functions work on indices into one vertex list.
+
+// Reorder triangles for post-transform vertex cache hits (Tipsify, Sander et al. 2007)
+// clusterStarts receives the first triangle of every run that starts after a cache flush, may be nullptr
+void OptimizeVertexCache(std::vector<uint32_t>* indices, uint32_t vertexCount, uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE,
+	std::vector<uint32_t>* clusterStarts = nullptr);
+
+// Sort clusters from OptimizeVertexCache so outward facing ones are drawn first, keeps order inside a cluster
+void OptimizeOverdraw(std::vector<uint32_t>* indices, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& clusterStarts);
+
+// Split into chunks of at most maxVertexCount vertices, vertices of each chunk are numbered in order of first use
+// so fetches walk memory linearly
+std::vector<MeshChunk> BuildMeshChunks(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t maxVertexCount = MAX_CHUNK_VERTEX_COUNT);
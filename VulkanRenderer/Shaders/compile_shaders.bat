@@ -1,4 +1,10 @@
 C:\VulkanSDK\1.3.231.1\Bin\glslangValidator.exe -V shader.vert
 C:\VulkanSDK\1.3.231.1\Bin\glslangValidator.exe -V shader.frag
+C:\VulkanSDK\1.3.231.1\Bin\glslangValidator.exe -V shader_compact.vert -o vert_compact.spv
+C:\VulkanSDK\1.3.231.1\Bin\glslangValidator.exe -V -DHAS_NORMALS shader_compact.vert -o vert_compact_normal.spv
+C:\VulkanSDK\1.3.231.1\Bin\glslangValidator.exe -V cull.comp -o cull.spv
+C:\VulkanSDK\1.3.231.1\Bin\glslangValidator.exe -V cull_scan.comp -o cull_scan.spv
+C:\VulkanSDK\1.3.231.1\Bin\glslangValidator.exe -V cull_compact.comp -o cull_compact.spv
+C:\VulkanSDK\1.3.231.1\Bin\glslangValidator.exe -V depth_pyramid.comp -o depth_pyramid.spv
 
 pause
\ No newline at end of file
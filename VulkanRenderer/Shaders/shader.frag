@@ -1,13 +1,17 @@
 #version 450 // version 4.5
+#extension GL_EXT_nonuniform_qualifier : require
 
 // Final output color must also have location
 layout(location = 0) in vec3 fragCol;
 layout(location = 1) in vec2 fragUV;
+layout(location = 3) flat in uint fragTextureIndex;
 
-layout(set = 1, binding = 0) uniform sampler2D textureSampler;
+// Every loaded texture, indexed with the draw's texture id
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(textureSampler, fragUV);
+    // Draws of one indirect call may use different textures
+    outColor = texture(textures[nonuniformEXT(fragTextureIndex)], fragUV);
 }
\ No newline at end of file
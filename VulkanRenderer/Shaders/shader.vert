@@ -1,29 +1,66 @@
-#version 450 // version 4.5
+#version 460 // version 4.6, gl_DrawID
 
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 col;
 layout(location = 2) in vec2 uv;
+layout(location = 4) in mat4 instanceTransform;		// Per instance, locations 4-7
 
 layout(set = 0, binding = 0) uniform UboViewProjection {
     mat4 projection;
     mat4 view;
 } uboViewProjection;
 
-// NOT IN USE LEFT FOR REFERENCE
-// layout(binding = 1) uniform UboModel {
-//     mat4 model;
-// } uboModel;
 
-layout(push_constant) uniform PushModel {
+struct DrawData {
+    uint transformIndex;
+    uint textureIndex;
+    uint batchIndex;		// Read by culling
+    uint batchFirstDraw;	// Read by culling
+    vec4 positionOffset;	// Mesh bounds min, compact formats only
+    vec4 positionScale;		// Mesh bounds extent, compact formats only
+    vec4 boundingSphere;	// Read by culling
+};
+
+struct ObjectTransform {
     mat4 model;
-} pushModel;
+    mat4 modelViewProjection;	// Only filled in when PRECOMPUTED_TRANSFORMS
+    mat3 normalMatrix;			// Only filled in when PRECOMPUTED_TRANSFORMS
+};
+
+// Products are done per model on the CPU, otherwise every vertex multiplies the matrices itself
+layout(constant_id = 0) const bool PRECOMPUTED_TRANSFORMS = true;
+
+// Model transforms of the frame
+layout(set = 0, binding = 1) readonly buffer Transforms {
+    ObjectTransform transforms[];
+};
+
+// One entry per indirect draw of the frame
+layout(set = 0, binding = 2) readonly buffer Draws {
+    DrawData draws[];
+};
+
+// First draw of the indirect batch, gl_DrawID counts from there
+layout(push_constant) uniform PushDraw {
+    uint drawBase;
+} pushDraw;
 
 layout(location = 0) out vec3 fragCol;
 layout(location = 1) out vec2 fragUV;
+layout(location = 3) flat out uint fragTextureIndex;
 
 void main() {
     // gl_VertexIndex keeps track like a static var
-    gl_Position = uboViewProjection.projection * uboViewProjection.view * pushModel.model * vec4(pos, 1.0);
+    DrawData draw = draws[pushDraw.drawBase + gl_DrawID];
+
+    // Matrix times vector only, instance first
+    vec4 instancePosition = instanceTransform * vec4(pos, 1.0);
+    if (PRECOMPUTED_TRANSFORMS) {
+        gl_Position = transforms[draw.transformIndex].modelViewProjection * instancePosition;
+    } else {
+        gl_Position = uboViewProjection.projection * (uboViewProjection.view * (transforms[draw.transformIndex].model * instancePosition));
+    }
     fragCol = col;
     fragUV = uv;
+    fragTextureIndex = draw.textureIndex;
 }
\ No newline at end of file
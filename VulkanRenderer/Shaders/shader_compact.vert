@@ -0,0 +1,88 @@
+#version 460 // version 4.6, gl_DrawID
+
+// Compact vertex formats, compile with -DHAS_NORMALS for the variant carrying octahedral normals
+layout(location = 0) in vec4 pos;		// unorm16, relative to mesh bounds
+layout(location = 1) in vec2 uv;		// half float
+#ifdef HAS_NORMALS
+layout(location = 2) in vec2 octNormal;	// snorm16 octahedral
+#endif
+layout(location = 4) in mat4 instanceTransform;		// Per instance, locations 4-7
+
+layout(set = 0, binding = 0) uniform UboViewProjection {
+    mat4 projection;
+    mat4 view;
+} uboViewProjection;
+
+struct DrawData {
+    uint transformIndex;
+    uint textureIndex;
+    uint batchIndex;		// Read by culling
+    uint batchFirstDraw;	// Read by culling
+    vec4 positionOffset;	// Mesh bounds min, compact formats only
+    vec4 positionScale;		// Mesh bounds extent, compact formats only
+    vec4 boundingSphere;	// Read by culling
+};
+
+struct ObjectTransform {
+    mat4 model;
+    mat4 modelViewProjection;	// Only filled in when PRECOMPUTED_TRANSFORMS
+    mat3 normalMatrix;			// Only filled in when PRECOMPUTED_TRANSFORMS
+};
+
+// Products are done per model on the CPU, otherwise every vertex multiplies the matrices itself
+layout(constant_id = 0) const bool PRECOMPUTED_TRANSFORMS = true;
+
+// Model transforms of the frame
+layout(set = 0, binding = 1) readonly buffer Transforms {
+    ObjectTransform transforms[];
+};
+
+// One entry per indirect draw of the frame
+layout(set = 0, binding = 2) readonly buffer Draws {
+    DrawData draws[];
+};
+
+// First draw of the indirect batch, gl_DrawID counts from there
+layout(push_constant) uniform PushDraw {
+    uint drawBase;
+} pushDraw;
+
+layout(location = 0) out vec3 fragCol;
+layout(location = 1) out vec2 fragUV;
+layout(location = 3) flat out uint fragTextureIndex;
+#ifdef HAS_NORMALS
+layout(location = 2) out vec3 fragNormal;
+
+vec3 OctahedralDecode(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.xy += vec2(normal.x >= 0.0 ? -fold : fold, normal.y >= 0.0 ? -fold : fold);
+    return normalize(normal);
+}
+#endif
+
+void main() {
+    DrawData draw = draws[pushDraw.drawBase + gl_DrawID];
+    vec3 position = draw.positionOffset.xyz + pos.xyz * draw.positionScale.xyz;
+
+    // Matrix times vector only, instance first
+    vec4 instancePosition = instanceTransform * vec4(position, 1.0);
+    if (PRECOMPUTED_TRANSFORMS) {
+        gl_Position = transforms[draw.transformIndex].modelViewProjection * instancePosition;
+    } else {
+        gl_Position = uboViewProjection.projection * (uboViewProjection.view * (transforms[draw.transformIndex].model * instancePosition));
+    }
+
+    // Models are always loaded white, compact formats don't store color
+    fragCol = vec3(1.0);
+    fragUV = uv;
+    fragTextureIndex = draw.textureIndex;
+#ifdef HAS_NORMALS
+    vec3 instanceNormal = mat3(instanceTransform) * OctahedralDecode(octNormal);
+    if (PRECOMPUTED_TRANSFORMS) {
+        fragNormal = normalize(transforms[draw.transformIndex].normalMatrix * instanceNormal);
+    } else {
+        fragNormal = mat3(transforms[draw.transformIndex].model) * instanceNormal;
+    }
+#endif
+}
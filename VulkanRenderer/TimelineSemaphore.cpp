@@ -0,0 +1,88 @@
+#include "TimelineSemaphore.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void TimelineSemaphore::Init(VkDevice device)
+{
+	m_Device = device;
+	m_SubmittedValue = 0;
+	m_CompletedValue = 0;
+
+	VkSemaphoreTypeCreateInfo typeCreateInfo{};
+	typeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeCreateInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo{};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &typeCreateInfo;
+
+	const VkResult result = vkCreateSemaphore(m_Device, &semaphoreCreateInfo, nullptr, &m_Semaphore);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create timeline semaphore");
+	}
+}
+
+void TimelineSemaphore::Destroy()
+{
+	vkDestroySemaphore(m_Device, m_Semaphore, nullptr);
+	m_Semaphore = VK_NULL_HANDLE;
+}
+
+uint64_t TimelineSemaphore::GetCompletedValue()
+{
+	// Nothing more can complete than was submitted
+	if (m_CompletedValue < m_SubmittedValue)
+	{
+		uint64_t value{};
+		const VkResult result = vkGetSemaphoreCounterValue(m_Device, m_Semaphore, &value);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to get timeline semaphore value");
+		}
+
+		m_CompletedValue = std::max(m_CompletedValue, value);
+	}
+
+	return m_CompletedValue;
+}
+
+bool TimelineSemaphore::IsComplete(uint64_t value)
+{
+	return value <= m_CompletedValue || value <= GetCompletedValue();
+}
+
+bool TimelineSemaphore::Wait(uint64_t value, uint64_t timeout)
+{
+	if (value <= m_CompletedValue)
+	{
+		return true;
+	}
+
+	// Waiting on a value no submit signals would never return
+	if (value > m_SubmittedValue)
+	{
+		throw std::runtime_error("Waiting on unsubmitted timeline semaphore value");
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_Semaphore;
+	waitInfo.pValues = &value;
+
+	const VkResult result = vkWaitSemaphores(m_Device, &waitInfo, timeout);
+	if (result == VK_TIMEOUT)
+	{
+		return false;
+	}
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to wait for timeline semaphore");
+	}
+
+	m_CompletedValue = std::max(m_CompletedValue, value);
+	return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <limits>
+
+// One monotonically increasing counter per queue, every submit on the queue signals the next value.
+// Work up to value N is done once the counter reached N, so any subsystem can remember the value of the submit
+// that uses a resource and check it later without a fence of its own.
+class TimelineSemaphore final
+{
+public:
+	TimelineSemaphore() = default;
+	~TimelineSemaphore() = default;
+
+	TimelineSemaphore(const TimelineSemaphore&) = delete;
+	TimelineSemaphore& operator=(const TimelineSemaphore&) = delete;
+
+	void Init(VkDevice device);
+	void Destroy();
+
+	// Value the next submit signals, call once per submit and pass it through VkTimelineSemaphoreSubmitInfo
+	uint64_t AdvanceSubmitValue() { return ++m_SubmittedValue; }
+	uint64_t GetSubmittedValue() const { return m_SubmittedValue; }
+
+	// Non-blocking, queries the counter only when the cached value isn't enough
+	uint64_t GetCompletedValue();
+	bool IsComplete(uint64_t value);
+
+	// Blocks until the counter reached value or the timeout (in nanoseconds) ran out, returns false on timeout
+	bool Wait(uint64_t value, uint64_t timeout = std::numeric_limits<uint64_t>::max());
+
+	VkSemaphore GetSemaphore() const { return m_Semaphore; }
+
+private:
+	VkDevice m_Device{};
+	VkSemaphore m_Semaphore{};
+
+	uint64_t m_SubmittedValue{};		// Last value a submit signals
+	uint64_t m_CompletedValue{};		// Last value the device was seen to reach
+};
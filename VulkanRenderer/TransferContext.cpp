@@ -0,0 +1,521 @@
+#include "TransferContext.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+// Keeps chunks within the ring, so one upload can't stall on itself
+const VkDeviceSize MAX_STAGING_CHUNK_DIVISOR = 4;
+
+// Satisfies buffer copy alignment and texel size of every format we upload
+const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+void TransferContext::Init(VkDevice device, MemoryAllocator* allocator, VkQueue queue, uint32_t queueFamilyIndex,
+	uint32_t graphicsQueueFamilyIndex, VkDeviceSize stagingRingSize)
+{
+	m_Device = device;
+	m_pAllocator = allocator;
+	m_Queue = queue;
+	m_QueueFamilyIndex = queueFamilyIndex;
+	m_GraphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+	m_TransfersOwnership = queueFamilyIndex != graphicsQueueFamilyIndex;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;	// Short lived, reused buffers
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+	const VkResult result = vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create transfer command pool");
+	}
+
+	m_Timeline.Init(m_Device);
+
+	// One staging buffer for the lifetime of the context, persistently mapped by the allocator
+	m_StagingSize = stagingRingSize;
+	CreateBuffer(
+		m_Device,
+		m_pAllocator,
+		m_StagingSize,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		MemoryCategory::Staging,
+		&m_StagingBuffer,
+		&m_StagingAllocation
+	);
+}
+
+void TransferContext::Destroy()
+{
+	// Make sure everything recorded has executed before we free what it uses
+	Wait(GetRecordingToken());
+
+	m_FreeBatches.clear();
+	m_Timeline.Destroy();
+
+	DestroyBuffer(m_Device, m_pAllocator, m_StagingBuffer, &m_StagingAllocation);
+
+	// Command buffers are freed with their pool
+	vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
+}
+
+void TransferContext::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
+{
+	// Region of data to copy from and to
+	VkBufferCopy bufferCopyRegion{};
+	bufferCopyRegion.srcOffset = srcOffset;
+	bufferCopyRegion.dstOffset = dstOffset;
+	bufferCopyRegion.size = size;
+
+	// Command to copy src buffer to dst buffer
+	vkCmdCopyBuffer(GetCommandBuffer(), srcBuffer, dstBuffer, 1, &bufferCopyRegion);
+}
+
+void TransferContext::CopyBufferToImage(VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height, VkDeviceSize srcOffset, uint32_t firstRow)
+{
+	VkBufferImageCopy imageRegion{};
+	imageRegion.bufferOffset = srcOffset;
+	imageRegion.bufferRowLength = 0;
+	imageRegion.bufferImageHeight = 0;
+	imageRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageRegion.imageSubresource.mipLevel = 0;
+	imageRegion.imageSubresource.baseArrayLayer = 0;
+	imageRegion.imageSubresource.layerCount = 1;
+	imageRegion.imageOffset = { 0, static_cast<int32_t>(firstRow), 0 };
+	imageRegion.imageExtent = { width, height, 1 };
+
+	vkCmdCopyBufferToImage(GetCommandBuffer(), srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageRegion);
+}
+
+void TransferContext::TransitionImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+	VkImageMemoryBarrier memoryBarrier{};
+
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	memoryBarrier.oldLayout = oldLayout;
+	memoryBarrier.newLayout = newLayout;
+	memoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	memoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	memoryBarrier.image = image;
+	memoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	memoryBarrier.subresourceRange.baseMipLevel = 0;
+	memoryBarrier.subresourceRange.layerCount = 1;
+	memoryBarrier.subresourceRange.levelCount = 1;
+	memoryBarrier.subresourceRange.baseArrayLayer = 0;
+
+	VkPipelineStageFlags srcStage{};
+	VkPipelineStageFlags dstStage{};
+
+	// if transitioning from new image to image ready to receive data
+	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+	{
+		memoryBarrier.srcAccessMask = 0;								// Memory access stage transition must happen after...
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;		// Memory access stage transition must happen before...
+
+		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	// If transitioning from transfer destination to shader readable...
+	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+
+	vkCmdPipelineBarrier(
+		GetCommandBuffer(),
+		srcStage, dstStage,				// Match to src and dst access masks
+		0,								// Dependency flags
+		0, nullptr,						// Memory barrier count + data
+		0, nullptr,						// Buffer memory barrier count + data
+		1, &memoryBarrier
+	);
+}
+
+void TransferContext::UploadToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	const VkDeviceSize maxChunkSize = m_StagingSize / MAX_STAGING_CHUNK_DIVISOR;
+	const char* srcData = static_cast<const char*>(data);
+
+	for (VkDeviceSize uploaded{}; uploaded < size;)
+	{
+		const VkDeviceSize chunkSize = std::min(size - uploaded, maxChunkSize);
+
+		// Write chunk straight into mapped ring memory, then copy it on the GPU
+		const VkDeviceSize stagingOffset = AllocateStaging(chunkSize, STAGING_ALIGNMENT);
+		memcpy(static_cast<char*>(m_StagingAllocation.mappedData) + stagingOffset, srcData + uploaded, (size_t)chunkSize);
+
+		CopyBuffer(m_StagingBuffer, dstBuffer, chunkSize, stagingOffset, dstOffset + uploaded);
+
+		uploaded += chunkSize;
+	}
+
+	if (m_TransfersOwnership)
+	{
+		// Earlier chunks ran earlier on this queue, one release at the end covers the whole upload
+		VkBufferMemoryBarrier releaseBarrier{};
+		releaseBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		releaseBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		releaseBarrier.dstAccessMask = 0;							// Ignored for release, acquire makes data visible
+		releaseBarrier.srcQueueFamilyIndex = m_QueueFamilyIndex;
+		releaseBarrier.dstQueueFamilyIndex = m_GraphicsQueueFamilyIndex;
+		releaseBarrier.buffer = dstBuffer;
+		releaseBarrier.offset = dstOffset;
+		releaseBarrier.size = size;
+
+		m_RecordingBatch.bufferReleases.push_back(releaseBarrier);
+	}
+}
+
+void TransferContext::UploadToImage(VkImage image, const void* data, uint32_t width, uint32_t height, uint32_t bytesPerPixel)
+{
+	const VkDeviceSize rowPitch = static_cast<VkDeviceSize>(width) * bytesPerPixel;
+	const VkDeviceSize maxChunkSize = m_StagingSize / MAX_STAGING_CHUNK_DIVISOR;
+	if (rowPitch > maxChunkSize)
+	{
+		throw std::runtime_error("Image row doesn't fit in staging ring");
+	}
+
+	// Chunks are whole rows so each one is a plain sub-rectangle copy
+	const uint32_t rowsPerChunk = static_cast<uint32_t>(maxChunkSize / rowPitch);
+	const char* srcData = static_cast<const char*>(data);
+
+	TransitionImageLayout(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	for (uint32_t row{}; row < height;)
+	{
+		const uint32_t rowCount = std::min(height - row, rowsPerChunk);
+		const VkDeviceSize chunkSize = rowCount * rowPitch;
+
+		const VkDeviceSize stagingOffset = AllocateStaging(chunkSize, STAGING_ALIGNMENT);
+		memcpy(static_cast<char*>(m_StagingAllocation.mappedData) + stagingOffset, srcData + row * rowPitch, (size_t)chunkSize);
+
+		CopyBufferToImage(m_StagingBuffer, image, width, rowCount, stagingOffset, row);
+
+		row += rowCount;
+	}
+
+	if (!m_TransfersOwnership)
+	{
+		TransitionImageLayout(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		return;
+	}
+
+	// Layout transition happens as part of the ownership transfer, release and acquire must match
+	VkImageMemoryBarrier releaseBarrier{};
+	releaseBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	releaseBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	releaseBarrier.dstAccessMask = 0;
+	releaseBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	releaseBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	releaseBarrier.srcQueueFamilyIndex = m_QueueFamilyIndex;
+	releaseBarrier.dstQueueFamilyIndex = m_GraphicsQueueFamilyIndex;
+	releaseBarrier.image = image;
+	releaseBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	releaseBarrier.subresourceRange.baseMipLevel = 0;
+	releaseBarrier.subresourceRange.levelCount = 1;
+	releaseBarrier.subresourceRange.baseArrayLayer = 0;
+	releaseBarrier.subresourceRange.layerCount = 1;
+
+	m_RecordingBatch.imageReleases.push_back(releaseBarrier);
+}
+
+TransferToken TransferContext::GetRecordingToken() const
+{
+	return m_IsRecording ? m_RecordingBatch.token : m_NextToken - 1;
+}
+
+TransferToken TransferContext::Flush()
+{
+	if (!m_IsRecording)
+	{
+		return m_NextToken - 1;
+	}
+
+	if (m_TransfersOwnership)
+	{
+		// Hand uploaded resources over to the graphics family, transfer queues only know transfer stages
+		if (!m_RecordingBatch.bufferReleases.empty() || !m_RecordingBatch.imageReleases.empty())
+		{
+			vkCmdPipelineBarrier(
+				m_RecordingBatch.commandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				0,
+				0, nullptr,
+				static_cast<uint32_t>(m_RecordingBatch.bufferReleases.size()), m_RecordingBatch.bufferReleases.data(),
+				static_cast<uint32_t>(m_RecordingBatch.imageReleases.size()), m_RecordingBatch.imageReleases.data()
+			);
+		}
+	}
+	else
+	{
+		// Make buffer writes visible to vertex input and shaders of any later submission on this queue
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			m_RecordingBatch.commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0,
+			1, &memoryBarrier,
+			0, nullptr,
+			0, nullptr
+		);
+	}
+
+	VkResult result = vkEndCommandBuffer(m_RecordingBatch.commandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to end transfer command buffer");
+	}
+
+	// Timeline reaches the token when the whole batch is done, no queue drain needed
+	const uint64_t signalValue = m_Timeline.AdvanceSubmitValue();
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.signalSemaphoreValueCount = 1;
+	timelineSubmitInfo.pSignalSemaphoreValues = &signalValue;
+
+	const VkSemaphore timelineSemaphore = m_Timeline.GetSemaphore();
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &m_RecordingBatch.commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timelineSemaphore;
+
+	result = vkQueueSubmit(m_Queue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit transfer batch");
+	}
+
+	const TransferToken token = m_RecordingBatch.token;
+
+	m_InFlightBatches.push_back(std::move(m_RecordingBatch));
+	m_RecordingBatch = Batch{};
+	m_IsRecording = false;
+	m_NextToken++;
+
+	return token;
+}
+
+bool TransferContext::IsComplete(TransferToken token)
+{
+	// Released resources only become usable once a graphics command buffer acquired them
+	if (m_TransfersOwnership)
+	{
+		return token <= m_AcquiredToken;
+	}
+
+	if (token <= m_CompletedToken)
+	{
+		return true;
+	}
+
+	RetireCompletedBatches();
+
+	return token <= m_CompletedToken;
+}
+
+void TransferContext::Wait(TransferToken token)
+{
+	if (token <= m_CompletedToken)
+	{
+		return;
+	}
+
+	// Waiting on work that was never submitted would hang forever
+	if (m_IsRecording && token >= m_RecordingBatch.token)
+	{
+		Flush();
+	}
+
+	// Batches finish in submission order, so wait on the last one covered by token
+	while (!m_InFlightBatches.empty() && m_InFlightBatches.front().token <= token)
+	{
+		WaitOldestBatch();
+	}
+}
+
+void TransferContext::RecordAcquireBarriers(VkCommandBuffer commandBuffer)
+{
+	RetireCompletedBatches();
+
+	// Host saw the batch's timeline value, so the releases happened before this command buffer is submitted
+	if (!m_BufferAcquires.empty() || !m_ImageAcquires.empty())
+	{
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(m_BufferAcquires.size()), m_BufferAcquires.data(),
+			static_cast<uint32_t>(m_ImageAcquires.size()), m_ImageAcquires.data()
+		);
+
+		m_BufferAcquires.clear();
+		m_ImageAcquires.clear();
+	}
+
+	m_AcquiredToken = m_CompletedToken;
+}
+
+VkCommandBuffer TransferContext::GetCommandBuffer()
+{
+	if (m_IsRecording)
+	{
+		return m_RecordingBatch.commandBuffer;
+	}
+
+	RetireCompletedBatches();
+
+	// Reuse a finished batch when possible
+	if (!m_FreeBatches.empty())
+	{
+		m_RecordingBatch = std::move(m_FreeBatches.back());
+		m_FreeBatches.pop_back();
+
+		vkResetCommandBuffer(m_RecordingBatch.commandBuffer, 0);
+	}
+	else
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = m_CommandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkResult result = vkAllocateCommandBuffers(m_Device, &allocInfo, &m_RecordingBatch.commandBuffer);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate transfer command buffer");
+		}
+	}
+
+	// Batches are submitted in recording order, so the token is the value its submit will signal
+	m_RecordingBatch.token = m_NextToken;
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // Only submitted once before being reset
+
+	vkBeginCommandBuffer(m_RecordingBatch.commandBuffer, &beginInfo);
+	m_IsRecording = true;
+
+	return m_RecordingBatch.commandBuffer;
+}
+
+VkDeviceSize TransferContext::AllocateStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+	// Make sure a batch is open so the space is tied to the commands reading it
+	GetCommandBuffer();
+
+	while (true)
+	{
+		// Nothing in flight reads the ring, start over at the front
+		if (m_StagingHead == m_StagingTail)
+		{
+			m_StagingHead = 0;
+			m_StagingTail = 0;
+		}
+
+		VkDeviceSize offset = (m_StagingHead + alignment - 1) & ~(alignment - 1);
+
+		// Range can't wrap around the end of the buffer, skip to start of next lap
+		if (offset % m_StagingSize + size > m_StagingSize)
+		{
+			offset = (offset / m_StagingSize + 1) * m_StagingSize;
+		}
+
+		if (offset + size - m_StagingTail <= m_StagingSize)
+		{
+			m_StagingHead = offset + size;
+			m_RecordingBatch.usesStaging = true;
+			m_RecordingBatch.stagingEnd = m_StagingHead;
+
+			return offset % m_StagingSize;
+		}
+
+		// Ring is full: submit what reads it so far and reclaim the oldest batch's space
+		if (m_RecordingBatch.usesStaging)
+		{
+			Flush();
+			GetCommandBuffer();
+		}
+
+		if (m_InFlightBatches.empty())
+		{
+			throw std::runtime_error("Upload doesn't fit in staging ring");
+		}
+
+		WaitOldestBatch();
+	}
+}
+
+void TransferContext::WaitOldestBatch()
+{
+	Batch& batch = m_InFlightBatches.front();
+	m_Timeline.Wait(batch.token);
+
+	RetireBatch(batch);
+	m_InFlightBatches.pop_front();
+}
+
+void TransferContext::RetireBatch(Batch& batch)
+{
+	// GPU is done reading this batch's part of the staging ring
+	if (batch.usesStaging)
+	{
+		m_StagingTail = batch.stagingEnd;
+	}
+	batch.usesStaging = false;
+	batch.stagingEnd = 0;
+
+	// Matching acquire barriers for the graphics family
+	for (auto barrier : batch.bufferReleases)
+	{
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		m_BufferAcquires.push_back(barrier);
+	}
+	for (auto barrier : batch.imageReleases)
+	{
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		m_ImageAcquires.push_back(barrier);
+	}
+	batch.bufferReleases.clear();
+	batch.imageReleases.clear();
+
+	m_CompletedToken = std::max(m_CompletedToken, batch.token);
+	m_FreeBatches.push_back(std::move(batch));
+}
+
+void TransferContext::RetireCompletedBatches()
+{
+	// One counter query covers every finished batch
+	const uint64_t completedValue = m_Timeline.GetCompletedValue();
+	while (!m_InFlightBatches.empty() && m_InFlightBatches.front().token <= completedValue)
+	{
+		RetireBatch(m_InFlightBatches.front());
+		m_InFlightBatches.pop_front();
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <deque>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "TimelineSemaphore.h"
+
+// Default size of the persistently mapped staging ring all uploads go through
+const VkDeviceSize DEFAULT_STAGING_RING_SIZE = 32ull * 1024 * 1024;
+
+// Monotonically increasing id of a transfer batch, work recorded up to a token is done once the token completes.
+// It is the value the batch's submit signals on the transfer queue's timeline semaphore
+using TransferToken = uint64_t;
+
+// Records many copies and layout transitions into one command buffer and submits them together,
+// instead of a blocking submit + vkQueueWaitIdle per copy. Every batch signals its token on one timeline semaphore.
+// Upload data is written straight into a staging ring, space is reclaimed when the batch that read it retires.
+// When it runs on a separate (transfer) queue family, uploaded resources are released to the graphics family
+// and must be acquired with RecordAcquireBarriers in a graphics command buffer before use.
+class TransferContext final
+{
+public:
+	TransferContext() = default;
+	~TransferContext() = default;
+
+	TransferContext(const TransferContext&) = delete;
+	TransferContext& operator=(const TransferContext&) = delete;
+
+	void Init(VkDevice device, MemoryAllocator* allocator, VkQueue queue, uint32_t queueFamilyIndex,
+		uint32_t graphicsQueueFamilyIndex, VkDeviceSize stagingRingSize = DEFAULT_STAGING_RING_SIZE);
+	void Destroy();
+
+	// - Record functions (nothing reaches the GPU until Flush)
+	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
+	void CopyBufferToImage(VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height, VkDeviceSize srcOffset = 0, uint32_t firstRow = 0);
+	void TransitionImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+	// - Upload functions (copy data into the staging ring, split in chunks when larger than the ring allows)
+	void UploadToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+	void UploadToImage(VkImage image, const void* data, uint32_t width, uint32_t height, uint32_t bytesPerPixel);
+
+	// - Submission functions
+	TransferToken GetRecordingToken() const;		// Token covering everything recorded so far
+	TransferToken Flush();							// Submit recorded work, returns its token
+	bool IsComplete(TransferToken token);			// Non-blocking check if work is done and usable by graphics queue
+	void Wait(TransferToken token);					// Blocks until token completes (flushes if needed)
+
+	// Records graphics family acquire barriers for every retired batch (no-op without ownership transfer)
+	void RecordAcquireBarriers(VkCommandBuffer commandBuffer);
+
+private:
+	struct Batch
+	{
+		VkCommandBuffer commandBuffer{};
+		TransferToken token{};
+
+		bool usesStaging{ false };
+		VkDeviceSize stagingEnd{};		// Ring head after the last staging allocation of this batch
+
+		// Ownership releases recorded at the end of the batch, graphics family acquires them after it retired
+		std::vector<VkBufferMemoryBarrier> bufferReleases{};
+		std::vector<VkImageMemoryBarrier> imageReleases{};
+	};
+
+	VkDevice m_Device{};
+	MemoryAllocator* m_pAllocator{};
+	VkQueue m_Queue{};
+	VkCommandPool m_CommandPool{};
+	TimelineSemaphore m_Timeline{};				// Reaches a batch's token once the batch finished
+
+	uint32_t m_QueueFamilyIndex{};
+	uint32_t m_GraphicsQueueFamilyIndex{};
+	bool m_TransfersOwnership{ false };			// Queue family differs from graphics family
+
+	// Acquires of retired batches, waiting to be recorded into the next graphics command buffer
+	std::vector<VkBufferMemoryBarrier> m_BufferAcquires{};
+	std::vector<VkImageMemoryBarrier> m_ImageAcquires{};
+
+	// Staging ring, offsets grow monotonically and are wrapped by ring size on use
+	VkBuffer m_StagingBuffer{};
+	Allocation m_StagingAllocation{};
+	VkDeviceSize m_StagingSize{};
+	VkDeviceSize m_StagingHead{};				// Next free byte
+	VkDeviceSize m_StagingTail{};				// Oldest byte still read by an in-flight batch
+
+	Batch m_RecordingBatch{};
+	bool m_IsRecording{ false };
+
+	std::deque<Batch> m_InFlightBatches{};		// Submitted, in submission order
+	std::vector<Batch> m_FreeBatches{};			// Finished batches ready for reuse
+
+	TransferToken m_NextToken{ 1 };
+	TransferToken m_CompletedToken{};
+	TransferToken m_AcquiredToken{};				// Completed token whose acquires have been recorded
+
+	VkCommandBuffer GetCommandBuffer();
+	VkDeviceSize AllocateStaging(VkDeviceSize size, VkDeviceSize alignment);
+	void WaitOldestBatch();
+	void RetireBatch(Batch& batch);
+	void RetireCompletedBatches();
+};
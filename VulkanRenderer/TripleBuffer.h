@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+const uint8_t TRIPLE_BUFFER_INDEX_MASK = 0x3;
+const uint8_t TRIPLE_BUFFER_PUBLISHED_BIT = 0x4;		// Middle buffer wasn't acquired yet
+
+// Lock-free handoff of a value from one producer thread to one consumer thread. The producer writes its own buffer and
+// publishes it, the consumer takes the newest published one, so neither ever waits for the other and values published in
+// between are skipped. One buffer each for producer and consumer, the third (middle) holds the newest published one and
+// changes hands with an atomic exchange
+template<typename T>
+class TripleBuffer final
+{
+public:
+	TripleBuffer() = default;
+	~TripleBuffer() = default;
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// - Producer
+	T& GetWriteBuffer() { return m_Buffers[m_WriteIndex]; }
+
+	// Hands the write buffer to the consumer, writes continue in the buffer it replaced
+	void Publish()
+	{
+		const uint8_t middle = m_Middle.exchange(static_cast<uint8_t>(m_WriteIndex | TRIPLE_BUFFER_PUBLISHED_BIT), std::memory_order_acq_rel);
+		m_WriteIndex = middle & TRIPLE_BUFFER_INDEX_MASK;
+		m_Middle.notify_one();
+	}
+
+	// - Consumer
+	// Takes the newest published buffer as read buffer, false (read buffer unchanged) when nothing was published since
+	bool Acquire()
+	{
+		if ((m_Middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_PUBLISHED_BIT) == 0)
+		{
+			return false;
+		}
+
+		const uint8_t middle = m_Middle.exchange(m_ReadIndex, std::memory_order_acq_rel);
+		m_ReadIndex = middle & TRIPLE_BUFFER_INDEX_MASK;
+		return true;
+	}
+
+	// Blocks until something was published since the last Acquire
+	void WaitForPublish() const
+	{
+		uint8_t middle = m_Middle.load(std::memory_order_acquire);
+		while ((middle & TRIPLE_BUFFER_PUBLISHED_BIT) == 0)
+		{
+			m_Middle.wait(middle, std::memory_order_acquire);
+			middle = m_Middle.load(std::memory_order_acquire);
+		}
+	}
+
+	const T& GetReadBuffer() const { return m_Buffers[m_ReadIndex]; }
+
+private:
+	std::array<T, 3> m_Buffers{};
+	uint8_t m_WriteIndex{ 0 };							// Producer only
+	std::atomic<uint8_t> m_Middle{ 1 };					// Index and published bit
+	uint8_t m_ReadIndex{ 2 };							// Consumer only
+};
@@ -0,0 +1,66 @@
+#include "UniformRing.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Utilities.h"
+
+void UniformRing::Init(VkDevice device, MemoryAllocator* allocator, VkDeviceSize minOffsetAlignment, uint32_t frameCount, VkDeviceSize frameSize,
+	VkBufferUsageFlags usage)
+{
+	m_Device = device;
+	m_pAllocator = allocator;
+	m_Alignment = minOffsetAlignment > 0 ? minOffsetAlignment : 1;
+	m_FrameCount = frameCount;
+
+	// Keep every slice start aligned so offsets stay valid dynamic offsets
+	m_FrameSize = (frameSize + m_Alignment - 1) / m_Alignment * m_Alignment;
+
+	CreateBuffer(
+		m_Device,
+		m_pAllocator,
+		m_FrameSize * m_FrameCount,
+		usage,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		MemoryCategory::Uniform,
+		&m_Buffer,
+		&m_Allocation
+	);
+}
+
+void UniformRing::Destroy()
+{
+	DestroyBuffer(m_Device, m_pAllocator, m_Buffer, &m_Allocation);
+}
+
+void UniformRing::BeginFrame(uint32_t frameIndex)
+{
+	m_FrameBegin = m_FrameSize * (frameIndex % m_FrameCount);
+	m_FrameHead = m_FrameBegin;
+}
+
+void* UniformRing::Allocate(VkDeviceSize size, uint32_t* dynamicOffset)
+{
+	const VkDeviceSize offset = (m_FrameHead + m_Alignment - 1) / m_Alignment * m_Alignment;
+	if (offset + size > m_FrameBegin + m_FrameSize)
+	{
+		throw std::runtime_error("Uniform ring frame slice is full");
+	}
+
+	m_FrameHead = offset + size;
+	*dynamicOffset = static_cast<uint32_t>(offset);
+
+	return static_cast<char*>(m_Allocation.mappedData) + offset;
+}
+
+uint32_t UniformRing::Push(const void* data, VkDeviceSize size)
+{
+	uint32_t dynamicOffset{};
+	void* pDestination = Allocate(size, &dynamicOffset);
+	if (size > 0)
+	{
+		memcpy(pDestination, data, (size_t)size);
+	}
+
+	return dynamicOffset;
+}
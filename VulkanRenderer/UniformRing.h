@@ -0,0 +1,53 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "MemoryAllocator.h"
+
+// Default bytes of uniform data a single frame in flight can push
+const VkDeviceSize DEFAULT_UNIFORM_FRAME_SIZE = 64ull * 1024;
+// Default bytes of per-instance data a single frame in flight can push (65536 transforms)
+const VkDeviceSize DEFAULT_INSTANCE_FRAME_SIZE = 4ull * 1024 * 1024;
+
+// One persistently mapped uniform buffer split in a slice per frame in flight.
+// Per-frame constants are sub-allocated linearly from the current slice and bound through
+// UNIFORM_BUFFER_DYNAMIC descriptors, so an update is one memcpy and a dynamic offset.
+// Other per-frame data written by the CPU (e.g. per-instance vertex data) uses the same ring with different buffer usage.
+class UniformRing final
+{
+public:
+	UniformRing() = default;
+	~UniformRing() = default;
+
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	void Init(VkDevice device, MemoryAllocator* allocator, VkDeviceSize minOffsetAlignment, uint32_t frameCount,
+		VkDeviceSize frameSize = DEFAULT_UNIFORM_FRAME_SIZE, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	void Destroy();
+
+	// Start writing into the frame's slice, GPU must be done with that frame (its timeline value waited on)
+	void BeginFrame(uint32_t frameIndex);
+
+	// Reserve aligned space in current slice, returns mapped pointer and offset to pass as dynamic offset
+	void* Allocate(VkDeviceSize size, uint32_t* dynamicOffset);
+	uint32_t Push(const void* data, VkDeviceSize size);
+
+	VkBuffer GetBuffer() const { return m_Buffer; }
+	VkDeviceSize GetFrameSize() const { return m_FrameSize; }
+
+private:
+	VkDevice m_Device{};
+	MemoryAllocator* m_pAllocator{};
+
+	VkBuffer m_Buffer{};
+	Allocation m_Allocation{};
+
+	VkDeviceSize m_Alignment{ 1 };
+	VkDeviceSize m_FrameSize{};				// Size of one slice, multiple of alignment
+	uint32_t m_FrameCount{};
+
+	VkDeviceSize m_FrameBegin{};			// Offset of current slice
+	VkDeviceSize m_FrameHead{};				// Next free offset in current slice
+};
@@ -1,12 +1,20 @@
 #pragma once
 
+#include <array>
 #include <fstream>
 #include <glm/glm.hpp>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
-const int MAX_FRAME_DRAWS = 2;
-const int MAX_OBJECTS = 20;
+#include "MemoryAllocator.h"
+
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;	// Frames recorded ahead of the GPU unless picked at startup
+const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+const int MAX_TEXTURES = 4096;			// Size of the bindless texture array, lowered to the device's update after bind limits
+const int DEFAULT_TEXTURE_ID = 0;		// 1x1 white texture created at startup, materials without a texture use it. Never unloaded
+const int MAX_DRAWS = 16384;			// Indirect draws (and model transforms) a single frame can record
+const int MAX_RECORDING_THREADS = 8;	// Threads recording a frame's draws into secondary command buffers
+const bool PRECOMPUTE_TRANSFORMS = true;	// Model-view-projection and normal matrices are computed per model on the CPU, not per vertex
 
 const std::vector<const char*> g_DeviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -25,6 +33,7 @@ struct QueueFamilyIndices
 {
 	int32_t graphicsFamily = -1;			// Location of graphics queue family on GPU (-1 means non-existent)
 	int32_t presentationFamily = -1;		// Location of presentation queue family
+	int32_t transferFamily = -1;			// Location of transfer queue family (graphics family if there is no dedicated one)
 
 	// Check if queue families are valid
 	bool IsValid() const
@@ -73,32 +82,15 @@ static std::vector<char> ReadFile(const std::string& filename)
 	return fileBuffer;
 }
 
-static uint32_t FindMemoryTypeIndex(VkPhysicalDevice physicalDevice ,uint32_t allowedTypes, VkMemoryPropertyFlags properties)
-{
-	// Get properties of physical device memory
-	VkPhysicalDeviceMemoryProperties memProperties{};
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-	for (uint32_t i{}; i < memProperties.memoryTypeCount; i++)
-	{
-		// Index of memory type must match corresponding bit in allowed types
-		// Desired property bit flags are part of memory bit flags
-		if ((allowedTypes & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-		{
-			// memory type is valid
-			return i;
-		}
-	}
-}
-
 static void CreateBuffer(
-	VkPhysicalDevice physicalDevice, 
 	VkDevice device, 
+	MemoryAllocator* allocator,
 	VkDeviceSize bufferSize, 
 	VkBufferUsageFlags bufferUsage, 
 	VkMemoryPropertyFlags bufferProperties, 
+	MemoryCategory category,
 	VkBuffer* buffer, 
-	VkDeviceMemory* bufferMemory)
+	Allocation* bufferAllocation)
 {
 	// CREATE VERTEX BUFFER
 	// just info about buffer no memory included
@@ -118,170 +110,35 @@ static void CreateBuffer(
 	VkMemoryRequirements memRequirements{};
 	vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
 
-	// ALLOCATE MEMORY TO BUFFER
-	VkMemoryAllocateInfo memAllocInfo{};
-	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAllocInfo.allocationSize = memRequirements.size;
-	memAllocInfo.memoryTypeIndex = FindMemoryTypeIndex(
-		physicalDevice,
-		memRequirements.memoryTypeBits,										
-		bufferProperties																
-	);																					
-
-	// Allocate memory to VkDeviceMemory
-	result = vkAllocateMemory(device, &memAllocInfo, nullptr, bufferMemory);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate vertex buffer memory");
-	}
-
-	// Allocate memory to given vertex buffer
-	vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
-}
-
-
-static VkCommandBuffer BeginCommandBuffer(VkDevice device, VkCommandPool commandPool)
-{
-	// Command buffer to hold transfer commands
-	VkCommandBuffer commandBuffer{};
-
-	// Command buffer details
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool;
-	allocInfo.commandBufferCount = 1;
-
-	// Allocate command buffer from pool
-	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-	// Information to begin command buffer record
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // Only using the command buffer once
-
-	// Begin recording transfer commands
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	return commandBuffer;
-}
-
-static void EndAndSubmitCommandBuffer(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer)
-{
-	// End recording
-	vkEndCommandBuffer(commandBuffer);
-
-	// Queue submission information
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	// SUB-ALLOCATE MEMORY FOR BUFFER (allocator picks memory type and block)
+	*bufferAllocation = allocator->Allocate(memRequirements, bufferProperties, AllocationType::Buffer, category);
 
-	// Submit transfer command to transfer queue and wait until it finishes
-	vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue);
-
-	// Free temporary command buffer back to pool
-	vkFreeCommandBuffers(device,commandPool, 1, &commandBuffer);
+	// Bind memory to given buffer at its offset in the block
+	vkBindBufferMemory(device, *buffer, bufferAllocation->memory, bufferAllocation->offset);
 }
 
-static void CopyBuffer(
-	VkDevice device, 
-	VkQueue transferQueue, 
-	VkCommandPool transferCommandPool, 
-	VkBuffer srcBuffer, 
-	VkBuffer dstBuffer, 
-	VkDeviceSize bufferSize)
+static void DestroyBuffer(VkDevice device, MemoryAllocator* allocator, VkBuffer buffer, Allocation* bufferAllocation)
 {
-	VkCommandBuffer transferCommandBuffer = BeginCommandBuffer(device, transferCommandPool);
-
-	{
-		// Region of data to copy from and to
-		VkBufferCopy bufferCopyRegion{};
-		bufferCopyRegion.srcOffset = 0;
-		bufferCopyRegion.dstOffset = 0;
-		bufferCopyRegion.size = bufferSize;
-
-		// Command to copy src buffer to dst buffer
-		vkCmdCopyBuffer(transferCommandBuffer, srcBuffer, dstBuffer, 1, &bufferCopyRegion);
-	}
-	
-	EndAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
+	vkDestroyBuffer(device, buffer, nullptr);
+	allocator->Free(*bufferAllocation);
 }
 
-static void CopyImageBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-	VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height)
+// Left, right, bottom, top, near, far planes of a view projection (normalized, xyz points inside).
+// A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+static std::array<glm::vec4, 6> ExtractFrustumPlanes(const glm::mat4& viewProjection)
 {
-	VkCommandBuffer transferCommandBuffer = BeginCommandBuffer(device, transferCommandPool);
-
+	// Rows of the matrix, glm is column major
+	const glm::vec4 row0{ viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0] };
+	const glm::vec4 row1{ viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1] };
+	const glm::vec4 row2{ viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2] };
+	const glm::vec4 row3{ viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3] };
+
+	// Near uses the -w <= z clip range, conservative when the projection maps depth to [0, 1]
+	std::array<glm::vec4, 6> planes = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 };
+	for (auto& plane : planes)
 	{
-		VkBufferImageCopy imageRegion{};
-		imageRegion.bufferOffset = 0;
-		imageRegion.bufferRowLength = 0;
-		imageRegion.bufferImageHeight = 0;
-		imageRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageRegion.imageSubresource.mipLevel = 0;
-		imageRegion.imageSubresource.baseArrayLayer = 0;
-		imageRegion.imageSubresource.layerCount = 1;
-		imageRegion.imageOffset = { 0,0,0 };
-		imageRegion.imageExtent = { width, height, 1 };
-
-		vkCmdCopyBufferToImage(transferCommandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageRegion);
+		plane /= glm::length(glm::vec3(plane));
 	}
 
-	EndAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
+	return planes;
 }
-
-static void TransitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
-{
-	VkCommandBuffer commandBuffer = BeginCommandBuffer(device, commandPool);
-
-	{
-		VkImageMemoryBarrier memoryBarrier{};
-
-		memoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		memoryBarrier.oldLayout = oldLayout;
-		memoryBarrier.newLayout = newLayout;
-		memoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		memoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		memoryBarrier.image = image;
-		memoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		memoryBarrier.subresourceRange.baseMipLevel = 0;
-		memoryBarrier.subresourceRange.layerCount = 1;
-		memoryBarrier.subresourceRange.levelCount = 1;
-		memoryBarrier.subresourceRange.baseArrayLayer = 0;
-
-		VkPipelineStageFlags srcStage{};
-		VkPipelineStageFlags dstStage{};
-
-		// if transitioning from new image to image ready to receive data
-		if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-		{
-			memoryBarrier.srcAccessMask = 0;								// Memory access stage transition must happen after...
-			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;		// Memory access stage transition must happen before...
-		
-			srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		}
-		// If transitioning from transfer destination to shader readable...
-		else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-		{
-			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-			srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		}
-
-		vkCmdPipelineBarrier(
-			commandBuffer,
-			srcStage, dstStage,				// Match to src and dst access masks
-			0,											// Dependency flags
-			0, nullptr,					// Memory barrier count + data
-			0, nullptr,		// Buffer memory barrier count + data
-			1, &memoryBarrier
-		);
-	}
-
-	EndAndSubmitCommandBuffer(device, commandPool, queue, commandBuffer);
-}
\ No newline at end of file
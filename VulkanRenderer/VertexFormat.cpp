@@ -0,0 +1,187 @@
+#include "VertexFormat.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	uint16_t QuantizeUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::clamp(value, 0.f, 1.f) * 65535.f + 0.5f);
+	}
+
+	int16_t QuantizeSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::round(std::clamp(value, -1.f, 1.f) * 32767.f));
+	}
+
+	// Map unit vector onto the octahedron, lower half folded over the diagonals
+	glm::vec2 OctahedralEncode(glm::vec3 normal)
+	{
+		const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (length == 0.f)
+		{
+			return glm::vec2{ 0.f };
+		}
+
+		normal /= length;
+
+		glm::vec2 encoded{ normal.x, normal.y };
+		if (normal.z < 0.f)
+		{
+			encoded.x = (1.f - std::abs(normal.y)) * (normal.x >= 0.f ? 1.f : -1.f);
+			encoded.y = (1.f - std::abs(normal.x)) * (normal.y >= 0.f ? 1.f : -1.f);
+		}
+
+		return encoded;
+	}
+
+	template<typename CompactType>
+	void EncodeCompact(const std::vector<Vertex>& vertices, const VertexQuantization& quantization, std::vector<uint8_t>* data)
+	{
+		data->resize(sizeof(CompactType) * vertices.size());
+		CompactType* compactVertices = reinterpret_cast<CompactType*>(data->data());
+
+		for (size_t i{}; i < vertices.size(); ++i)
+		{
+			const glm::vec3 normalized = (vertices[i].pos - glm::vec3(quantization.positionOffset)) / glm::vec3(quantization.positionScale);
+
+			CompactType& compact = compactVertices[i];
+			compact.pos[0] = QuantizeUnorm16(normalized.x);
+			compact.pos[1] = QuantizeUnorm16(normalized.y);
+			compact.pos[2] = QuantizeUnorm16(normalized.z);
+			compact.pos[3] = 0;
+			compact.uv[0] = glm::packHalf1x16(vertices[i].uv.x);
+			compact.uv[1] = glm::packHalf1x16(vertices[i].uv.y);
+		}
+	}
+}
+
+const char* GetVertexFormatName(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Compact:			return "Compact";
+	case VertexFormat::CompactNormal:	return "CompactNormal";
+	default:							return "Standard";
+	}
+}
+
+uint32_t GetVertexStride(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Compact:			return sizeof(CompactVertex);
+	case VertexFormat::CompactNormal:	return sizeof(CompactNormalVertex);
+	default:							return sizeof(Vertex);
+	}
+}
+
+void GetVertexInputDescription(VertexFormat format, std::vector<VkVertexInputBindingDescription>* bindings,
+	std::vector<VkVertexInputAttributeDescription>* attributes)
+{
+	VkVertexInputBindingDescription vertexBinding{};
+	vertexBinding.binding = VERTEX_BINDING;						// Binding position (can bind multiple streams of data)
+	vertexBinding.stride = GetVertexStride(format);				// Offset to next piece of data
+	vertexBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;		// How to move between data between each vertex
+																// VK_VERTEX_INPUT_RATE_VERTEX		: move on to next vertex
+																// VK_VERTEX_INPUT_RATE_INSTANCE	: move on to vertex for next instance (can draw 100 trees as 1 tree)
+
+	// Every instance of a mesh in one draw, each gets its own transform
+	VkVertexInputBindingDescription instanceBinding{};
+	instanceBinding.binding = INSTANCE_BINDING;
+	instanceBinding.stride = sizeof(InstanceData);
+	instanceBinding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	*bindings = { vertexBinding, instanceBinding };
+
+	attributes->clear();
+
+	// Instance transform, a mat4 input takes one location per column
+	for (uint32_t column{}; column < 4; ++column)
+	{
+		attributes->push_back({ INSTANCE_FIRST_LOCATION + column, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT,
+			static_cast<uint32_t>(offsetof(InstanceData, transform) + sizeof(glm::vec4) * column) });
+	}
+
+	if (format == VertexFormat::Standard)
+	{
+		// Position attribute
+		// Which binding it is at (same as above), which location it is at, format data will take (helps define size) and offset in vertex
+		attributes->push_back({ 0, VERTEX_BINDING, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) });
+
+		// Color attribute
+		attributes->push_back({ 1, VERTEX_BINDING, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, col) });
+
+		// Texture coordinate attribute
+		attributes->push_back({ 2, VERTEX_BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) });
+		return;
+	}
+
+	// Compact formats have no color (models always loaded white), shader dequantizes with the mesh's push constants
+	// Same offsets for both compact layouts, normal is appended
+	attributes->push_back({ 0, VERTEX_BINDING, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompactVertex, pos) });
+	attributes->push_back({ 1, VERTEX_BINDING, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv) });
+
+	if (format == VertexFormat::CompactNormal)
+	{
+		attributes->push_back({ 2, VERTEX_BINDING, VK_FORMAT_R16G16_SNORM, offsetof(CompactNormalVertex, normal) });
+	}
+}
+
+std::vector<uint8_t> EncodeVertices(VertexFormat format, const std::vector<Vertex>& vertices, const std::vector<glm::vec3>& normals,
+	VertexQuantization* quantization)
+{
+	std::vector<uint8_t> data{};
+	*quantization = VertexQuantization{};
+
+	if (format == VertexFormat::Standard)
+	{
+		data.resize(sizeof(Vertex) * vertices.size());
+		memcpy(data.data(), vertices.data(), data.size());
+		return data;
+	}
+
+	// Quantize relative to the mesh bounds so all 16 bits go to the part of space the mesh covers
+	glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+	glm::vec3 boundsMax{ std::numeric_limits<float>::lowest() };
+	for (const auto& vertex : vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.pos);
+		boundsMax = glm::max(boundsMax, vertex.pos);
+	}
+
+	if (vertices.empty())
+	{
+		boundsMin = boundsMax = glm::vec3{ 0.f };
+	}
+
+	// Flat axis would divide by zero, any scale decodes to the same value there
+	const glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3{ std::numeric_limits<float>::min() });
+	quantization->positionOffset = glm::vec4(boundsMin, 0.f);
+	quantization->positionScale = glm::vec4(extent, 0.f);
+
+	if (format == VertexFormat::Compact)
+	{
+		EncodeCompact<CompactVertex>(vertices, *quantization, &data);
+		return data;
+	}
+
+	EncodeCompact<CompactNormalVertex>(vertices, *quantization, &data);
+
+	CompactNormalVertex* compactVertices = reinterpret_cast<CompactNormalVertex*>(data.data());
+	for (size_t i{}; i < vertices.size(); ++i)
+	{
+		const glm::vec3 normal = i < normals.size() ? normals[i] : glm::vec3{ 0.f, 0.f, 1.f };
+		const glm::vec2 encoded = OctahedralEncode(normal);
+
+		compactVertices[i].normal[0] = QuantizeSnorm16(encoded.x);
+		compactVertices[i].normal[1] = QuantizeSnorm16(encoded.y);
+	}
+
+	return data;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Utilities.h"
+
+// Layout of vertices in a geometry buffer, chosen per model
+enum class VertexFormat
+{
+	Standard,			// Vertex: float position, color and uv (32 bytes)
+	Compact,			// CompactVertex: 16-bit position in mesh bounds, half float uv (12 bytes)
+	CompactNormal,		// CompactNormalVertex: Compact + octahedral normal (16 bytes)
+	Count
+};
+
+const char* GetVertexFormatName(VertexFormat format);
+uint32_t GetVertexStride(VertexFormat format);
+
+// Position is unorm16 relative to the mesh AABB (w is padding, 3 component 16-bit formats aren't widely supported as vertex input)
+struct CompactVertex
+{
+	uint16_t pos[4];
+	uint16_t uv[2];		// Half floats, uvs outside [0,1] (repeat) stay exact enough
+};
+
+struct CompactNormalVertex
+{
+	uint16_t pos[4];
+	uint16_t uv[2];
+	int16_t normal[2];	// snorm16 octahedral encoding
+};
+
+// Dequantization of compact positions: pos = positionOffset + unorm * positionScale, pushed per mesh
+struct VertexQuantization
+{
+	glm::vec4 positionOffset{ 0.f };	// AABB min
+	glm::vec4 positionScale{ 1.f };		// AABB extent
+};
+
+// Per-instance data streamed from INSTANCE_BINDING, transform takes locations INSTANCE_FIRST_LOCATION to +3
+struct InstanceData
+{
+	glm::mat4 transform{ 1.f };
+};
+
+const uint32_t VERTEX_BINDING = 0;
+const uint32_t INSTANCE_BINDING = 1;
+const uint32_t INSTANCE_FIRST_LOCATION = 4;
+
+// Vertex input state of a pipeline drawing the format from VERTEX_BINDING and instance data from INSTANCE_BINDING
+void GetVertexInputDescription(VertexFormat format, std::vector<VkVertexInputBindingDescription>* bindings,
+	std::vector<VkVertexInputAttributeDescription>* attributes);
+
+// Convert vertices to the format, returns the packed bytes (normals may be empty, they're only read by CompactNormal)
+std::vector<uint8_t> EncodeVertices(VertexFormat format, const std::vector<Vertex>& vertices, const std::vector<glm::vec3>& normals,
+	VertexQuantization* quantization);
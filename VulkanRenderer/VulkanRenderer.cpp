@@ -3,15 +3,30 @@
 #include <functional>
 #include <set>
 #include <stdexcept>
+#include <utility>
 
 #include "Window.h"
 #include <random>
 
-int VulkanRenderer::Init(Window* window)
+// Applied snapshot sequence once the render thread threw
+const uint64_t RENDER_THREAD_FAILED = ~0ull;
+
+int VulkanRenderer::Init(Window* window, uint32_t framesInFlight)
 {
 	m_pWindow = window;
 
 	try {
+		if (framesInFlight < 1 || framesInFlight > MAX_FRAMES_IN_FLIGHT)
+		{
+			throw std::runtime_error("Frames in flight must be between 1 and " + std::to_string(MAX_FRAMES_IN_FLIGHT));
+		}
+		m_FramesInFlight = framesInFlight;
+		m_Frames.resize(m_FramesInFlight);
+		if (CheckValidationEnabled())
+		{
+			printf("Frames in flight: %u\n", m_FramesInFlight);
+		}
+
 		// Will set a debug bool if validation is needed
 		if (CheckValidationEnabled() && !CheckValidationLayerSupport())
 		{
@@ -24,32 +39,46 @@ int VulkanRenderer::Init(Window* window)
 		CreateSurface();
 		GetPhysicalDevice(); 
 		CreateLogicalDevice();
+		m_Allocator.Init(m_MainDevice.physicalDevice, m_MainDevice.logicalDevice, m_MemoryBudgetEnabled);
+
+		int width{};
+		int height{};
+		glfwGetFramebufferSize(m_pWindow->GetWindow(), &width, &height);
+		m_FramebufferExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 		CreateSwapchain();
 		CreateDepthBufferImage();
 		CreateRenderPass();
+		CreateOcclusionRenderPasses();
 		CreateDescriptorSetLayout();
 		CreatePushConstantRange();
-		CreateGraphicsPipeline();
+		CreatePipelineLayout();
 		CreateFrameBuffers();
 		CreateCommandPool();
 		CreateCommandBuffers();
+		CreateRecordingThreads();
+		CreateTransferContext();
+		PrepareVertexFormat(VertexFormat::Standard);
 		CreateTextureSampler();
-		//AllocateDynamicBufferTransferSpace();
 		CreateUniformBuffers();
+		CreateGpuCulling();
+		CreateDepthPyramid();
 		CreateDescriptorPool();
 		CreateDescriptorSets();
+		CreateDefaultTexture();
 		CreateSynchronization();
 
-		m_UboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)m_SwapchainExtent.width / (float)m_SwapchainExtent.height, 0.1f, 100.0f);
+		UpdateProjection();
 		m_UboViewProjection.view = glm::lookAt(m_CameraPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-		m_UboViewProjection.projection[1][1] *= -1.f;
+		m_PendingSnapshot.view = m_UboViewProjection.view;
+		m_UboViewProjection.previousViewProjection = m_UboViewProjection.projection * m_UboViewProjection.view;
 
 
 
 		CreateMeshModel("Models/vehicle.obj");
 		glm::mat4 testMat = glm::rotate(glm::mat4(1.f), glm::radians(-90.f), glm::vec3(0.f, 1.f, 0.f));
 		testMat = glm::rotate(glm::mat4(1.f), glm::radians(-90.f), glm::vec3(1.f, 0.f, 0.f));
+
+		PrintMemoryBudget();
 	}
 	catch(const std::runtime_error &e) {
 		printf("[ERROR]: %s\n", e.what());
@@ -66,6 +95,9 @@ void VulkanRenderer::Update(float deltaTime)
 	bool hasPressedD = InputHandler::GetKeyIsDown(GLFW_KEY_D);
 	bool hasPressedA = InputHandler::GetKeyIsDown(GLFW_KEY_A);
 
+	// Input of the next snapshot, its latency is measured from here
+	m_PendingSnapshot.inputTime = std::chrono::high_resolution_clock::now();
+
 	double deltaX = InputHandler::MouseXDelta();
 	double deltaY = InputHandler::MouseYDelta();
 
@@ -100,1085 +132,2602 @@ void VulkanRenderer::Update(float deltaTime)
 
 	m_CameraFront = glm::normalize(direction);
 
-	m_UboViewProjection.view =  glm::lookAt(m_CameraPos, m_CameraPos + m_CameraFront, m_CameraUp);
+	m_PendingSnapshot.view = glm::lookAt(m_CameraPos, m_CameraPos + m_CameraFront, m_CameraUp);
 }
 
 void VulkanRenderer::UpdateModel(int modelId, glm::mat4 newModel)
 {
-	if (modelId >= m_ModelList.size())
+	GetModelInstanceIds(modelId);
+
+	if (m_PendingSnapshot.modelTransforms.size() <= static_cast<size_t>(modelId))
 	{
-		throw std::runtime_error("Mesh with given ID doesn't exists");
+		m_PendingSnapshot.modelTransforms.resize(modelId + 1);
 	}
-
-	m_ModelList[modelId].SetModel(newModel);
+	m_PendingSnapshot.modelTransforms[modelId] = newModel;
 }
 
-void VulkanRenderer::Cleanup()
+InstanceId VulkanRenderer::AddInstance(int modelId, const glm::mat4& transform)
 {
-	// Wait until no actions being run on device before destroy
-	vkDeviceWaitIdle(m_MainDevice.logicalDevice);
+	ModelInstanceIds& instanceIds = GetModelInstanceIds(modelId);
 
-	// Free memory blocks
-	//_aligned_free(m_ModelTransferSpace);
-
-	for (size_t i{}; i < m_ModelList.size(); ++i)
+	// Handed out here, the render side adds the instance under the same id when it applies the snapshot
+	InstanceId instanceId{};
+	if (!instanceIds.freeIds.empty())
 	{
-		m_ModelList[i].DestroyMeshModel();
+		instanceId = instanceIds.freeIds.back();
+		instanceIds.freeIds.pop_back();
+	}
+	else
+	{
+		instanceId = static_cast<InstanceId>(instanceIds.isUsed.size());
+		instanceIds.isUsed.push_back(false);
 	}
+	instanceIds.isUsed[instanceId] = true;
 
-	vkDestroyDescriptorPool(m_MainDevice.logicalDevice, m_SamplerDescriptorPool, nullptr);
-	vkDestroyDescriptorSetLayout(m_MainDevice.logicalDevice, m_SamplerSetLayout, nullptr);
+	m_PendingSnapshot.commands.push_back({ SceneCommandType::AddInstance, modelId, instanceId, transform });
 
-	vkDestroySampler(m_MainDevice.logicalDevice, m_TextureSampler, nullptr);
+	return instanceId;
+}
 
-	for (size_t i{}; i < m_TextureImages.size(); ++i)
+void VulkanRenderer::UpdateInstance(int modelId, InstanceId instanceId, const glm::mat4& transform)
+{
+	const ModelInstanceIds& instanceIds = GetModelInstanceIds(modelId);
+	if (instanceId >= instanceIds.isUsed.size() || !instanceIds.isUsed[instanceId])
 	{
-		vkDestroyImage(m_MainDevice.logicalDevice, m_TextureImages[i], nullptr);
-		vkFreeMemory(m_MainDevice.logicalDevice, m_TextureImageMemory[i], nullptr);
-		vkDestroyImageView(m_MainDevice.logicalDevice, m_TextureImageViews[i], nullptr);
+		throw std::runtime_error("Invalid instance id");
 	}
 
-	vkDestroyImageView(m_MainDevice.logicalDevice, m_DepthBufferImageView, nullptr);
-	vkDestroyImage(m_MainDevice.logicalDevice, m_DepthBufferImage, nullptr);
-	vkFreeMemory(m_MainDevice.logicalDevice, m_DepthBufferImageMemory, nullptr);
+	m_PendingSnapshot.commands.push_back({ SceneCommandType::UpdateInstance, modelId, instanceId, transform });
+}
 
-	vkDestroyDescriptorPool(m_MainDevice.logicalDevice, m_DescriptorPool, nullptr);
-	vkDestroyDescriptorSetLayout(m_MainDevice.logicalDevice, m_DescriptorSetLayout, nullptr);
-	for (size_t i{}; i < m_SwapchainImages.size(); ++i)
+void VulkanRenderer::RemoveInstance(int modelId, InstanceId instanceId)
+{
+	ModelInstanceIds& instanceIds = GetModelInstanceIds(modelId);
+	if (instanceId >= instanceIds.isUsed.size() || !instanceIds.isUsed[instanceId])
 	{
-		vkDestroyBuffer(m_MainDevice.logicalDevice, m_VPUniformBuffer[i], nullptr);
-		vkFreeMemory(m_MainDevice.logicalDevice, m_VPUniformBufferMemory[i], nullptr);
-
-		//vkDestroyBuffer(m_MainDevice.logicalDevice, m_ModelDynamicUniformBuffer[i], nullptr);
-		//vkFreeMemory(m_MainDevice.logicalDevice, m_ModelDynamicUniformBufferMemory[i], nullptr);
+		throw std::runtime_error("Invalid instance id");
 	}
 
-	for (auto& mesh : m_MeshList)
-	{
-		mesh.DestroyBuffers();
-	}
+	instanceIds.isUsed[instanceId] = false;
+	instanceIds.freeIds.push_back(instanceId);
+
+	m_PendingSnapshot.commands.push_back({ SceneCommandType::RemoveInstance, modelId, instanceId });
+}
+
+void VulkanRenderer::UnloadMeshModel(int modelId)
+{
+	GetModelInstanceIds(modelId) = ModelInstanceIds{};
 
-	for (size_t i = 0; i < MAX_FRAME_DRAWS; ++i)
+	// A model loaded later into the same slot doesn't inherit the transform
+	if (static_cast<size_t>(modelId) < m_PendingSnapshot.modelTransforms.size())
 	{
-		vkDestroySemaphore(m_MainDevice.logicalDevice, m_RendersFinished[i], nullptr);
-		vkDestroySemaphore(m_MainDevice.logicalDevice, m_ImagesAvailable[i], nullptr);
-		vkDestroyFence(m_MainDevice.logicalDevice, m_DrawFences[i], nullptr);
+		m_PendingSnapshot.modelTransforms[modelId].reset();
 	}
 
-	vkDestroyCommandPool(m_MainDevice.logicalDevice, m_GraphicsCommandPool, nullptr);
+	m_PendingSnapshot.commands.push_back({ SceneCommandType::UnloadModel, modelId });
+}
 
-	for (const auto& framebuffer : m_SwapchainFramebuffers)
+void VulkanRenderer::UnloadTexture(int textureId)
+{
+	if (textureId == DEFAULT_TEXTURE_ID)
 	{
-		vkDestroyFramebuffer(m_MainDevice.logicalDevice, framebuffer, nullptr);
+		throw std::runtime_error("Default texture can't be unloaded");
 	}
 
-	vkDestroyPipeline(m_MainDevice.logicalDevice, m_GraphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(m_MainDevice.logicalDevice, m_PipelineLayout, nullptr);
-	vkDestroyRenderPass(m_MainDevice.logicalDevice, m_RenderPass, nullptr);
+	if (textureId < 0 || textureId >= static_cast<int>(m_TextureRefCounts.size()) || m_TextureRefCounts[textureId] == 0)
+	{
+		throw std::runtime_error("Texture with given ID isn't loaded");
+	}
 
-	for (const auto& image : m_SwapchainImages)
+	if (--m_TextureRefCounts[textureId] > 0)
 	{
-		vkDestroyImageView(m_MainDevice.logicalDevice, image.imageView, nullptr);
+		return;
 	}
 
-	vkDestroySwapchainKHR(m_MainDevice.logicalDevice, m_Swapchain, nullptr);
-	vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr); // allocator param not needed.
+	const VkImage image = m_TextureImages[textureId];
+	Allocation imageAllocation = m_TextureImageAllocations[textureId];
+	const VkImageView imageView = m_TextureImageViews[textureId];
 
-	if (CheckValidationEnabled())
+	m_TextureImages[textureId] = VK_NULL_HANDLE;
+	m_TextureImageAllocations[textureId] = Allocation{};
+	m_TextureImageViews[textureId] = VK_NULL_HANDLE;
+
+	// Array element keeps pointing at the destroyed view, no draw reads it and it is rewritten when the id is reused
+	m_DeletionQueue.Push(m_FrameCount, m_TextureUploadTokens[textureId], [this, textureId, image, imageAllocation, imageView]() mutable
 	{
-		DestroyDebugUtilsMessengerEXT(m_Instance, m_DebugMessenger, nullptr);
-	}
+		vkDestroyImageView(m_MainDevice.logicalDevice, imageView, nullptr);
+		vkDestroyImage(m_MainDevice.logicalDevice, image, nullptr);
+		m_Allocator.Free(imageAllocation);
 
-	// Order is important, instance should be last (I think)
-	vkDestroyDevice(m_MainDevice.logicalDevice, nullptr);
-	vkDestroyInstance(m_Instance, nullptr); // allocator param is custom de allocator func
+		// Nothing references the old texture anymore, id can be handed out again
+		m_FreeTextureSlots.push_back(textureId);
+	});
 }
 
+AllocatorStatistics VulkanRenderer::GetMemoryStatistics() const
+{
+	return m_Allocator.GetStatistics();
+}
 
-void VulkanRenderer::Draw()
+MemoryBudget VulkanRenderer::GetMemoryBudget() const
 {
+	return m_Allocator.GetBudget();
+}
 
-	// -- GET NEXT IMAGE --
+void VulkanRenderer::PrintMemoryBudget() const
+{
+	m_Allocator.PrintStatistics();
+	m_Allocator.PrintBudget();
+}
 
-	// Wait for fence until received signal
-	vkWaitForFences(m_MainDevice.logicalDevice, 1, &m_DrawFences[m_CurrentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+DrawListStatistics VulkanRenderer::GetDrawStatistics() const
+{
+	return m_DrawStatistics;
+}
 
-	// Undo signal
-	vkResetFences(m_MainDevice.logicalDevice, 1, &m_DrawFences[m_CurrentFrame]);
+void VulkanRenderer::SetCullingMode(CullingMode cullingMode)
+{
+	m_CullingMode = cullingMode;
+	InvalidateCommands();
+}
 
-	// Get index of next image to be drawn to, and signal semaphore when ready to be drawn to
-	uint32_t imageIndex{};
-	VkResult result = vkAcquireNextImageKHR(m_MainDevice.logicalDevice, m_Swapchain, std::numeric_limits<uint64_t>::max(), m_ImagesAvailable[m_CurrentFrame], VK_NULL_HANDLE, &imageIndex);
-	if (result != VK_SUCCESS)
+CullingMode VulkanRenderer::GetCullingMode() const
+{
+	if ((m_CullingMode == CullingMode::Gpu || m_CullingMode == CullingMode::GpuOcclusion) && !m_GpuCulling.IsInitialized())
 	{
-		throw std::runtime_error("Failed to acquire next image");
+		return CullingMode::Cpu;
 	}
 
-	RecordCommands(imageIndex);
-	UpdateUniformBuffers(imageIndex);
+	return m_CullingMode;
+}
 
-	// -- SUBMIT COMMAND BUFFER TO RENDER
-	// Queue submission information
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;											// Number of semaphores to wait on
-	submitInfo.pWaitSemaphores = &m_ImagesAvailable[m_CurrentFrame];			// List of semaphores to wait on
+CullingStatistics VulkanRenderer::GetCullingStatistics() const
+{
+	return m_CullingStatistics;
+}
 
-	const VkPipelineStageFlags waitStages[] = {									// Stages to check semaphores on
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-	};
+void VulkanRenderer::SetCommandReuse(bool enabled)
+{
+	m_CommandReuseEnabled = enabled;
 
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;											// number of cmd buffers to submit
-	submitInfo.pCommandBuffers = &m_CommandBuffers[imageIndex];					// Cmd buffer to submit
-	submitInfo.signalSemaphoreCount = 1;										// Semaphores to signal before end
-	submitInfo.pSignalSemaphores = &m_RendersFinished[m_CurrentFrame];			// Semaphores to signal when cmd buffer finishes.
+	// Buffers weren't kept up to date while reuse was off
+	InvalidateCommands();
+}
 
-	// Submit cmd buffer to queue and signal fence so code can continue (fence is initially closed)
-	result = vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, m_DrawFences[m_CurrentFrame]);
-	if (result != VK_SUCCESS)
+bool VulkanRenderer::IsCommandReuseEnabled() const
+{
+	return m_CommandReuseEnabled;
+}
+
+CommandReuseStatistics VulkanRenderer::GetCommandReuseStatistics() const
+{
+	return m_CommandReuseStatistics;
+}
+
+void VulkanRenderer::RequestSwapchainRecreation()
+{
+	if (!m_SwapchainRequestPending)
 	{
-		throw std::runtime_error("Failed to submit command to queue");
+		m_SwapchainRequestPending = true;
+		m_PendingSnapshot.swapchainRequestTime = std::chrono::high_resolution_clock::now();
 	}
+	m_PendingSnapshot.swapchainRequestCount++;
+}
 
-	// -- PRESENT RENDERED IMAGE TO SCREEN --
-	VkPresentInfoKHR presentInfo{};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;											// Number of semaphores to wait on
-	presentInfo.pWaitSemaphores = &m_RendersFinished[m_CurrentFrame];			// Semaphores to wait on
-	presentInfo.swapchainCount = 1;												// Number of swapchains to present to
-	presentInfo.pSwapchains = &m_Swapchain;										// Swapchains to present images to
-	presentInfo.pImageIndices = &imageIndex;									// index of images in swapchains to present
-
-	// Present image
-	result = vkQueuePresentKHR(m_PresentationQueue, &presentInfo);
-	if (result != VK_SUCCESS)
+void VulkanRenderer::MarkSwapchainOutOfDate(std::chrono::high_resolution_clock::time_point requestTime)
+{
+	// Latency counts from the first notice, further resizes before the recreation don't restart it
+	if (!m_SwapchainOutOfDate)
 	{
-		throw std::runtime_error("Failed to present info to surface");
+		m_SwapchainOutOfDate = true;
+		m_ResizeRequestTime = requestTime;
 	}
+}
 
-	
+SwapchainStatistics VulkanRenderer::GetSwapchainStatistics() const
+{
+	return m_SwapchainStatistics;
+}
 
-	// Used to make semi unique semaphores, otherwise semaphore will be used for multiple frames and trigger irregularly
-	m_CurrentFrame = (m_CurrentFrame + 1) % MAX_FRAME_DRAWS;
+void VulkanRenderer::SetPresentMode(PresentMode presentMode)
+{
+	m_PresentMode = presentMode;
+
+	// Present mode is fixed per swapchain
+	if (m_Swapchain != VK_NULL_HANDLE)
+	{
+		MarkSwapchainOutOfDate(std::chrono::high_resolution_clock::now());
+	}
 }
 
-void VulkanRenderer::CreateInstance()
+PresentMode VulkanRenderer::GetPresentMode() const
 {
-	// Application information
-	// Most stuff here is for developers only
-	VkApplicationInfo applicationInfo{};
-	applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-	applicationInfo.pApplicationName = "Vulkan app";				// Custom name for application
-	applicationInfo.applicationVersion = VK_MAKE_VERSION(1,0,0);	// Custom version of application
-	applicationInfo.pEngineName = "No Engine";						// Custom engine name
-	applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);		// Custom engine version
-	applicationInfo.apiVersion = VK_API_VERSION_1_3;				// Vulkan API version (affects application)
+	return m_ActivePresentMode;
+}
 
-	// Creation information for VkInstance
-	VkInstanceCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	createInfo.pApplicationInfo = &applicationInfo;					// Reference to application info above
+void VulkanRenderer::WaitForRenderedFrames()
+{
+	// m_FrameCount is the value the last submit signals
+	m_GraphicsTimeline.Wait(m_FrameCount);
+	MeasureLatency();
+}
 
-	const auto instanceExtensions = GetRequiredExtensions();
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
-	createInfo.ppEnabledExtensionNames = instanceExtensions.data();
+LatencyStatistics VulkanRenderer::GetLatencyStatistics() const
+{
+	return m_LatencyStatistics;
+}
 
-	VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-	if (CheckValidationEnabled())
+void VulkanRenderer::WaitForAppliedSnapshot()
+{
+	uint64_t appliedSequence = m_AppliedSnapshotSequence.load(std::memory_order_acquire);
+	while (appliedSequence < m_PendingSnapshot.sequence)
 	{
-		createInfo.enabledLayerCount = static_cast<uint32_t>(m_ValidationLayers.size());
-		createInfo.ppEnabledLayerNames = m_ValidationLayers.data();
-
-		PopulateDebugMessengerCreateInfo(debugCreateInfo);
-		createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*) &debugCreateInfo;
+		m_AppliedSnapshotSequence.wait(appliedSequence, std::memory_order_acquire);
+		appliedSequence = m_AppliedSnapshotSequence.load(std::memory_order_acquire);
 	}
+}
 
-	// Create instance
-	const VkResult result = vkCreateInstance(&createInfo, nullptr, &m_Instance);	// Allocator parameter is important! Look into it later
+void VulkanRenderer::PublishSnapshot()
+{
+	// At most one snapshot waits for Draw, the simulation doesn't run further ahead. This also means no snapshot is
+	// skipped, so the scene commands of each are applied exactly once
+	WaitForAppliedSnapshot();
 
-	if (result != VK_SUCCESS)
+	if (m_AppliedSnapshotSequence.load(std::memory_order_acquire) == RENDER_THREAD_FAILED)
 	{
-		throw std::runtime_error("Failed to create a Vulkan instance");
+		StopRenderThread();
 	}
-}
 
-void VulkanRenderer::CreateLogicalDevice()
-{
-	// Get the queue family indices for the chosen Physical device
-	QueueFamilyIndices indices = GetQueueFamilies(m_MainDevice.physicalDevice);
+	int width{};
+	int height{};
+	glfwGetFramebufferSize(m_pWindow->GetWindow(), &width, &height);
+	m_PendingSnapshot.framebufferExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+	m_PendingSnapshot.sequence++;
 
-	// Vector for queue create information
-	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
-	// At this point the queue indices are set and the std::set assures no duplicate indices will be given
-	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily };
+	m_Snapshots.GetWriteBuffer() = m_PendingSnapshot;
+	m_Snapshots.Publish();
+	m_SwapchainRequestPending = false;
+	m_PendingSnapshot.commands.clear();
+}
 
-	// Queues the logical device needs to create and info to do so (1 for now TODO: add more later)
-	for (const int queueFamilyIndex: queueFamilyIndices)
+void VulkanRenderer::StartRenderThread()
+{
+	if (m_RenderThread.joinable())
 	{
-		VkDeviceQueueCreateInfo queueCreateInfo{};
-		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queueCreateInfo.queueFamilyIndex = queueFamilyIndex;	// Index of the family to create a queue from
-		queueCreateInfo.queueCount = 1;
-		constexpr float priority = 1.0f;
-		queueCreateInfo.pQueuePriorities = &priority;				// Vulkan needs to know how to handle multiple queues so it needs a priority (0 lowest 1 highest)
-
-		queueCreateInfos.push_back(queueCreateInfo);
+		throw std::runtime_error("Render thread already running");
 	}
-	
 
-	// Information to create logical device (called device)
-	VkDeviceCreateInfo deviceCreateInfo{};
-	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();														// List of queue create info so device can create required queues
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(g_DeviceExtensions.size());							// Number of enabled logical device extensions
-	deviceCreateInfo.ppEnabledExtensionNames = g_DeviceExtensions.data();												// List of enabled logical device extensions
+	m_StopRenderThread.store(false, std::memory_order_release);
+	m_RenderThread = std::thread(&VulkanRenderer::RenderThreadMain, this);
+}
 
-	// Physical device features that the logical device will be using
-	VkPhysicalDeviceFeatures deviceFeatures = {};
-	deviceFeatures.samplerAnisotropy = VK_TRUE;					// Enable anisotropy
+void VulkanRenderer::StopRenderThread()
+{
+	if (!m_RenderThread.joinable())
+	{
+		return;
+	}
 
-	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;		// Physical device features for logical device
+	// The last published snapshot is applied first, the wake up below would replace it and its commands would be lost
+	WaitForAppliedSnapshot();
 
-	// Create logical device for the given physical device
-	const VkResult result = vkCreateDevice(m_MainDevice.physicalDevice, &deviceCreateInfo, nullptr, &m_MainDevice.logicalDevice);
+	// Publishing wakes the thread up if it waits for a snapshot. A Draw already running finishes (and may draw this
+	// snapshot), the thread stops before the next one. Commands stay pending for the next PublishSnapshot
+	m_StopRenderThread.store(true, std::memory_order_release);
+	SceneSnapshot& wakeSnapshot = m_Snapshots.GetWriteBuffer();
+	wakeSnapshot = m_PendingSnapshot;
+	wakeSnapshot.commands.clear();
+	m_Snapshots.Publish();
+	m_RenderThread.join();
 
-	if (result != VK_SUCCESS)
+	if (m_RenderThreadException)
 	{
-		throw std::runtime_error("Error creating logical device");
+		std::rethrow_exception(std::exchange(m_RenderThreadException, nullptr));
 	}
-
-	// Queues are created at the same time as the device
-	// So we want to handle the queues
-	// Fetch queue memory index from created logical device
-	vkGetDeviceQueue(m_MainDevice.logicalDevice, indices.graphicsFamily, 0, &m_GraphicsQueue);
-	vkGetDeviceQueue(m_MainDevice.logicalDevice, indices.presentationFamily, 0, &m_PresentationQueue);
 }
 
-void VulkanRenderer::CreateSurface()
+const FrameStatistics& VulkanRenderer::GetFrameStatistics(bool* pIsNew)
 {
-	// Create surface (This creates a surface struct set up depending on your system)
-	const VkResult result = glfwCreateWindowSurface(m_Instance, m_pWindow->GetWindow(), nullptr, &m_Surface);
-	if (result != VK_SUCCESS)
+	const bool isNew = m_FrameStatistics.Acquire();
+	if (pIsNew != nullptr)
 	{
-		throw std::runtime_error("Error creating window surface");
+		*pIsNew = isNew;
 	}
+	return m_FrameStatistics.GetReadBuffer();
 }
 
-void VulkanRenderer::CreateDebugMessenger()
+void VulkanRenderer::RequestMemoryReport()
 {
-	if (!CheckValidationEnabled())
-		return;
+	m_PendingSnapshot.memoryReportCount++;
+}
 
-	VkDebugUtilsMessengerCreateInfoEXT createInfo{};
-	PopulateDebugMessengerCreateInfo(createInfo);
+void VulkanRenderer::RenderThreadMain()
+{
+	try
+	{
+		while (true)
+		{
+			m_Snapshots.WaitForPublish();
+			if (m_StopRenderThread.load(std::memory_order_acquire))
+			{
+				break;
+			}
 
-	if (CreateDebugUtilsMessengerEXT(m_Instance, &createInfo, nullptr, &m_DebugMessenger) != VK_SUCCESS) {
-		throw std::runtime_error("failed to set up debug messenger!");
+			Draw();
+		}
+	}
+	catch (...)
+	{
+		// PublishSnapshot stops waiting for this thread, joins it and rethrows
+		m_RenderThreadException = std::current_exception();
+		m_AppliedSnapshotSequence.store(RENDER_THREAD_FAILED, std::memory_order_release);
+		m_AppliedSnapshotSequence.notify_all();
 	}
 }
 
-void VulkanRenderer::CreateSwapchain()
+void VulkanRenderer::ApplySnapshot()
 {
-	// Get swapchain details so we can pick best settings.
-	const SwapchainDetails swapChainDetails = GetSwapChainDetails(m_MainDevice.physicalDevice);
+	// Newest wins, skipped snapshots are never drawn. Without a new one the frame is drawn from the last one again
+	if (!m_Snapshots.Acquire())
+	{
+		return;
+	}
 
-	// Choose best surface format
-	const VkSurfaceFormatKHR format = ChooseBestSurfaceFormat(swapChainDetails.formats);
+	const SceneSnapshot& snapshot = m_Snapshots.GetReadBuffer();
+	m_UboViewProjection.view = snapshot.view;
+	m_InputTime = snapshot.inputTime;
+	m_FramebufferExtent = snapshot.framebufferExtent;
 
-	// Choose best presentation mode
-	const VkPresentModeKHR presentMode = ChooseBestPresentationMode(swapChainDetails.presentationModes);
+	// Before the transforms, an unload clears its model's transform in the same snapshot
+	for (const SceneCommand& command : snapshot.commands)
+	{
+		ApplySceneCommand(command);
+	}
 
-	// Choose swapchain image resolutions
-	const VkExtent2D extent = ChooseSwapExtent(swapChainDetails.capabilities);
+	for (size_t i{}; i < snapshot.modelTransforms.size() && i < m_ModelList.size(); ++i)
+	{
+		if (snapshot.modelTransforms[i])
+		{
+			m_ModelList[i].SetModel(*snapshot.modelTransforms[i]);
+		}
+	}
 
-	// How many images are in swapchain => get 1 more than min to allow triple buffering
-	uint32_t imageCount = swapChainDetails.capabilities.minImageCount + 1;
+	if (snapshot.swapchainRequestCount != m_AppliedSwapchainRequestCount)
+	{
+		m_AppliedSwapchainRequestCount = snapshot.swapchainRequestCount;
+		MarkSwapchainOutOfDate(snapshot.swapchainRequestTime);
+	}
 
-	// Clamp values, if maxImageCount is negative then we have infinite images, so no need to clamp
-	if (swapChainDetails.capabilities.maxImageCount > 0 && swapChainDetails.capabilities.maxImageCount < imageCount)
+	if (snapshot.memoryReportCount != m_AppliedMemoryReportCount)
 	{
-		imageCount = swapChainDetails.capabilities.maxImageCount;
+		m_AppliedMemoryReportCount = snapshot.memoryReportCount;
+		PrintMemoryBudget();
 	}
 
-	// Create swapchain
-	VkSwapchainCreateInfoKHR swapchainCreateInfo{};
-	swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-	swapchainCreateInfo.presentMode = presentMode;										// Swapchain present mode
-	swapchainCreateInfo.imageExtent = extent;											// Swapchain image size
-	swapchainCreateInfo.imageColorSpace = format.colorSpace;							// Swapchain color space
-	swapchainCreateInfo.imageFormat = format.format;									// Swapchain format
-	swapchainCreateInfo.minImageCount = imageCount;										// Swapchain image count (buffering)
-	swapchainCreateInfo.imageArrayLayers = 1;											// Number of layers for each image in chain
-	swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;				// What attachment images will be used as
-	swapchainCreateInfo.preTransform = swapChainDetails.capabilities.currentTransform;	// Transform to apply on swapchain images
-	swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;				// Draw as it normally is: don't blend! (Window overlap)
-	swapchainCreateInfo.clipped = VK_TRUE;												// Whether to clip part of image not in view (offscreen or behind other windows)
-	swapchainCreateInfo.surface = m_Surface;											// Surface to build swapchain on
+	// Lets the simulation publish the next one
+	m_AppliedSnapshotSequence.store(snapshot.sequence, std::memory_order_release);
+	m_AppliedSnapshotSequence.notify_one();
+}
 
-	// Get queue family indices
-	const QueueFamilyIndices familyIndices = GetQueueFamilies(m_MainDevice.physicalDevice);
+void VulkanRenderer::ApplySceneCommand(const SceneCommand& command)
+{
+	MeshModel& model = m_ModelList[command.modelId];
+	switch (command.type)
+	{
+	case SceneCommandType::AddInstance:
+		model.AddInstance(command.instanceId, command.transform);
+		break;
+	case SceneCommandType::UpdateInstance:
+		model.SetInstanceTransform(command.instanceId, command.transform);
+		break;
+	case SceneCommandType::RemoveInstance:
+		model.RemoveInstance(command.instanceId);
+		break;
+	case SceneCommandType::UnloadModel:
+	{
+		// Frames in flight may still draw the model, give its geometry back once they completed
+		m_DeletionQueue.Push(m_FrameCount, model.GetUploadToken(), [unloadedModel = model]() mutable
+		{
+			unloadedModel.DestroyMeshModel();
+		});
 
-	// If graphics and presentation families are different then swapchain must let images be shared between families
-	if (familyIndices.graphicsFamily != familyIndices.presentationFamily)
-	{
-		// Queues to share between
-		const uint32_t queueFamilyIndices[] = {
-			(uint32_t) familyIndices.graphicsFamily,
-			(uint32_t) familyIndices.presentationFamily
-		};
+		for (const int textureId : model.GetTextureIds())
+		{
+			UnloadTexture(textureId);
+		}
 
-		swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;	// Image share handling
-		swapchainCreateInfo.queueFamilyIndexCount = 2;						// Number of queues to share images between
-		swapchainCreateInfo.pQueueFamilyIndices = queueFamilyIndices;		// Array of queues to share between
+		// Empty model isn't drawn, slot is reused by the next loaded model
+		model = MeshModel{};
+		m_FreeModelSlots.push_back(command.modelId);
+
+		InvalidateCommands();
+		break;
 	}
-	else
+	}
+}
+
+VulkanRenderer::ModelInstanceIds& VulkanRenderer::GetModelInstanceIds(int modelId)
+{
+	if (modelId < 0 || modelId >= static_cast<int>(m_ModelInstanceIds.size()) || !m_ModelInstanceIds[modelId].isLoaded)
 	{
-		swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;	// Image share handling
-		swapchainCreateInfo.queueFamilyIndexCount = 0;						// Number of queues to share images between
-		swapchainCreateInfo.pQueueFamilyIndices = nullptr;					// Array of queues to share between
+		throw std::runtime_error("Model with given ID isn't loaded");
 	}
 
-	// If you want to create a new swapchain you can pass on responsibilities (resize should destroy swapchain)
-	swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	return m_ModelInstanceIds[modelId];
+}
 
-	// Create chain
-	const VkResult result = vkCreateSwapchainKHR(m_MainDevice.logicalDevice, &swapchainCreateInfo, nullptr, &m_Swapchain);
+void VulkanRenderer::PublishFrameStatistics()
+{
+	FrameStatistics& statistics = m_FrameStatistics.GetWriteBuffer();
+	statistics.draw = GetDrawStatistics();
+	statistics.culling = GetCullingStatistics();
+	statistics.commandReuse = GetCommandReuseStatistics();
+	statistics.swapchain = GetSwapchainStatistics();
+	statistics.latency = GetLatencyStatistics();
+	m_FrameStatistics.Publish();
+}
 
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create swapchain");
-	}
+void VulkanRenderer::MeasureLatency()
+{
+	// The GPU finished (and the display showed) these frames no later than now, so the newest one gives the closest measurement.
+	// Only polled when a frame slot is reused, a measurement can be late by up to a frame
+	const auto now = std::chrono::high_resolution_clock::now();
+	const uint64_t completedValue = m_GraphicsTimeline.GetCompletedValue();
 
-	// Store for later reference
-	m_SwapchainImageFormat = format.format;
-	m_SwapchainExtent = extent;
+	uint64_t newestValue{};
+	for (FrameContext& frame : m_Frames)
+	{
+		if (!frame.latencyPending || frame.submitValue > completedValue)
+		{
+			continue;
+		}
 
-	// Get amount of images first
-	uint32_t swapchainImageCount{};
-	vkGetSwapchainImagesKHR(m_MainDevice.logicalDevice, m_Swapchain, &swapchainImageCount, nullptr);
+		frame.latencyPending = false;
+		if (frame.submitValue > newestValue)
+		{
+			newestValue = frame.submitValue;
+			m_LatencyStatistics.inputToRenderedMilliseconds = std::chrono::duration<double, std::milli>(now - frame.inputTime).count();
+		}
+	}
 
-	std::vector<VkImage> images(swapchainImageCount);
-	vkGetSwapchainImagesKHR(m_MainDevice.logicalDevice, m_Swapchain, &swapchainImageCount, images.data());
+	if (!m_PresentWaitEnabled)
+	{
+		return;
+	}
 
-	for (const VkImage image: images)
+	uint64_t newestPresentId{};
+	for (FrameContext& frame : m_Frames)
 	{
-		// VkImages is a identifier
-		SwapchainImage swapchainImage{};
-		swapchainImage.image = image;
-		swapchainImage.imageView = CreateImageView(image, format.format, VK_IMAGE_ASPECT_COLOR_BIT);
+		if (!frame.presentPending)
+		{
+			continue;
+		}
 
-		m_SwapchainImages.push_back(swapchainImage);
+		// Zero timeout only polls, times out while the image isn't on screen yet
+		const VkResult result = m_pfnWaitForPresent(m_MainDevice.logicalDevice, m_Swapchain, frame.submitValue, 0);
+		if (result == VK_TIMEOUT)
+		{
+			continue;
+		}
+
+		// Presented, or the swapchain can't tell anymore (out of date)
+		frame.presentPending = false;
+		if (result == VK_SUCCESS && frame.submitValue > newestPresentId)
+		{
+			newestPresentId = frame.submitValue;
+			m_LatencyStatistics.inputToPresentedMilliseconds = std::chrono::duration<double, std::milli>(now - frame.inputTime).count();
+			m_LatencyStatistics.presentedFrameCount++;
+		}
 	}
 }
 
-void VulkanRenderer::CreateRenderPass()
+void VulkanRenderer::Cleanup()
 {
-	/************************************************************************/
-	/* ATTACHMENTS															*/
-	/************************************************************************/
-	// Color attachment of render pass
-	VkAttachmentDescription colorAttachment{};
-	colorAttachment.format = m_SwapchainImageFormat;					// Format to use for attachment
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;					// Number of samples for multi-sampling
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;				// Describes to do with attachment before rendering.
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;				// Describes to do with attachment after rendering.
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;    // Describes to do with stencil before rendering.
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // Describes to do with stencil after rendering.
+	StopRenderThread();
 
-	// Frame buffer data will be stored as an image, but images can be given different data layouts
-	// to give optimal use for certain operations
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;			// The image data layout before render pass starts.
-	// So the data will start with any layout, then the sub passes will
-	// transform to their optimal layout and when the render pass finally
-	// ends it will be put in the final layout.
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;		// The image data layout after render (to change to)
+	// Wait until no actions being run on device before destroy
+	vkDeviceWaitIdle(m_MainDevice.logicalDevice);
 
-	// Depth attachment of render pass
-	VkAttachmentDescription depthAttachment{};
-	depthAttachment.format = m_DepthFormat;
-	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	// Nothing is in flight anymore, destroy unloaded resources right away
+	m_DeletionQueue.Flush();
 
-	/************************************************************************/
-	/* REFERENCES                                                           */
-	/************************************************************************/
-	// Attachment reference uses an attachment index that refers to index in the attachment list passed to renderPassCreateInfo
-	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;										// index of it, in this case we only have 1 so we pick index 0
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;	// Layout for data in sub pass.
+	for (size_t i{}; i < m_ModelList.size(); ++i)
+	{
+		m_ModelList[i].DestroyMeshModel();
+	}
 
-	// Depth attachment reference
-	VkAttachmentReference depthAttachmentRef{};
-	depthAttachmentRef.attachment = 1;
-	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	vkDestroyDescriptorPool(m_MainDevice.logicalDevice, m_TextureDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_MainDevice.logicalDevice, m_TextureSetLayout, nullptr);
 
-	// Information about specific sub pass the render pass is using
-	VkSubpassDescription subpass{};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;		// Pipeline type sub pass is to be bound to.
-	subpass.colorAttachmentCount = 1;
-	subpass.pDepthStencilAttachment = &depthAttachmentRef;
-	subpass.pColorAttachments = &colorAttachmentRef;
+	vkDestroySampler(m_MainDevice.logicalDevice, m_TextureSampler, nullptr);
 
-	// Need to determine when layout transitions occur using sub pass dependencies
-	std::array<VkSubpassDependency, 2> subpassDependencies{};
+	for (size_t i{}; i < m_TextureImages.size(); ++i)
+	{
+		vkDestroyImage(m_MainDevice.logicalDevice, m_TextureImages[i], nullptr);
+		m_Allocator.Free(m_TextureImageAllocations[i]);
+		vkDestroyImageView(m_MainDevice.logicalDevice, m_TextureImageViews[i], nullptr);
+	}
 
-	// -- Conversion from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL --
-	// When the bottom of the external subpass attempts to read the memory we start converting from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-	// But make sure before first subpass kicks in and if the VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT starts to either write or read.
-	// List of what stage triggers what bit => https://registry.khronos.org/vulkan/specs/1.3-extensions/man/html/VkAccessFlagBits.html
+	vkDestroyImageView(m_MainDevice.logicalDevice, m_DepthBufferImageView, nullptr);
+	vkDestroyImage(m_MainDevice.logicalDevice, m_DepthBufferImage, nullptr);
+	m_Allocator.Free(m_DepthBufferImageAllocation);
 
-	// Transition must happen after these conditions...
-	subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;								// Subpass index (external = special value outside of render pass)
-	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;				// Pipeline stage
-	subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;						// Stage access mask (memory access)
+	vkDestroyDescriptorPool(m_MainDevice.logicalDevice, m_DescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_MainDevice.logicalDevice, m_DescriptorSetLayout, nullptr);
+	m_UniformRing.Destroy();
+	m_InstanceRing.Destroy();
+	m_TransformRing.Destroy();
+	m_DrawDataRing.Destroy();
+	m_IndirectRing.Destroy();
+	if (m_GpuCulling.IsInitialized())
+	{
+		m_GpuCulling.Destroy();
+	}
+	if (m_DepthPyramid.IsInitialized())
+	{
+		m_DepthPyramid.Destroy();
+	}
 
-	// Transition must happen before these conditions...
-	subpassDependencies[0].dstSubpass = 0; // index of subpass (only have 1 so index 0)	
-	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	subpassDependencies[0].dependencyFlags = 0;
+	for (auto& mesh : m_MeshList)
+	{
+		mesh.DestroyBuffers();
+	}
 
-	// -- Conversion from VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR --
-	// Transition must happen after these conditions...
-	subpassDependencies[1].srcSubpass = 0;
-	subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	m_RecordingWorkers.Destroy();
+	for (const auto& frame : m_Frames)
+	{
+		vkDestroySemaphore(m_MainDevice.logicalDevice, frame.renderFinished, nullptr);
+		vkDestroySemaphore(m_MainDevice.logicalDevice, frame.imageAvailable, nullptr);
 
-	// Transition must happen before these conditions...
-	subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	subpassDependencies[1].dependencyFlags = 0;
+		vkDestroyCommandPool(m_MainDevice.logicalDevice, frame.commandPool, nullptr);
+		for (const VkCommandPool commandPool : frame.recordingCommandPools)
+		{
+			vkDestroyCommandPool(m_MainDevice.logicalDevice, commandPool, nullptr);
+		}
+		for (const VkCommandPool commandPool : frame.reusableCommandPools)
+		{
+			vkDestroyCommandPool(m_MainDevice.logicalDevice, commandPool, nullptr);
+		}
+	}
+	m_GraphicsTimeline.Destroy();
 
-	std::array<VkAttachmentDescription, 2> renderpassAttachments{ colorAttachment, depthAttachment };
+	vkDestroyCommandPool(m_MainDevice.logicalDevice, m_GraphicsCommandPool, nullptr);
+	m_TransferContext.Destroy();
+	for (auto& geometryBuffer : m_GeometryBuffers)
+	{
+		if (geometryBuffer.IsInitialized())
+		{
+			geometryBuffer.Destroy();
+		}
+	}
 
-	// Create info for render pass
-	VkRenderPassCreateInfo renderPassCreateInfo{};
-	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(renderpassAttachments.size());
-	renderPassCreateInfo.pAttachments = renderpassAttachments.data();
-	renderPassCreateInfo.subpassCount = 1;
-	renderPassCreateInfo.pSubpasses = &subpass;
-	renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
-	renderPassCreateInfo.pDependencies = subpassDependencies.data();
+	for (const auto& framebuffer : m_SwapchainFramebuffers)
+	{
+		vkDestroyFramebuffer(m_MainDevice.logicalDevice, framebuffer, nullptr);
+	}
 
-	const VkResult result = vkCreateRenderPass(m_MainDevice.logicalDevice, &renderPassCreateInfo, nullptr, &m_RenderPass);
-	if (result != VK_SUCCESS)
+	for (const auto& pipeline : m_GraphicsPipelines)
 	{
-		throw std::runtime_error("Failed to create render pass. HAVE FUN DEBUGGING THIS IF IT FAILED LOL");
+		vkDestroyPipeline(m_MainDevice.logicalDevice, pipeline, nullptr);
+	}
+	vkDestroyPipelineLayout(m_MainDevice.logicalDevice, m_PipelineLayout, nullptr);
+	vkDestroyRenderPass(m_MainDevice.logicalDevice, m_RenderPass, nullptr);
+	for (const auto& renderPass : m_OcclusionRenderPasses)
+	{
+		vkDestroyRenderPass(m_MainDevice.logicalDevice, renderPass, nullptr);
+	}
+
+	for (const auto& image : m_SwapchainImages)
+	{
+		vkDestroyImageView(m_MainDevice.logicalDevice, image.imageView, nullptr);
+	}
+
+	vkDestroySwapchainKHR(m_MainDevice.logicalDevice, m_Swapchain, nullptr);
+	vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr); // allocator param not needed.
+
+	if (CheckValidationEnabled())
+	{
+		DestroyDebugUtilsMessengerEXT(m_Instance, m_DebugMessenger, nullptr);
 	}
+
+	// All memory has been returned by now, release the blocks
+	m_Allocator.Destroy();
+
+	// Order is important, instance should be last (I think)
+	vkDestroyDevice(m_MainDevice.logicalDevice, nullptr);
+	vkDestroyInstance(m_Instance, nullptr); // allocator param is custom de allocator func
 }
 
-void VulkanRenderer::CreateDescriptorSetLayout()
+
+void VulkanRenderer::Draw()
 {
-	// UNIFORM VALUES DESCRIPTOR SET LAYOUT
-	// MVP binding info
-	VkDescriptorSetLayoutBinding vpLayoutBinding{};
-	vpLayoutBinding.binding = 0;											// Where to bind in shader (layout(binding = 0))
-	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;		// Type of descriptor (uniform, dynamic uniform, image sampler etc...)
-	vpLayoutBinding.descriptorCount = 1;									// Number of descriptors for binding
-	vpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;				// Shader stage to bind to
-	vpLayoutBinding.pImmutableSamplers = nullptr;							// For textures: can make sampler immutable
+	// Camera, transforms and requests of the simulation
+	ApplySnapshot();
 
-	//VkDescriptorSetLayoutBinding modelLayoutBinding{};
-	//modelLayoutBinding.binding = 1;
-	//modelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	//modelLayoutBinding.descriptorCount = 1;
-	//modelLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	//modelLayoutBinding.pImmutableSamplers = nullptr;
+	// -- RECREATE SWAPCHAIN --
+	if (m_SwapchainOutOfDate && !RecreateSwapchain())
+	{
+		// Minimized, nothing to draw to until the window has an area again
+		return;
+	}
 
-	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = {
-		vpLayoutBinding, /*modelLayoutBinding*/
-	};
+	// -- GET NEXT IMAGE --
 
-	// Create descriptor set layout with given bindings.
-	VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
-	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());				// Number of binding info's
-	layoutCreateInfo.pBindings = layoutBindings.data();											// Bindings
+	FrameContext& frame = m_Frames[m_CurrentFrame];
 
-	VkResult result = vkCreateDescriptorSetLayout(m_MainDevice.logicalDevice, &layoutCreateInfo, nullptr, &m_DescriptorSetLayout);
+	// Wait until the frame's last submit finished, only this slot's frame, later ones keep running
+	m_GraphicsTimeline.Wait(frame.submitValue);
+	MeasureLatency();
+
+	// Command buffers of the frame are done, reset all of them at once through their pools
+	vkResetCommandPool(m_MainDevice.logicalDevice, frame.commandPool, 0);
+	for (const VkCommandPool commandPool : frame.recordingCommandPools)
+	{
+		vkResetCommandPool(m_MainDevice.logicalDevice, commandPool, 0);
+	}
+
+	// Timeline value is the number of finished frames, which may be more than the ones just waited on
+	m_DeletionQueue.Retire(m_GraphicsTimeline.GetCompletedValue(), m_FrameCount + 1, &m_TransferContext);
+
+	// Get index of next image to be drawn to, and signal semaphore when ready to be drawn to
+	uint32_t imageIndex{};
+	VkResult result = vkAcquireNextImageKHR(m_MainDevice.logicalDevice, m_Swapchain, std::numeric_limits<uint64_t>::max(), frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		// Nothing was acquired and the semaphore stays unsignalled, the frame is drawn with the new swapchain instead
+		MarkSwapchainOutOfDate(std::chrono::high_resolution_clock::now());
+		return;
+	}
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	{
+		throw std::runtime_error("Failed to acquire next image");
+	}
+
+	// Suboptimal images still present fine, the swapchain is replaced after this frame
+	if (result == VK_SUBOPTIMAL_KHR)
+	{
+		MarkSwapchainOutOfDate(std::chrono::high_resolution_clock::now());
+	}
+
+	// With more frames in flight than swapchain images (or images handed out of order) another frame may still be
+	// rendering to this image, don't record further ahead than that frame
+	m_GraphicsTimeline.Wait(m_SwapchainImageValues[imageIndex]);
+
+	// Frame's submit finished, so its slice of the uniform ring is free again
+	m_UniformRing.BeginFrame(m_CurrentFrame);
+	m_InstanceRing.BeginFrame(m_CurrentFrame);
+	m_TransformRing.BeginFrame(m_CurrentFrame);
+	m_DrawDataRing.BeginFrame(m_CurrentFrame);
+	m_IndirectRing.BeginFrame(m_CurrentFrame);
+	UpdateUniformBuffers();
+
+	std::array<VkCommandBuffer, 2> commandBuffers{};
+	const uint32_t commandBufferCount = RecordCommands(imageIndex, &commandBuffers);
+
+	// -- SUBMIT COMMAND BUFFER TO RENDER
+	// Queue submission information
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = 1;											// Number of semaphores to wait on
+	submitInfo.pWaitSemaphores = &frame.imageAvailable;						// List of semaphores to wait on
+
+	const VkPipelineStageFlags waitStages[] = {									// Stages to check semaphores on
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+	};
+
+	submitInfo.pWaitDstStageMask = waitStages;
+	submitInfo.commandBufferCount = commandBufferCount;							// number of cmd buffers to submit
+	submitInfo.pCommandBuffers = commandBuffers.data();							// Cmd buffers to submit, executed in order
+
+	// Presentation waits on the binary semaphore, everything on the CPU side on the timeline value
+	const uint64_t submitValue = m_GraphicsTimeline.AdvanceSubmitValue();
+	const std::array<VkSemaphore, 2> signalSemaphores{ frame.renderFinished, m_GraphicsTimeline.GetSemaphore() };
+	const std::array<uint64_t, 2> signalValues{ 0, submitValue };				// Binary semaphores ignore their value
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());	// Semaphores to signal before end
+	submitInfo.pSignalSemaphores = signalSemaphores.data();					// Semaphores to signal when cmd buffer finishes.
+
+	// Submit cmd buffer to queue, no fence, the timeline tells when it finished
+	result = vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit command to queue");
+	}
+
+	frame.submitValue = submitValue;
+	frame.inputTime = m_InputTime;
+	frame.latencyPending = true;
+	m_SwapchainImageValues[imageIndex] = submitValue;
+	m_FrameCount++;
+
+	// -- PRESENT RENDERED IMAGE TO SCREEN --
+	VkPresentInfoKHR presentInfo{};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;											// Number of semaphores to wait on
+	presentInfo.pWaitSemaphores = &frame.renderFinished;						// Semaphores to wait on
+	presentInfo.swapchainCount = 1;												// Number of swapchains to present to
+	presentInfo.pSwapchains = &m_Swapchain;										// Swapchains to present images to
+	presentInfo.pImageIndices = &imageIndex;									// index of images in swapchains to present
+
+	// Submit values increase with every frame, so they are valid present ids for vkWaitForPresentKHR
+	VkPresentIdKHR presentId{};
+	presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+	presentId.swapchainCount = 1;
+	presentId.pPresentIds = &submitValue;
+	if (m_PresentWaitEnabled)
+	{
+		presentInfo.pNext = &presentId;
+	}
+
+	// Present image
+	result = vkQueuePresentKHR(m_PresentationQueue, &presentInfo);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+	{
+		MarkSwapchainOutOfDate(std::chrono::high_resolution_clock::now());
+	}
+	else if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to present info to surface");
+	}
+
+	frame.presentPending = m_PresentWaitEnabled && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR);
+	m_LatencyStatistics.inputToPresentSubmitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_InputTime).count();
+
+	if (m_ResizeLatencyPending)
+	{
+		m_ResizeLatencyPending = false;
+		m_SwapchainStatistics.lastResizeLatencyMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_ResizeRequestTime).count();
+	}
+
+	// Used to make semi unique semaphores, otherwise semaphore will be used for multiple frames and trigger irregularly
+	m_CurrentFrame = (m_CurrentFrame + 1) % m_FramesInFlight;
+
+	PublishFrameStatistics();
+}
+
+void VulkanRenderer::CreateInstance()
+{
+	// Application information
+	// Most stuff here is for developers only
+	VkApplicationInfo applicationInfo{};
+	applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	applicationInfo.pApplicationName = "Vulkan app";				// Custom name for application
+	applicationInfo.applicationVersion = VK_MAKE_VERSION(1,0,0);	// Custom version of application
+	applicationInfo.pEngineName = "No Engine";						// Custom engine name
+	applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);		// Custom engine version
+	applicationInfo.apiVersion = VK_API_VERSION_1_3;				// Vulkan API version (affects application)
+
+	// Creation information for VkInstance
+	VkInstanceCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	createInfo.pApplicationInfo = &applicationInfo;					// Reference to application info above
+
+	const auto instanceExtensions = GetRequiredExtensions();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
+	createInfo.ppEnabledExtensionNames = instanceExtensions.data();
+
+	VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+	if (CheckValidationEnabled())
+	{
+		createInfo.enabledLayerCount = static_cast<uint32_t>(m_ValidationLayers.size());
+		createInfo.ppEnabledLayerNames = m_ValidationLayers.data();
+
+		PopulateDebugMessengerCreateInfo(debugCreateInfo);
+		createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*) &debugCreateInfo;
+	}
+
+	// Create instance
+	const VkResult result = vkCreateInstance(&createInfo, nullptr, &m_Instance);	// Allocator parameter is important! Look into it later
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create a Vulkan instance");
+	}
+}
+
+void VulkanRenderer::CreateLogicalDevice()
+{
+	// Get the queue family indices for the chosen Physical device
+	QueueFamilyIndices indices = GetQueueFamilies(m_MainDevice.physicalDevice);
+
+	// Vector for queue create information
+	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
+	// At this point the queue indices are set and the std::set assures no duplicate indices will be given
+	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily, indices.transferFamily };
+
+	// Queues the logical device needs to create and info to do so (1 for now TODO: add more later)
+	for (const int queueFamilyIndex: queueFamilyIndices)
+	{
+		VkDeviceQueueCreateInfo queueCreateInfo{};
+		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueCreateInfo.queueFamilyIndex = queueFamilyIndex;	// Index of the family to create a queue from
+		queueCreateInfo.queueCount = 1;
+		constexpr float priority = 1.0f;
+		queueCreateInfo.pQueuePriorities = &priority;				// Vulkan needs to know how to handle multiple queues so it needs a priority (0 lowest 1 highest)
+
+		queueCreateInfos.push_back(queueCreateInfo);
+	}
+	
+
+	// Information to create logical device (called device)
+	VkDeviceCreateInfo deviceCreateInfo{};
+	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();														// List of queue create info so device can create required queues
+
+	// Optional extensions are enabled when the device has them
+	std::vector<const char*> deviceExtensions = g_DeviceExtensions;
+	m_MemoryBudgetEnabled = CheckDeviceExtensionAvailable(m_MainDevice.physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (m_MemoryBudgetEnabled)
+	{
+		deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+
+	// Presents are timed once on screen when the device can wait for them, needs both extensions and their features
+	VkPhysicalDevicePresentWaitFeaturesKHR supportedPresentWaitFeatures{};
+	supportedPresentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+	VkPhysicalDevicePresentIdFeaturesKHR supportedPresentIdFeatures{};
+	supportedPresentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	supportedPresentIdFeatures.pNext = &supportedPresentWaitFeatures;
+
+	if (CheckDeviceExtensionAvailable(m_MainDevice.physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+		CheckDeviceExtensionAvailable(m_MainDevice.physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2 presentFeatures2{};
+		presentFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		presentFeatures2.pNext = &supportedPresentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(m_MainDevice.physicalDevice, &presentFeatures2);
+	}
+
+	m_PresentWaitEnabled = supportedPresentIdFeatures.presentId == VK_TRUE && supportedPresentWaitFeatures.presentWait == VK_TRUE;
+	if (m_PresentWaitEnabled)
+	{
+		deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+	}
+	m_LatencyStatistics.presentWaitEnabled = m_PresentWaitEnabled;
+
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());							// Number of enabled logical device extensions
+	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();													// List of enabled logical device extensions
+
+	// Multi draw indirect is optional, batches fall back to one indirect command per call
+	VkPhysicalDeviceFeatures supportedFeatures{};
+	vkGetPhysicalDeviceFeatures(m_MainDevice.physicalDevice, &supportedFeatures);
+	m_MultiDrawIndirectEnabled = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
+	// GPU culling needs indirect count draws and compute on the graphics queue
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+	supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 supportedFeatures2{};
+	supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures2.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(m_MainDevice.physicalDevice, &supportedFeatures2);
+
+	uint32_t queueFamilyCount{};
+	vkGetPhysicalDeviceQueueFamilyProperties(m_MainDevice.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_MainDevice.physicalDevice, &queueFamilyCount, queueFamilyList.data());
+
+	m_GpuCullingSupported = supportedVulkan12Features.drawIndirectCount == VK_TRUE &&
+		(queueFamilyList[indices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+
+	// Texture array can't hold more than the update after bind limits allow
+	VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+	vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 deviceProperties2{};
+	deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	deviceProperties2.pNext = &vulkan12Properties;
+	vkGetPhysicalDeviceProperties2(m_MainDevice.physicalDevice, &deviceProperties2);
+
+	m_MaxTextures = std::min({
+		static_cast<uint32_t>(MAX_TEXTURES),
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+		vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages
+	});
+
+	// Physical device features that the logical device will be using
+	VkPhysicalDeviceFeatures deviceFeatures = {};
+	deviceFeatures.samplerAnisotropy = VK_TRUE;					// Enable anisotropy
+	deviceFeatures.drawIndirectFirstInstance = VK_TRUE;			// Indirect draws start at their model's instances
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+
+	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;		// Physical device features for logical device
+
+	// gl_DrawID, indirect draws find their per-draw data with it
+	VkPhysicalDeviceVulkan11Features vulkan11Features{};
+	vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	vulkan11Features.shaderDrawParameters = VK_TRUE;
+
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.drawIndirectCount = m_GpuCullingSupported ? VK_TRUE : VK_FALSE;
+
+	// Bindless texture array (descriptor indexing), checked by CheckDeviceSuitable
+	vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+	vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+	vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+	// Frames and uploads are tracked with one timeline semaphore per queue, checked by CheckDeviceSuitable
+	vulkan12Features.timelineSemaphore = VK_TRUE;
+	vulkan11Features.pNext = &vulkan12Features;
+
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+	presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	presentWaitFeatures.presentWait = VK_TRUE;
+
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+	presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	presentIdFeatures.presentId = VK_TRUE;
+	presentIdFeatures.pNext = &presentWaitFeatures;
+
+	if (m_PresentWaitEnabled)
+	{
+		vulkan12Features.pNext = &presentIdFeatures;
+	}
+
+	deviceCreateInfo.pNext = &vulkan11Features;
+
+	// Create logical device for the given physical device
+	const VkResult result = vkCreateDevice(m_MainDevice.physicalDevice, &deviceCreateInfo, nullptr, &m_MainDevice.logicalDevice);
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error creating logical device");
+	}
+
+	// Queues are created at the same time as the device
+	// So we want to handle the queues
+	// Fetch queue memory index from created logical device
+	vkGetDeviceQueue(m_MainDevice.logicalDevice, indices.graphicsFamily, 0, &m_GraphicsQueue);
+	vkGetDeviceQueue(m_MainDevice.logicalDevice, indices.presentationFamily, 0, &m_PresentationQueue);
+	vkGetDeviceQueue(m_MainDevice.logicalDevice, indices.transferFamily, 0, &m_TransferQueue);
+
+	// Extension function, the loader doesn't export it
+	if (m_PresentWaitEnabled)
+	{
+		m_pfnWaitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(m_MainDevice.logicalDevice, "vkWaitForPresentKHR"));
+	}
+}
+
+void VulkanRenderer::CreateSurface()
+{
+	// Create surface (This creates a surface struct set up depending on your system)
+	const VkResult result = glfwCreateWindowSurface(m_Instance, m_pWindow->GetWindow(), nullptr, &m_Surface);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error creating window surface");
+	}
+}
+
+void VulkanRenderer::CreateDebugMessenger()
+{
+	if (!CheckValidationEnabled())
+		return;
+
+	VkDebugUtilsMessengerCreateInfoEXT createInfo{};
+	PopulateDebugMessengerCreateInfo(createInfo);
+
+	if (CreateDebugUtilsMessengerEXT(m_Instance, &createInfo, nullptr, &m_DebugMessenger) != VK_SUCCESS) {
+		throw std::runtime_error("failed to set up debug messenger!");
+	}
+}
+
+void VulkanRenderer::CreateSwapchain()
+{
+	// Get swapchain details so we can pick best settings.
+	const SwapchainDetails swapChainDetails = GetSwapChainDetails(m_MainDevice.physicalDevice);
+
+	// Choose best surface format
+	const VkSurfaceFormatKHR format = ChooseBestSurfaceFormat(swapChainDetails.formats);
+
+	// Choose best presentation mode
+	const VkPresentModeKHR presentMode = ChooseBestPresentationMode(swapChainDetails.presentationModes);
+
+	// Choose swapchain image resolutions
+	const VkExtent2D extent = ChooseSwapExtent(swapChainDetails.capabilities);
+
+	// How many images are in swapchain => get 1 more than min to allow triple buffering
+	uint32_t imageCount = swapChainDetails.capabilities.minImageCount + 1;
+
+	// Clamp values, if maxImageCount is negative then we have infinite images, so no need to clamp
+	if (swapChainDetails.capabilities.maxImageCount > 0 && swapChainDetails.capabilities.maxImageCount < imageCount)
+	{
+		imageCount = swapChainDetails.capabilities.maxImageCount;
+	}
+
+	// Create swapchain
+	VkSwapchainCreateInfoKHR swapchainCreateInfo{};
+	swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	swapchainCreateInfo.presentMode = presentMode;										// Swapchain present mode
+	swapchainCreateInfo.imageExtent = extent;											// Swapchain image size
+	swapchainCreateInfo.imageColorSpace = format.colorSpace;							// Swapchain color space
+	swapchainCreateInfo.imageFormat = format.format;									// Swapchain format
+	swapchainCreateInfo.minImageCount = imageCount;										// Swapchain image count (buffering)
+	swapchainCreateInfo.imageArrayLayers = 1;											// Number of layers for each image in chain
+	swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;				// What attachment images will be used as
+	swapchainCreateInfo.preTransform = swapChainDetails.capabilities.currentTransform;	// Transform to apply on swapchain images
+	swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;				// Draw as it normally is: don't blend! (Window overlap)
+	swapchainCreateInfo.clipped = VK_TRUE;												// Whether to clip part of image not in view (offscreen or behind other windows)
+	swapchainCreateInfo.surface = m_Surface;											// Surface to build swapchain on
+
+	// Get queue family indices
+	const QueueFamilyIndices familyIndices = GetQueueFamilies(m_MainDevice.physicalDevice);
+
+	// If graphics and presentation families are different then swapchain must let images be shared between families
+	if (familyIndices.graphicsFamily != familyIndices.presentationFamily)
+	{
+		// Queues to share between
+		const uint32_t queueFamilyIndices[] = {
+			(uint32_t) familyIndices.graphicsFamily,
+			(uint32_t) familyIndices.presentationFamily
+		};
+
+		swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;	// Image share handling
+		swapchainCreateInfo.queueFamilyIndexCount = 2;						// Number of queues to share images between
+		swapchainCreateInfo.pQueueFamilyIndices = queueFamilyIndices;		// Array of queues to share between
+	}
+	else
+	{
+		swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;	// Image share handling
+		swapchainCreateInfo.queueFamilyIndexCount = 0;						// Number of queues to share images between
+		swapchainCreateInfo.pQueueFamilyIndices = nullptr;					// Array of queues to share between
+	}
+
+	// On resize the old swapchain hands over its resources, it is retired and destroyed once its frames finished
+	swapchainCreateInfo.oldSwapchain = m_Swapchain;
+
+	// Create chain
+	const VkResult result = vkCreateSwapchainKHR(m_MainDevice.logicalDevice, &swapchainCreateInfo, nullptr, &m_Swapchain);
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create swapchain");
+	}
+
+	// Store for later reference
+	m_SwapchainImageFormat = format.format;
+	m_SwapchainExtent = extent;
+
+	// Get amount of images first
+	uint32_t swapchainImageCount{};
+	vkGetSwapchainImagesKHR(m_MainDevice.logicalDevice, m_Swapchain, &swapchainImageCount, nullptr);
+
+	std::vector<VkImage> images(swapchainImageCount);
+	vkGetSwapchainImagesKHR(m_MainDevice.logicalDevice, m_Swapchain, &swapchainImageCount, images.data());
+
+	for (const VkImage image: images)
+	{
+		// VkImages is a identifier
+		SwapchainImage swapchainImage{};
+		swapchainImage.image = image;
+		swapchainImage.imageView = CreateImageView(image, format.format, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		m_SwapchainImages.push_back(swapchainImage);
+	}
+}
+
+void VulkanRenderer::CreateRenderPass()
+{
+	/************************************************************************/
+	/* ATTACHMENTS															*/
+	/************************************************************************/
+	// Color attachment of render pass
+	VkAttachmentDescription colorAttachment{};
+	colorAttachment.format = m_SwapchainImageFormat;					// Format to use for attachment
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;					// Number of samples for multi-sampling
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;				// Describes to do with attachment before rendering.
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;				// Describes to do with attachment after rendering.
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;    // Describes to do with stencil before rendering.
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // Describes to do with stencil after rendering.
+
+	// Frame buffer data will be stored as an image, but images can be given different data layouts
+	// to give optimal use for certain operations
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;			// The image data layout before render pass starts.
+	// So the data will start with any layout, then the sub passes will
+	// transform to their optimal layout and when the render pass finally
+	// ends it will be put in the final layout.
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;		// The image data layout after render (to change to)
+
+	// Depth attachment of render pass
+	VkAttachmentDescription depthAttachment{};
+	depthAttachment.format = m_DepthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	/************************************************************************/
+	/* REFERENCES                                                           */
+	/************************************************************************/
+	// Attachment reference uses an attachment index that refers to index in the attachment list passed to renderPassCreateInfo
+	VkAttachmentReference colorAttachmentRef{};
+	colorAttachmentRef.attachment = 0;										// index of it, in this case we only have 1 so we pick index 0
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;	// Layout for data in sub pass.
+
+	// Depth attachment reference
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	// Information about specific sub pass the render pass is using
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;		// Pipeline type sub pass is to be bound to.
+	subpass.colorAttachmentCount = 1;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+	subpass.pColorAttachments = &colorAttachmentRef;
+
+	// Need to determine when layout transitions occur using sub pass dependencies
+	std::array<VkSubpassDependency, 2> subpassDependencies{};
+
+	// -- Conversion from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL --
+	// When the bottom of the external subpass attempts to read the memory we start converting from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	// But make sure before first subpass kicks in and if the VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT starts to either write or read.
+	// List of what stage triggers what bit => https://registry.khronos.org/vulkan/specs/1.3-extensions/man/html/VkAccessFlagBits.html
+
+	// Transition must happen after these conditions...
+	subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;								// Subpass index (external = special value outside of render pass)
+	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;				// Pipeline stage
+	subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;						// Stage access mask (memory access)
+
+	// Transition must happen before these conditions...
+	subpassDependencies[0].dstSubpass = 0; // index of subpass (only have 1 so index 0)	
+	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	subpassDependencies[0].dependencyFlags = 0;
+
+	// -- Conversion from VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR --
+	// Transition must happen after these conditions...
+	subpassDependencies[1].srcSubpass = 0;
+	subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	// Transition must happen before these conditions...
+	subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	subpassDependencies[1].dependencyFlags = 0;
+
+	std::array<VkAttachmentDescription, 2> renderpassAttachments{ colorAttachment, depthAttachment };
+
+	// Create info for render pass
+	VkRenderPassCreateInfo renderPassCreateInfo{};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(renderpassAttachments.size());
+	renderPassCreateInfo.pAttachments = renderpassAttachments.data();
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpass;
+	renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
+	renderPassCreateInfo.pDependencies = subpassDependencies.data();
+
+	const VkResult result = vkCreateRenderPass(m_MainDevice.logicalDevice, &renderPassCreateInfo, nullptr, &m_RenderPass);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create render pass. HAVE FUN DEBUGGING THIS IF IT FAILED LOL");
+	}
+}
+
+void VulkanRenderer::CreateOcclusionRenderPasses()
+{
+	// Same attachments as m_RenderPass (so the framebuffers work with both), but the frame is split over two passes:
+	// the first clears and keeps depth for the depth pyramid, the second loads both and presents
+	for (uint32_t phase{}; phase < CULL_PHASE_COUNT; ++phase)
+	{
+		const bool first = phase == 0;
+
+		std::array<VkAttachmentDescription, 2> attachments{};
+		attachments[0].format = m_SwapchainImageFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = first ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = first ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[0].finalLayout = first ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		// Depth pyramid build samples the first pass's depth in read only layout
+		attachments[1].format = m_DepthFormat;
+		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[1].loadOp = first ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].storeOp = first ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = first ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		attachments[1].finalLayout = first ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference colorAttachmentRef{};
+		colorAttachmentRef.attachment = 0;
+		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentRef{};
+		depthAttachmentRef.attachment = 1;
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorAttachmentRef;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+		// Attachments are written after the acquired image is available and once the pyramid build (compute) read the depth,
+		// either of the earlier frame or of the first pass
+		std::array<VkSubpassDependency, 2> subpassDependencies{};
+		subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		subpassDependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		subpassDependencies[0].dstSubpass = 0;
+		subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		// First pass hands its depth to the pyramid build and its color to the second pass, the second one presents
+		subpassDependencies[1].srcSubpass = 0;
+		subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		if (first)
+		{
+			subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			subpassDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		}
+		else
+		{
+			subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		}
+
+		VkRenderPassCreateInfo renderPassCreateInfo{};
+		renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassCreateInfo.pAttachments = attachments.data();
+		renderPassCreateInfo.subpassCount = 1;
+		renderPassCreateInfo.pSubpasses = &subpass;
+		renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
+		renderPassCreateInfo.pDependencies = subpassDependencies.data();
+
+		const VkResult result = vkCreateRenderPass(m_MainDevice.logicalDevice, &renderPassCreateInfo, nullptr, &m_OcclusionRenderPasses[phase]);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create occlusion culling render pass");
+		}
+	}
+}
+
+void VulkanRenderer::CreateDescriptorSetLayout()
+{
+	// UNIFORM VALUES DESCRIPTOR SET LAYOUT
+	// MVP binding info
+	VkDescriptorSetLayoutBinding vpLayoutBinding{};
+	vpLayoutBinding.binding = 0;											// Where to bind in shader (layout(binding = 0))
+	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	// Type of descriptor (uniform, dynamic uniform, image sampler etc...)
+	vpLayoutBinding.descriptorCount = 1;									// Number of descriptors for binding
+	vpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;				// Shader stage to bind to
+	vpLayoutBinding.pImmutableSamplers = nullptr;							// For textures: can make sampler immutable
+
+	// Model transforms of the frame, indexed through the draw data
+	VkDescriptorSetLayoutBinding transformLayoutBinding{};
+	transformLayoutBinding.binding = 1;
+	transformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	transformLayoutBinding.descriptorCount = 1;
+	transformLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// Per-draw data of the frame, indexed with the draw index
+	VkDescriptorSetLayoutBinding drawDataLayoutBinding{};
+	drawDataLayoutBinding.binding = 2;
+	drawDataLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	drawDataLayoutBinding.descriptorCount = 1;
+	drawDataLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = {
+		vpLayoutBinding,
+		transformLayoutBinding,
+		drawDataLayoutBinding
+	};
+
+	// Create descriptor set layout with given bindings.
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());				// Number of binding info's
+	layoutCreateInfo.pBindings = layoutBindings.data();											// Bindings
+
+	VkResult result = vkCreateDescriptorSetLayout(m_MainDevice.logicalDevice, &layoutCreateInfo, nullptr, &m_DescriptorSetLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error creating descriptor layout");
+	}
+
+	// CREATE TEXTURE ARRAY DESCRIPTOR SET LAYOUT
+	// One binding holding every texture
+	VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+	samplerLayoutBinding.binding = 0;
+	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	samplerLayoutBinding.descriptorCount = m_MaxTextures;
+	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	samplerLayoutBinding.pImmutableSamplers = nullptr;
+
+	// Textures are written while command buffers using the set are recorded or in flight, elements of unloaded ids stay invalid
+	const VkDescriptorBindingFlags samplerBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo{};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsCreateInfo.bindingCount = 1;
+	bindingFlagsCreateInfo.pBindingFlags = &samplerBindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo textureLayoutCreateInfo{};
+	textureLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	textureLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	textureLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	textureLayoutCreateInfo.pBindings = &samplerLayoutBinding;
+	textureLayoutCreateInfo.bindingCount = 1;
+
+	result = vkCreateDescriptorSetLayout(m_MainDevice.logicalDevice, &textureLayoutCreateInfo, nullptr, &m_TextureSetLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error creating descriptor layout");
+	}
+} 
+
+void VulkanRenderer::CreatePushConstantRange()
+{
+	// Define push constant values
+	m_PushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	m_PushConstantRange.offset = 0;
+	m_PushConstantRange.size = sizeof(DrawPushConstants);		// Everything else a draw needs is in its draw data
+}
+
+void VulkanRenderer::CreatePipelineLayout()
+{
+	// -- PIPELINE LAYOUT --
+	std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = { m_DescriptorSetLayout, m_TextureSetLayout };
+	
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+	pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &m_PushConstantRange;
+
+	// Create Pipeline layout, shared by the pipelines of all vertex formats
+	VkResult result = vkCreatePipelineLayout(m_MainDevice.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create pipeline layout");
+	}
+}
+
+void VulkanRenderer::CreateGraphicsPipeline(VertexFormat vertexFormat)
+{
+	// Compact formats have their own vertex shader doing the dequantization
+	const char* vertexShaderFile{};
+	switch (vertexFormat)
+	{
+	case VertexFormat::Compact:			vertexShaderFile = "Shaders/vert_compact.spv"; break;
+	case VertexFormat::CompactNormal:	vertexShaderFile = "Shaders/vert_compact_normal.spv"; break;
+	default:							vertexShaderFile = "Shaders/vert.spv"; break;
+	}
+
+	// Read in SPIR-V code of shaders
+	auto vertexShaderCode = ReadFile(vertexShaderFile);
+	auto fragmentShaderCode = ReadFile("Shaders/frag.spv");
+
+	// Build shader modules to link to graphics pipeline
+	VkShaderModule vertexShaderModule = CreateShaderModule(vertexShaderCode);
+	VkShaderModule fragmentShaderModule = CreateShaderModule(fragmentShaderCode);
+
+	// -- SHADER STAGE CREATION INFORMATION ---
+	// Vertex stage creation information
+	VkPipelineShaderStageCreateInfo vertexShaderCreateInfo{};
+	vertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertexShaderCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT; // Shader stage type
+	vertexShaderCreateInfo.module = vertexShaderModule; // Module to be used
+	vertexShaderCreateInfo.pName = "main"; // function to run in shader file
+
+	// Constant 0 tells vertex shaders whether the transforms hold precomputed products
+	const VkBool32 precomputedTransforms = PRECOMPUTE_TRANSFORMS ? VK_TRUE : VK_FALSE;
+	VkSpecializationMapEntry specializationEntry{};
+	specializationEntry.constantID = 0;
+	specializationEntry.offset = 0;
+	specializationEntry.size = sizeof(VkBool32);
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = 1;
+	specializationInfo.pMapEntries = &specializationEntry;
+	specializationInfo.dataSize = sizeof(VkBool32);
+	specializationInfo.pData = &precomputedTransforms;
+	vertexShaderCreateInfo.pSpecializationInfo = &specializationInfo;
+
+	// Fragment stage creation information
+	VkPipelineShaderStageCreateInfo fragmentShaderCreateInfo{};
+	fragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragmentShaderCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragmentShaderCreateInfo.module = fragmentShaderModule;
+	fragmentShaderCreateInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderCreateInfo, fragmentShaderCreateInfo };
+
+	// How the data for a single vertex (including info such as position, color, texture coordinates and normals) are at a whole
+	// and how the data for an attribute is defined within a vertex
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+	GetVertexInputDescription(vertexFormat, &bindingDescriptions, &attributeDescriptions);
+
+	// -- VERTEX INPUT --
+	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo{};
+	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputCreateInfo.pVertexBindingDescriptions = bindingDescriptions.data();											// List of vertex binding descriptions (data spacing/stride information)
+	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+	vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();								// List of vertex attribute descriptions (data format and where to bind to/from)
+
+	// -- INPUT ASSEMBLY --
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyCreateInfo{};
+	inputAssemblyCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;						// Primitive type to assemble vertices as
+	inputAssemblyCreateInfo.primitiveRestartEnable = VK_FALSE;									// Allow overriding of "strip" topology to start new primitives
+
+	// -- VIEWPORT & SCISSOR --
+	// Both are dynamic and set when recording (RecordBatches), only their count is baked in
+	VkPipelineViewportStateCreateInfo viewportStateCreateInfo{};
+	viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportStateCreateInfo.viewportCount = 1;
+	viewportStateCreateInfo.pViewports = nullptr;
+	viewportStateCreateInfo.scissorCount = 1;
+	viewportStateCreateInfo.pScissors = nullptr;
+
+	// -- DYNAMIC STATES --
+	// Dynamic states to enable (to avoid baked in values), pipelines survive swapchain resizes
+	const std::array<VkDynamicState, 2> dynamicStateEnables = {
+		VK_DYNAMIC_STATE_VIEWPORT,	// Dynamic viewport, resize in command buffer with vkCmdSetViewport(commandBuffer, 0, 1, &viewport)
+		VK_DYNAMIC_STATE_SCISSOR	// Dynamic scissor, resize in command buffer with vkCmdSetScissor(commandBuffer, 0, 1, &scissor)
+	};
+
+	// Dynamic state creation info
+	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
+	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+	dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
+
+	// -- RASTERIZER --
+	VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo{};
+	rasterizerCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizerCreateInfo.depthClampEnable = VK_FALSE;					// Change if fragments beyond near/far plane are clipped or clamped to plane (need to enable device feature for this)
+	rasterizerCreateInfo.rasterizerDiscardEnable = VK_FALSE;			// Discard data and skip. Used for data without rendering (Leave to false)
+
+	rasterizerCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;			// How to handle polygon rendering. (fill will consider all points within polygon as fragment/pixels. line is handy for wire frames)
+																		// other needs GPU features
+
+	rasterizerCreateInfo.lineWidth = 1.0f;								// Any value other that 1 needs GPU feature
+	rasterizerCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;				// Don't render back side.
+	rasterizerCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;	// Which side is front
+	rasterizerCreateInfo.depthBiasEnable = VK_FALSE;					// Whether to add depth bias to fragments (good for stopping "Shadow acne" in shadow mapping)
+
+	// -- MULTISAMPLING --
+	VkPipelineMultisampleStateCreateInfo multiSamplingCreateInfo{};
+	multiSamplingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multiSamplingCreateInfo.sampleShadingEnable = VK_FALSE;					// Enable multi sampling shading or not
+	multiSamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;	// Number of samples to use per fragment
+
+	// -- BLENDING --
+	// Blending decides how to blend a new color being written to a fragment, with the old value
+
+	// Blend attachment state => how blending is handled
+	VkPipelineColorBlendAttachmentState colorState{};
+	colorState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+		| VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;  // Colors to apply blending to
+	colorState.blendEnable = VK_TRUE;							// Enable blending
+
+	// Blending uses the follow equation: (srcColorBlendFactor * new color) colorBlendOp (destColorBlendFactor * old color)
+	colorState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorState.colorBlendOp = VK_BLEND_OP_ADD;
+
+	// Summarised: (VK_BLEND_FACTOR_SRC_ALPHA * new color) + (VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA * old color)
+	//			   ( new color alpha * new color) + ((1- new color alpha) * old color)
+
+	colorState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorState.alphaBlendOp = VK_BLEND_OP_ADD;
+	// Summarised: (1 * new alpha) + (0 * old alpha) = new alpha
+
+	VkPipelineColorBlendStateCreateInfo colorBlendingCreateInfo{};
+	colorBlendingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendingCreateInfo.logicOpEnable = VK_FALSE;			// Alternative to calculations is to use logical operations.
+	//colorBlendingCreateInfo.logicOp = VK_LOGIC_OP_COPY;
+	colorBlendingCreateInfo.attachmentCount = 1;
+	colorBlendingCreateInfo.pAttachments = &colorState;
+	
+	// -- Depth stencil testing
+	// TODO: Set up depth stencil testing"
+	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo{};
+	depthStencilCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilCreateInfo.depthTestEnable = VK_TRUE;
+	depthStencilCreateInfo.depthWriteEnable = VK_TRUE;
+	depthStencilCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;
+	depthStencilCreateInfo.stencilTestEnable = VK_FALSE;
+
+	// -- Graphics pipeline creation
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stageCount = 2;										// Number of shader stages
+	pipelineCreateInfo.pStages = shaderStages;								// List of shader stages
+	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;          // All the fixed function pipeline states
+	pipelineCreateInfo.pInputAssemblyState = &inputAssemblyCreateInfo;
+	pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+	pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+	pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
+	pipelineCreateInfo.pMultisampleState = &multiSamplingCreateInfo;
+	pipelineCreateInfo.pColorBlendState = &colorBlendingCreateInfo;
+	pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
+	pipelineCreateInfo.layout = m_PipelineLayout;							// Pipeline layout to be used
+	pipelineCreateInfo.renderPass = m_RenderPass;							// Render pass description the pipeline is compatible with
+	pipelineCreateInfo.subpass = 0;											// Subpass of render pass to use with pipeline
+
+	// Pipeline derivatives: can create multiple pipelines that derive from one another for optimization
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;					// Existing pipeline to derive from
+	pipelineCreateInfo.basePipelineIndex = -1;								// or index of pipeline being create to derive from (if making multiple)
+
+	// Create graphics pipeline
+	VkResult result = vkCreateGraphicsPipelines(m_MainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr,
+		&m_GraphicsPipelines[static_cast<size_t>(vertexFormat)]);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create graphics pipelines");
+	}
+
+	// CREATE PIPELINE (once we create pipeline we can destroy here)
+	vkDestroyShaderModule(m_MainDevice.logicalDevice, fragmentShaderModule, nullptr);
+	vkDestroyShaderModule(m_MainDevice.logicalDevice, vertexShaderModule, nullptr);
+}
+
+void VulkanRenderer::PrepareVertexFormat(VertexFormat vertexFormat)
+{
+	// Pipeline and geometry buffers of a format are only created once a model uses it
+	if (m_GraphicsPipelines[static_cast<size_t>(vertexFormat)] == VK_NULL_HANDLE)
+	{
+		CreateGraphicsPipeline(vertexFormat);
+		InvalidateCommands();
+	}
+
+	GeometryBuffer& geometryBuffer = m_GeometryBuffers[static_cast<size_t>(vertexFormat)];
+	if (!geometryBuffer.IsInitialized())
+	{
+		geometryBuffer.Init(m_MainDevice.logicalDevice, &m_Allocator, GetVertexStride(vertexFormat));
+	}
+}
+
+void VulkanRenderer::CreateDepthBufferImage()
+{
+	// Get supported format for depth buffer
+	m_DepthFormat = ChooseSupportedFormat(
+		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+	);
+
+	// Create depth buffer image, sampled when building the depth pyramid
+	m_DepthBufferImage = CreateImage(m_SwapchainExtent.width, m_SwapchainExtent.height, m_DepthFormat, VK_IMAGE_TILING_OPTIMAL
+		, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_DepthBufferImageAllocation,
+		MemoryCategory::RenderTarget, true);
+
+	// Create image view
+	m_DepthBufferImageView = CreateImageView(m_DepthBufferImage, m_DepthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+}
+
+void VulkanRenderer::CreateFrameBuffers()
+{
+	m_SwapchainFramebuffers.resize(m_SwapchainImages.size());
+
+	// Create a framebuffer for each swapchain image.
+	for (size_t i{}; i < m_SwapchainFramebuffers.size(); ++i)
+	{
+		std::array<VkImageView, 2> attachments{
+			m_SwapchainImages[i].imageView,
+			m_DepthBufferImageView
+		}; 
+
+		VkFramebufferCreateInfo framebufferCreateInfo{};
+		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferCreateInfo.renderPass = m_RenderPass;										// Render pass layout the framebuffer will be used with
+		framebufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());		
+		framebufferCreateInfo.pAttachments = attachments.data();								// List of attachments 1:1 with render pass
+		framebufferCreateInfo.width = m_SwapchainExtent.width;
+		framebufferCreateInfo.height = m_SwapchainExtent.height;
+		framebufferCreateInfo.layers = 1;
+
+		const VkResult result = vkCreateFramebuffer(m_MainDevice.logicalDevice, &framebufferCreateInfo, nullptr, &m_SwapchainFramebuffers[i]);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Error creating framebuffer");
+		}
+	}
+}
+
+void VulkanRenderer::CreateCommandPool()
+{
+	const QueueFamilyIndices indices = GetQueueFamilies(m_MainDevice.physicalDevice);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Dump old data on every new command buffer
+	poolInfo.queueFamilyIndex = indices.graphicsFamily;
+
+	// Create a graphics queue family command pool
+	const VkResult result = vkCreateCommandPool(m_MainDevice.logicalDevice, &poolInfo, nullptr, &m_GraphicsCommandPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create command pool");
+	}
+}
+
+void VulkanRenderer::CreateTransferContext()
+{
+	const QueueFamilyIndices indices = GetQueueFamilies(m_MainDevice.physicalDevice);
+
+	// Transfer context creates its own command pool on the transfer family
+	m_TransferContext.Init(m_MainDevice.logicalDevice, &m_Allocator, m_TransferQueue, indices.transferFamily, indices.graphicsFamily);
+
+	// Debug builds only, like the validation layers
+	if (CheckValidationEnabled() && indices.transferFamily != indices.graphicsFamily)
+	{
+		printf("Using dedicated transfer queue family %d\n", indices.transferFamily);
+	}
+}
+
+void VulkanRenderer::CreateCommandBuffers()
+{
+	const QueueFamilyIndices indices = GetQueueFamilies(m_MainDevice.physicalDevice);
+
+	for (auto& frame : m_Frames)
+	{
+		// Frame's command buffer is rerecorded every frame, only reset through its pool
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = indices.graphicsFamily;
+
+		VkResult result = vkCreateCommandPool(m_MainDevice.logicalDevice, &poolInfo, nullptr, &frame.commandPool);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create command pool");
+		}
+
+		VkCommandBufferAllocateInfo cbAllocInfo{};
+		cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbAllocInfo.commandPool = frame.commandPool;
+		cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;		// Primary is buffer you submit directly to queue, can not be called by other buffers.
+																	// Secondary can't be called directly but can be executed by other buffers.
+		cbAllocInfo.commandBufferCount = 1;
+
+		result = vkAllocateCommandBuffers(m_MainDevice.logicalDevice, &cbAllocInfo, &frame.commandBuffer);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Error allocating command buffers");
+		}
+	}
+}
+
+void VulkanRenderer::CreateReusableCommandBuffers()
+{
+	for (auto& frame : m_Frames)
+	{
+		// Reusable draws for every swapchain image, never recorded yet
+		frame.reusableCommandBuffers.resize(m_SwapchainFramebuffers.size());
+		frame.recordedCommands.assign(m_SwapchainFramebuffers.size(), RecordedCommands{});
+
+		VkCommandBufferAllocateInfo cbAllocInfo{};
+		cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbAllocInfo.commandPool = m_GraphicsCommandPool;
+		cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cbAllocInfo.commandBufferCount = static_cast<uint32_t>(frame.reusableCommandBuffers.size());
+
+		VkResult result = vkAllocateCommandBuffers(m_MainDevice.logicalDevice, &cbAllocInfo, frame.reusableCommandBuffers.data());
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Error allocating command buffers");
+		}
+
+		// Their draws are recorded in parallel too, each thread records into buffers of its own pool
+		const uint32_t threadCount = static_cast<uint32_t>(frame.reusableCommandPools.size());
+		frame.reusableSecondaryCommandBuffers.resize(m_SwapchainFramebuffers.size() * CULL_PHASE_COUNT * threadCount);
+
+		cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		cbAllocInfo.commandBufferCount = 1;
+
+		for (size_t i{}; i < frame.reusableSecondaryCommandBuffers.size(); ++i)
+		{
+			cbAllocInfo.commandPool = frame.reusableCommandPools[i % threadCount];
+			result = vkAllocateCommandBuffers(m_MainDevice.logicalDevice, &cbAllocInfo, &frame.reusableSecondaryCommandBuffers[i]);
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("Error allocating command buffers");
+			}
+		}
+	}
+}
+
+void VulkanRenderer::CreateRecordingThreads()
+{
+	// Calling thread records too, so one worker less than there are cores
+	const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const uint32_t threadCount = std::min(hardwareThreads, static_cast<uint32_t>(MAX_RECORDING_THREADS));
+	m_RecordingWorkers.Init(threadCount - 1);
+	m_RecordingStatistics.resize(threadCount);
+
+	const QueueFamilyIndices indices = GetQueueFamilies(m_MainDevice.physicalDevice);
+
+	for (auto& frame : m_Frames)
+	{
+		frame.recordingCommandPools.resize(threadCount);
+		frame.secondaryCommandBuffers.resize(CULL_PHASE_COUNT * threadCount);
+		frame.reusableCommandPools.resize(threadCount);
+
+		for (uint32_t thread{}; thread < threadCount; ++thread)
+		{
+			// Buffers are only reset through their pool, rerecorded every frame
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			poolInfo.queueFamilyIndex = indices.graphicsFamily;
+
+			VkResult result = vkCreateCommandPool(m_MainDevice.logicalDevice, &poolInfo, nullptr, &frame.recordingCommandPools[thread]);
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create command pool");
+			}
+
+			// One per cull phase, occlusion culling draws in two render passes
+			VkCommandBufferAllocateInfo cbAllocInfo{};
+			cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			cbAllocInfo.commandPool = frame.recordingCommandPools[thread];
+			cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			cbAllocInfo.commandBufferCount = 1;
+
+			for (uint32_t phase{}; phase < CULL_PHASE_COUNT; ++phase)
+			{
+				result = vkAllocateCommandBuffers(m_MainDevice.logicalDevice, &cbAllocInfo, &frame.secondaryCommandBuffers[phase * threadCount + thread]);
+				if (result != VK_SUCCESS)
+				{
+					throw std::runtime_error("Error allocating command buffers");
+				}
+			}
+
+			// Reusable secondaries are rerecorded one at a time when what they were recorded with changed
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+			result = vkCreateCommandPool(m_MainDevice.logicalDevice, &poolInfo, nullptr, &frame.reusableCommandPools[thread]);
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create command pool");
+			}
+		}
+	}
+
+	CreateReusableCommandBuffers();
+}
+
+void VulkanRenderer::CreateSynchronization()
+{
+	// Semaphore creation information
+	VkSemaphoreCreateInfo semaphoreCreateInfo{};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (auto& frame : m_Frames)
+	{
+		if (vkCreateSemaphore(m_MainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &frame.imageAvailable) != VK_SUCCESS ||
+			vkCreateSemaphore(m_MainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &frame.renderFinished) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create semaphore");
+		}
+		frame.submitValue = 0;		// Already reached, the first wait returns right away
+	}
+
+	// Replaces a fence per frame in flight
+	m_GraphicsTimeline.Init(m_MainDevice.logicalDevice);
+
+	// No frame rendered to any image yet
+	m_SwapchainImageValues.assign(m_SwapchainImages.size(), 0);
+}
+
+void VulkanRenderer::CreateUniformBuffers()
+{
+	// Dynamic offsets have to be multiples of the device's uniform (and storage) offset alignment
+	VkPhysicalDeviceProperties deviceProperties{};
+	vkGetPhysicalDeviceProperties(m_MainDevice.physicalDevice, &deviceProperties);
+
+	// One persistently mapped buffer, a slice for each frame in flight to prevent race conditions
+	m_UniformRing.Init(m_MainDevice.logicalDevice, &m_Allocator, deviceProperties.limits.minUniformBufferOffsetAlignment, m_FramesInFlight);
+
+	// Instance data is read as vertex attributes, only needs vec4 alignment
+	// Instance data is read as vertex attributes, slices are bound at offset 0 so pushes stay whole instances apart
+	m_InstanceRing.Init(m_MainDevice.logicalDevice, &m_Allocator, sizeof(InstanceData), m_FramesInFlight, DEFAULT_INSTANCE_FRAME_SIZE,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	// Indirect draw data, each is written with a single push per frame (and read by the cull shader)
+	const VkDeviceSize storageAlignment = deviceProperties.limits.minStorageBufferOffsetAlignment;
+	m_TransformRing.Init(m_MainDevice.logicalDevice, &m_Allocator, storageAlignment, m_FramesInFlight, sizeof(ObjectTransform) * MAX_DRAWS,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	m_DrawDataRing.Init(m_MainDevice.logicalDevice, &m_Allocator, storageAlignment, m_FramesInFlight, sizeof(DrawData) * MAX_DRAWS,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	m_IndirectRing.Init(m_MainDevice.logicalDevice, &m_Allocator, storageAlignment, m_FramesInFlight,
+		sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAWS, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+}
+
+void VulkanRenderer::CreateGpuCulling()
+{
+	if (!m_GpuCullingSupported)
+	{
+		return;
+	}
+
+	VkPhysicalDeviceProperties deviceProperties{};
+	vkGetPhysicalDeviceProperties(m_MainDevice.physicalDevice, &deviceProperties);
+
+	try
+	{
+		m_GpuCulling.Init(m_MainDevice.logicalDevice, &m_Allocator, deviceProperties.limits.minStorageBufferOffsetAlignment, m_FramesInFlight, MAX_DRAWS);
+	}
+	catch (const std::runtime_error& e)
+	{
+		// Missing or unusable cull shader, GetCullingMode falls back to CPU culling instead of failing to start
+		printf("[WARNING]: GPU culling unavailable, culling on the CPU: %s\n", e.what());
+		m_GpuCulling.Destroy();
+		return;
+	}
+
+	m_GpuCulling.WriteInputDescriptors(
+		m_TransformRing.GetBuffer(), m_TransformRing.GetFrameSize(),
+		m_DrawDataRing.GetBuffer(), m_DrawDataRing.GetFrameSize(),
+		m_IndirectRing.GetBuffer(), m_IndirectRing.GetFrameSize(),
+		m_InstanceRing.GetBuffer(),
+		m_UniformRing.GetBuffer(), sizeof(UboViewProjection)
+	);
+}
+
+void VulkanRenderer::CreateDepthPyramid()
+{
+	if (!m_GpuCulling.IsInitialized())
+	{
+		return;
+	}
+
+	// Cull shader always declares the pyramid, so it exists whenever GPU culling does (cleared to far until first built)
+	try
+	{
+		m_DepthPyramid.Init(m_MainDevice.logicalDevice, &m_Allocator, m_GpuCulling.GetDepthPyramidSetLayout(), m_DepthBufferImageView, m_SwapchainExtent);
+	}
+	catch (const std::runtime_error& e)
+	{
+		// Without a pyramid to bind the cull shader can't run either, GetCullingMode falls back to CPU culling
+		printf("[WARNING]: Depth pyramid unavailable, culling on the CPU: %s\n", e.what());
+		m_DepthPyramid.Destroy();
+		m_GpuCulling.Destroy();
+		return;
+	}
+
+	m_GpuCulling.SetDepthPyramid(m_DepthPyramid.GetCullDescriptorSet());
+}
+
+void VulkanRenderer::CreateDescriptorPool()
+{
+	// CREATE UNIFORM DESCRIPTOR POOL
+
+	// Type of descriptors and how many descriptors (combined makes pool size)
+	// ViewProjection pool
+	VkDescriptorPoolSize vpPoolSize{};
+	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	vpPoolSize.descriptorCount = 2;
+
+	// Transform and draw data pool
+	VkDescriptorPoolSize drawPoolSize{};
+	drawPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	drawPoolSize.descriptorCount = 4;
+
+	// List of pool sizes
+	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {
+		vpPoolSize,
+		drawPoolSize
+	};
+
+	VkDescriptorPoolCreateInfo poolCreateInfo{};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = 2;																	// Maximum number of descriptor sets that can be created from pool (direct and culled)
+	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());				// Amount of pool sizes being passed
+	poolCreateInfo.pPoolSizes = descriptorPoolSizes.data();										// Pool sizes to create pool with
+
+	VkResult result = vkCreateDescriptorPool(m_MainDevice.logicalDevice , &poolCreateInfo, nullptr, &m_DescriptorPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create descriptor pool");
+	}
+
+	// CREATE TEXTURE DESCRIPTOR POOL
+	// Only the texture array set
+	VkDescriptorPoolSize samplerPoolSize{};
+	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	samplerPoolSize.descriptorCount = m_MaxTextures;
+
+	VkDescriptorPoolCreateInfo samplerPoolCreateInfo{};
+	samplerPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	samplerPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;		// Layout is update after bind
+	samplerPoolCreateInfo.maxSets = 1;
+	samplerPoolCreateInfo.poolSizeCount = 1;
+	samplerPoolCreateInfo.pPoolSizes = &samplerPoolSize;
+
+	result = vkCreateDescriptorPool(m_MainDevice.logicalDevice, &samplerPoolCreateInfo, nullptr, &m_TextureDescriptorPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create descriptor pool");
+	}
+}
+
+void VulkanRenderer::CreateTextureSampler()
+{
+	// Sampler creation info
+	VkSamplerCreateInfo samplerCreateInfo{};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;								// How to render when image is magnified on screen
+	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;								// How to render when image is minified on screen
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;			// How to handle texture wrap in U (x) direction
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;			// How to handle texture wrap in V (y) direction
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;			// How to handle texture wrap in W (z) direction
+	samplerCreateInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;			// Border beyond texture (only works for border clamp)
+	samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;						// Coords Element of [0-1]
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;				// Mipmap interpolation mode
+	samplerCreateInfo.mipLodBias = 0.0f;										// Level of detail bias for mip level
+	samplerCreateInfo.minLod = 0.0f;											// Minimum level of detail to pick mip level
+	samplerCreateInfo.maxLod = 0.0f;											// Maximum level of detail to pick mip level
+	samplerCreateInfo.anisotropyEnable = VK_TRUE;								// Enable Anisotropy
+	samplerCreateInfo.maxAnisotropy = 16;										// Anisotropy sample level
+	
+	VkResult result = vkCreateSampler(m_MainDevice.logicalDevice, &samplerCreateInfo, nullptr, &m_TextureSampler);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create texture sampler");
+	}
+}				
+
+void VulkanRenderer::CreateDescriptorSets()
+{
+	// Descriptor set allocation info
+	VkDescriptorSetAllocateInfo setAllocInfo{};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = m_DescriptorPool;										// Pool to allocate descriptor set from
+	setAllocInfo.descriptorSetCount = 1;												// Number of sets to allocate
+	setAllocInfo.pSetLayouts = &m_DescriptorSetLayout;									// Layouts to use to allocate sets (1:1 relationship)
+	
+	VkResult result = vkAllocateDescriptorSets(m_MainDevice.logicalDevice, &setAllocInfo, &m_DescriptorSet);
 	if (result != VK_SUCCESS)
 	{
-		throw std::runtime_error("Error creating descriptor layout");
+		throw std::runtime_error("Error allocating descriptor set");
 	}
 
-	// CREATE TEXTURE SAMPLER DESCRIPTOR SET LAYOUT
-	// Texture binding info
-	VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-	samplerLayoutBinding.binding = 0;
-	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerLayoutBinding.descriptorCount = 1;
-	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-	samplerLayoutBinding.pImmutableSamplers = nullptr;
-
-	VkDescriptorSetLayoutCreateInfo textureLayoutCreateInfo{};
-	textureLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	textureLayoutCreateInfo.pBindings = &samplerLayoutBinding;
-	textureLayoutCreateInfo.bindingCount = 1;
-
-	result = vkCreateDescriptorSetLayout(m_MainDevice.logicalDevice, &textureLayoutCreateInfo, nullptr, &m_SamplerSetLayout);
+	// Buffer info and data offset info
+	// ViewProjection descriptor, actual position in the ring is given as dynamic offset at bind time
+	VkDescriptorBufferInfo vpBufferInfo{};
+	vpBufferInfo.buffer = m_UniformRing.GetBuffer();				// Buffer to get data from
+	vpBufferInfo.offset = 0;										// Position of start of data
+	vpBufferInfo.range = sizeof(UboViewProjection);					// Size of data
+
+	// Data about connection between binding and buffer
+	VkWriteDescriptorSet vpSetWrite{};
+	vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	vpSetWrite.dstSet = m_DescriptorSet;									// Descriptor set to update
+	vpSetWrite.dstBinding = 0;												// Binding to update (matches with binding on layout/shader)
+	vpSetWrite.dstArrayElement = 0;											// Index in array to update
+	vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	// Type of descriptor
+	vpSetWrite.descriptorCount = 1;											// Amount to update
+	vpSetWrite.pBufferInfo = &vpBufferInfo;									// Buffer information data to bind
+
+	// Transform and draw data descriptors cover a whole frame slice, dynamic offset selects the slice
+	VkDescriptorBufferInfo transformBufferInfo{};
+	transformBufferInfo.buffer = m_TransformRing.GetBuffer();
+	transformBufferInfo.offset = 0;
+	transformBufferInfo.range = m_TransformRing.GetFrameSize();
+
+	VkWriteDescriptorSet transformSetWrite{};
+	transformSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	transformSetWrite.dstSet = m_DescriptorSet;
+	transformSetWrite.dstBinding = 1;
+	transformSetWrite.dstArrayElement = 0;
+	transformSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	transformSetWrite.descriptorCount = 1;
+	transformSetWrite.pBufferInfo = &transformBufferInfo;
+
+	VkDescriptorBufferInfo drawDataBufferInfo{};
+	drawDataBufferInfo.buffer = m_DrawDataRing.GetBuffer();
+	drawDataBufferInfo.offset = 0;
+	drawDataBufferInfo.range = m_DrawDataRing.GetFrameSize();
+
+	VkWriteDescriptorSet drawDataSetWrite{};
+	drawDataSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	drawDataSetWrite.dstSet = m_DescriptorSet;
+	drawDataSetWrite.dstBinding = 2;
+	drawDataSetWrite.dstArrayElement = 0;
+	drawDataSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	drawDataSetWrite.descriptorCount = 1;
+	drawDataSetWrite.pBufferInfo = &drawDataBufferInfo;
+
+	std::array<VkWriteDescriptorSet, 3> setWrites = { vpSetWrite, transformSetWrite, drawDataSetWrite };
+
+	// Update descriptor set with new buffer binding info
+	vkUpdateDescriptorSets(m_MainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+
+	// Texture array, textures write their element when created
+	VkDescriptorSetAllocateInfo textureSetAllocInfo{};
+	textureSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	textureSetAllocInfo.descriptorPool = m_TextureDescriptorPool;
+	textureSetAllocInfo.descriptorSetCount = 1;
+	textureSetAllocInfo.pSetLayouts = &m_TextureSetLayout;
+
+	result = vkAllocateDescriptorSets(m_MainDevice.logicalDevice, &textureSetAllocInfo, &m_TextureDescriptorSet);
 	if (result != VK_SUCCESS)
 	{
-		throw std::runtime_error("Error creating descriptor layout");
+		throw std::runtime_error("Error allocating descriptor set");
 	}
-} 
-
-void VulkanRenderer::CreatePushConstantRange()
-{
-	// Define push constant values
-	m_PushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	m_PushConstantRange.offset = 0;
-	m_PushConstantRange.size = sizeof(Model);
-}
 
-void VulkanRenderer::CreateGraphicsPipeline()
-{
-	// Read in SPIR-V code of shaders
-	auto vertexShaderCode = ReadFile("Shaders/vert.spv");
-	auto fragmentShaderCode = ReadFile("Shaders/frag.spv");
-
-	// Build shader modules to link to graphics pipeline
-	VkShaderModule vertexShaderModule = CreateShaderModule(vertexShaderCode);
-	VkShaderModule fragmentShaderModule = CreateShaderModule(fragmentShaderCode);
+	if (!m_GpuCulling.IsInitialized())
+	{
+		return;
+	}
 
-	// -- SHADER STAGE CREATION INFORMATION ---
-	// Vertex stage creation information
-	VkPipelineShaderStageCreateInfo vertexShaderCreateInfo{};
-	vertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertexShaderCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT; // Shader stage type
-	vertexShaderCreateInfo.module = vertexShaderModule; // Module to be used
-	vertexShaderCreateInfo.pName = "main"; // function to run in shader file
+	// Same set reading the draw data of the visible draws written by the cull pass
+	result = vkAllocateDescriptorSets(m_MainDevice.logicalDevice, &setAllocInfo, &m_CulledDescriptorSet);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error allocating descriptor set");
+	}
 
-	// Fragment stage creation information
-	VkPipelineShaderStageCreateInfo fragmentShaderCreateInfo{};
-	fragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragmentShaderCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragmentShaderCreateInfo.module = fragmentShaderModule;
-	fragmentShaderCreateInfo.pName = "main";
+	drawDataBufferInfo.buffer = m_GpuCulling.GetDrawDataBuffer();
+	drawDataBufferInfo.range = m_GpuCulling.GetDrawDataRange();
 
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderCreateInfo, fragmentShaderCreateInfo };
+	for (auto& setWrite : setWrites)
+	{
+		setWrite.dstSet = m_CulledDescriptorSet;
+	}
 
-	// How the data for a single vertex (including info such as position, color, texture coordinates and normals) are at a whole
-	VkVertexInputBindingDescription bindingDescription{};
-	bindingDescription.binding = 0;									// Binding position (can bind multiple streams of data)
-	bindingDescription.stride = sizeof(Vertex);						// Offset to next piece of data
-	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;		// How to move between data between each vertex
-																	// VK_VERTEX_INPUT_RATE_VERTEX		: move on to next vertex
-																	// VK_VERTEX_INPUT_RATE_INSTANCE	: move on to vertex for next instance (can draw 100 trees as 1 tree)
-
-	// How the data for an attribute is defined within a vertex
-	std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
-
-	// Position attribute
-	attributeDescriptions[0].binding = 0;								// Which binding it is at (same as above)
-	attributeDescriptions[0].location = 0;								// Which location it is at (same as above)
-	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;		// Format data will take (helps define size)
-	attributeDescriptions[0].offset = offsetof(Vertex, pos);			// Offset from next attribute in data
-
-	// Color attribute
-	attributeDescriptions[1].binding = 0;								
-	attributeDescriptions[1].location = 1;								
-	attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;	
-	attributeDescriptions[1].offset = offsetof(Vertex, col);		
-
-	// Color attribute
-	attributeDescriptions[2].binding = 0;
-	attributeDescriptions[2].location = 2;
-	attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-	attributeDescriptions[2].offset = offsetof(Vertex, uv);
+	vkUpdateDescriptorSets(m_MainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+}
 
-	// -- VERTEX INPUT --
-	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo{};
-	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputCreateInfo.vertexBindingDescriptionCount = 1;
-	vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescription;											// List of vertex binding descriptions (data spacing/stride information)
-	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();								// List of vertex attribute descriptions (data format and where to bind to/from)
+void VulkanRenderer::UpdateUniformBuffers()
+{
+	// Copy VP data into this frame's slice of the ring, no driver calls needed
+	m_VPDynamicOffset = m_UniformRing.Push(&m_UboViewProjection, sizeof(UboViewProjection));
 
-	// -- INPUT ASSEMBLY --
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyCreateInfo{};
-	inputAssemblyCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssemblyCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;						// Primitive type to assemble vertices as
-	inputAssemblyCreateInfo.primitiveRestartEnable = VK_FALSE;									// Allow overriding of "strip" topology to start new primitives
+	// Depth pyramid this frame builds is tested with this camera next frame
+	m_UboViewProjection.previousViewProjection = m_UboViewProjection.projection * m_UboViewProjection.view;
+}
 
-	// -- VIEWPORT & SCISSOR --
-	// Create a viewport info struct
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)m_SwapchainExtent.width;
-	viewport.height = (float)m_SwapchainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+void VulkanRenderer::UpdateProjection()
+{
+	m_UboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)m_SwapchainExtent.width / (float)m_SwapchainExtent.height, m_NearPlane, m_FarPlane);
+	m_UboViewProjection.projection[1][1] *= -1.f;
+}
 
-	// Create a scissor info struct
-	VkRect2D scissor{};
-	scissor.offset = { 0,0 };		// Offset to use region from
-	scissor.extent = m_SwapchainExtent;		// Extent to describe region to use
+bool VulkanRenderer::RecreateSwapchain()
+{
+	if (m_FramebufferExtent.width == 0 || m_FramebufferExtent.height == 0)
+	{
+		return false;
+	}
 
-	VkPipelineViewportStateCreateInfo viewportStateCreateInfo{};
-	viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportStateCreateInfo.viewportCount = 1;
-	viewportStateCreateInfo.pViewports = &viewport;
-	viewportStateCreateInfo.scissorCount = 1;
-	viewportStateCreateInfo.pScissors = &scissor;
+	const auto start = std::chrono::high_resolution_clock::now();
 
-	// -- DYNAMIC STATES --
-	// Dynamic states to enable (to avoid baked in values)
-	//std::vector<VkDynamicState> dynamicStateEnables{};
-	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);	// Dynamic viewport, resize in command buffer with vkCmdSetViewport(commandBuffer, 0, 1, &viewport)
-	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);	// Dynamic scissor, resize in command buffer with vkCmdSetScissor(commandBuffer, 0, 1, &scissor)
-	//// Dynamic state creation info
-	//VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
-	//dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	//dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-	//dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
+	// Frames in flight still render to and present the old images, instead of waiting for the device everything sized by
+	// the swapchain is replaced and the old objects are destroyed once those frames finished.
+	// Pipelines, render passes and descriptor sets of the rings don't depend on the size and stay
+	const VkSwapchainKHR oldSwapchain = m_Swapchain;
+	std::vector<SwapchainImage> oldImages{};
+	oldImages.swap(m_SwapchainImages);
+	std::vector<VkFramebuffer> oldFramebuffers{};
+	oldFramebuffers.swap(m_SwapchainFramebuffers);
 
-	// -- RASTERIZER --
-	VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo{};
-	rasterizerCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizerCreateInfo.depthClampEnable = VK_FALSE;					// Change if fragments beyond near/far plane are clipped or clamped to plane (need to enable device feature for this)
-	rasterizerCreateInfo.rasterizerDiscardEnable = VK_FALSE;			// Discard data and skip. Used for data without rendering (Leave to false)
+	const VkImage oldDepthImage = m_DepthBufferImage;
+	Allocation oldDepthImageAllocation = m_DepthBufferImageAllocation;
+	const VkImageView oldDepthImageView = m_DepthBufferImageView;
 
-	rasterizerCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;			// How to handle polygon rendering. (fill will consider all points within polygon as fragment/pixels. line is handy for wire frames)
-																		// other needs GPU features
+	// Recorded with the old framebuffers, may still be pending. Secondaries go back to the thread pool they came from
+	std::vector<VkCommandBuffer> oldCommandBuffers{};
+	std::vector<std::pair<VkCommandPool, VkCommandBuffer>> oldSecondaryCommandBuffers{};
+	for (auto& frame : m_Frames)
+	{
+		oldCommandBuffers.insert(oldCommandBuffers.end(), frame.reusableCommandBuffers.begin(), frame.reusableCommandBuffers.end());
+		frame.reusableCommandBuffers.clear();
 
-	rasterizerCreateInfo.lineWidth = 1.0f;								// Any value other that 1 needs GPU feature
-	rasterizerCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;				// Don't render back side.
-	rasterizerCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;	// Which side is front
-	rasterizerCreateInfo.depthBiasEnable = VK_FALSE;					// Whether to add depth bias to fragments (good for stopping "Shadow acne" in shadow mapping)
+		for (size_t i{}; i < frame.reusableSecondaryCommandBuffers.size(); ++i)
+		{
+			oldSecondaryCommandBuffers.emplace_back(frame.reusableCommandPools[i % frame.reusableCommandPools.size()], frame.reusableSecondaryCommandBuffers[i]);
+		}
+		frame.reusableSecondaryCommandBuffers.clear();
 
-	// -- MULTISAMPLING --
-	VkPipelineMultisampleStateCreateInfo multiSamplingCreateInfo{};
-	multiSamplingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multiSamplingCreateInfo.sampleShadingEnable = VK_FALSE;					// Enable multi sampling shading or not
-	multiSamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;	// Number of samples to use per fragment
+		// Presented to the old swapchain, the new one can't wait on their ids
+		frame.presentPending = false;
+	}
 
-	// -- BLENDING --
-	// Blending decides how to blend a new color being written to a fragment, with the old value
+	CreateSwapchain();
 
-	// Blend attachment state => how blending is handled
-	VkPipelineColorBlendAttachmentState colorState{};
-	colorState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
-		| VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;  // Colors to apply blending to
-	colorState.blendEnable = VK_TRUE;							// Enable blending
+	m_DeletionQueue.Push(m_FrameCount, 0, [this, oldSwapchain, oldImages, oldFramebuffers, oldDepthImage, oldDepthImageAllocation,
+		oldDepthImageView, oldCommandBuffers, oldSecondaryCommandBuffers]() mutable
+	{
+		const VkDevice device = m_MainDevice.logicalDevice;
 
-	// Blending uses the follow equation: (srcColorBlendFactor * new color) colorBlendOp (destColorBlendFactor * old color)
-	colorState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colorState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorState.colorBlendOp = VK_BLEND_OP_ADD;
+		if (!oldCommandBuffers.empty())
+		{
+			vkFreeCommandBuffers(device, m_GraphicsCommandPool, static_cast<uint32_t>(oldCommandBuffers.size()), oldCommandBuffers.data());
+		}
+		for (const auto& [commandPool, commandBuffer] : oldSecondaryCommandBuffers)
+		{
+			vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+		}
+		for (const auto& framebuffer : oldFramebuffers)
+		{
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
 
-	// Summarised: (VK_BLEND_FACTOR_SRC_ALPHA * new color) + (VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA * old color)
-	//			   ( new color alpha * new color) + ((1- new color alpha) * old color)
+		vkDestroyImageView(device, oldDepthImageView, nullptr);
+		vkDestroyImage(device, oldDepthImage, nullptr);
+		m_Allocator.Free(oldDepthImageAllocation);
 
-	colorState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorState.alphaBlendOp = VK_BLEND_OP_ADD;
-	// Summarised: (1 * new alpha) + (0 * old alpha) = new alpha
+		for (const auto& image : oldImages)
+		{
+			vkDestroyImageView(device, image.imageView, nullptr);
+		}
+		vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+	});
 
-	VkPipelineColorBlendStateCreateInfo colorBlendingCreateInfo{};
-	colorBlendingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlendingCreateInfo.logicOpEnable = VK_FALSE;			// Alternative to calculations is to use logical operations.
-	//colorBlendingCreateInfo.logicOp = VK_LOGIC_OP_COPY;
-	colorBlendingCreateInfo.attachmentCount = 1;
-	colorBlendingCreateInfo.pAttachments = &colorState;
-	
-	// -- PIPELINE LAYOUT --
-	std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = { m_DescriptorSetLayout, m_SamplerSetLayout };
-	
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
-	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-	pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
-	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-	pipelineLayoutCreateInfo.pPushConstantRanges = &m_PushConstantRange;
+	CreateDepthBufferImage();
+	CreateFrameBuffers();
+	CreateReusableCommandBuffers();
 
-	// Create Pipeline layout
-	VkResult result = vkCreatePipelineLayout(m_MainDevice.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout);
-	if (result != VK_SUCCESS)
+	// Cull shader gets the new pyramid's set, recorded culling of frames in flight keeps the old one
+	if (m_DepthPyramid.IsInitialized())
 	{
-		throw std::runtime_error("Failed to create pipeline layout");
+		m_DeletionQueue.Push(m_FrameCount, 0, m_DepthPyramid.Resize(m_DepthBufferImageView, m_SwapchainExtent));
+		m_GpuCulling.SetDepthPyramid(m_DepthPyramid.GetCullDescriptorSet());
 	}
 
-	// -- Depth stencil testing
-	// TODO: Set up depth stencil testing"
-	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo{};
-	depthStencilCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilCreateInfo.depthTestEnable = VK_TRUE;
-	depthStencilCreateInfo.depthWriteEnable = VK_TRUE;
-	depthStencilCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-	depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;
-	depthStencilCreateInfo.stencilTestEnable = VK_FALSE;
+	// No frame rendered to any of the new images yet
+	m_SwapchainImageValues.assign(m_SwapchainImages.size(), 0);
 
-	// -- Graphics pipeline creation
-	VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
-	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineCreateInfo.stageCount = 2;										// Number of shader stages
-	pipelineCreateInfo.pStages = shaderStages;								// List of shader stages
-	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;          // All the fixed function pipeline states
-	pipelineCreateInfo.pInputAssemblyState = &inputAssemblyCreateInfo;
-	pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
-	pipelineCreateInfo.pDynamicState = nullptr;
-	pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
-	pipelineCreateInfo.pMultisampleState = &multiSamplingCreateInfo;
-	pipelineCreateInfo.pColorBlendState = &colorBlendingCreateInfo;
-	pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
-	pipelineCreateInfo.layout = m_PipelineLayout;							// Pipeline layout to be used
-	pipelineCreateInfo.renderPass = m_RenderPass;							// Render pass description the pipeline is compatible with
-	pipelineCreateInfo.subpass = 0;											// Subpass of render pass to use with pipeline
+	UpdateProjection();
+	InvalidateCommands();
 
-	// Pipeline derivatives: can create multiple pipelines that derive from one another for optimization
-	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;					// Existing pipeline to derive from
-	pipelineCreateInfo.basePipelineIndex = -1;								// or index of pipeline being create to derive from (if making multiple)
+	m_SwapchainOutOfDate = false;
+	m_ResizeLatencyPending = true;
 
-	// Create graphics pipeline
-	result = vkCreateGraphicsPipelines(m_MainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_GraphicsPipeline);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create graphics pipelines");
-	}
+	const double recreateMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	m_SwapchainStatistics.recreatedCount++;
+	m_SwapchainStatistics.lastRecreateMilliseconds = recreateMilliseconds;
+	m_SwapchainStatistics.maxRecreateMilliseconds = std::max(m_SwapchainStatistics.maxRecreateMilliseconds, recreateMilliseconds);
 
-	// CREATE PIPELINE (once we create pipeline we can destroy here)
-	vkDestroyShaderModule(m_MainDevice.logicalDevice, fragmentShaderModule, nullptr);
-	vkDestroyShaderModule(m_MainDevice.logicalDevice, vertexShaderModule, nullptr);
+	return true;
 }
 
-void VulkanRenderer::CreateDepthBufferImage()
+bool VulkanRenderer::IsModelDrawable(MeshModel& model)
 {
-	// Get supported format for depth buffer
-	m_DepthFormat = ChooseSupportedFormat(
-		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-	);
-
-	// Create depth buffer image
-	m_DepthBufferImage = CreateImage(m_SwapchainExtent.width, m_SwapchainExtent.height, m_DepthFormat, VK_IMAGE_TILING_OPTIMAL
-		, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_DepthBufferImageMemory);
-
-	// Create image view
-	m_DepthBufferImageView = CreateImageView(m_DepthBufferImage, m_DepthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	// Skip unloaded models, models without instances and models whose buffers and textures are still being uploaded
+	return model.GetMeshCount() > 0 && model.GetInstanceCount() > 0 && m_TransferContext.IsComplete(model.GetUploadToken());
 }
 
-void VulkanRenderer::CreateFrameBuffers()
+void VulkanRenderer::BuildDrawList()
 {
-	m_SwapchainFramebuffers.resize(m_SwapchainImages.size());
+	m_DrawList.Clear();
+	m_Transforms.clear();
 
-	// Create a framebuffer for each swapchain image.
-	for (size_t i{}; i < m_SwapchainFramebuffers.size(); ++i)
+	CullingStatistics cullingStatistics{};
+
+	// Test the world box of every mesh instance at once, boxes are added in the same order the loop below reads them
+	const bool cpuCulling = GetCullingMode() == CullingMode::Cpu;
+	if (cpuCulling)
 	{
-		std::array<VkImageView, 2> attachments{
-			m_SwapchainImages[i].imageView,
-			m_DepthBufferImageView
-		}; 
+		m_FrustumCuller.Clear();
+		for (auto& model : m_ModelList)
+		{
+			if (!IsModelDrawable(model))
+			{
+				continue;
+			}
 
-		VkFramebufferCreateInfo framebufferCreateInfo{};
-		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferCreateInfo.renderPass = m_RenderPass;										// Render pass layout the framebuffer will be used with
-		framebufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());		
-		framebufferCreateInfo.pAttachments = attachments.data();								// List of attachments 1:1 with render pass
-		framebufferCreateInfo.width = m_SwapchainExtent.width;
-		framebufferCreateInfo.height = m_SwapchainExtent.height;
-		framebufferCreateInfo.layers = 1;
+			for (size_t k{}; k < model.GetMeshCount(); ++k)
+			{
+				for (const auto& instance : model.GetInstances())
+				{
+					m_FrustumCuller.AddBox(model.GetMesh(k)->GetBounds(), model.GetModel() * instance.transform);
+				}
+			}
+		}
 
-		const VkResult result = vkCreateFramebuffer(m_MainDevice.logicalDevice, &framebufferCreateInfo, nullptr, &m_SwapchainFramebuffers[i]);
-		if (result != VK_SUCCESS)
+		m_FrustumCuller.Cull(ExtractFrustumPlanes(m_UboViewProjection.projection * m_UboViewProjection.view));
+		cullingStatistics.testedCount = m_FrustumCuller.GetBoxCount();
+	}
+
+	uint32_t boxIndex{};
+	const glm::mat4 viewProjection = m_UboViewProjection.projection * m_UboViewProjection.view;
+
+	// Walk the scene by reference, only instance transforms are copied per frame
+	for (auto& model : m_ModelList)
+	{
+		if (!IsModelDrawable(model))
 		{
-			throw std::runtime_error("Error creating framebuffer");
+			continue;
 		}
-	}
-}
 
-void VulkanRenderer::CreateCommandPool()
-{
-	const QueueFamilyIndices indices = GetQueueFamilies(m_MainDevice.physicalDevice);
+		// Instances of the model are written once and shared by all its meshes' draws
+		const std::vector<InstanceData>& instances = model.GetInstances();
+		const uint32_t instanceCount = model.GetInstanceCount();
+		const uint32_t instanceOffset = m_InstanceRing.Push(instances.data(), sizeof(InstanceData) * instances.size());
+		const uint32_t firstInstance = static_cast<uint32_t>(instanceOffset / sizeof(InstanceData));
+
+		// One transform per model, shared by all its draws
+		const uint32_t transformIndex = static_cast<uint32_t>(m_Transforms.size());
+		ObjectTransform& objectTransform = m_Transforms.emplace_back();
+		objectTransform.model = model.GetModel();
+		if (PRECOMPUTE_TRANSFORMS)
+		{
+			// Once per model instead of once per vertex
+			objectTransform.modelViewProjection = viewProjection * objectTransform.model;
+			objectTransform.normalMatrix = glm::mat3x4(glm::transpose(glm::inverse(glm::mat3(objectTransform.model))));
+		}
 
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Dump old data on every new command buffer
-	poolInfo.queueFamilyIndex = indices.graphicsFamily;
+		// Depth sorting uses the first instance, instances of one draw can't be ordered anyway
+		const glm::mat4 modelMatrix = model.GetModel() * instances.front().transform;
+		const uint32_t formatId = static_cast<uint32_t>(model.GetVertexFormat());
 
-	// Create a graphics queue family command pool
-	const VkResult result = vkCreateCommandPool(m_MainDevice.logicalDevice, &poolInfo, nullptr, &m_GraphicsCommandPool);
-	if (result != VK_SUCCESS)
+		for (size_t k{}; k < model.GetMeshCount(); ++k)
+		{
+			Mesh* pMesh = model.GetMesh(k);
+
+			// Mesh is drawn (with all instances) when any of its instances is visible
+			if (cpuCulling)
+			{
+				bool visible{ false };
+				for (uint32_t i{}; i < instanceCount && !visible; ++i)
+				{
+					visible = m_FrustumCuller.IsVisible(boxIndex + i);
+				}
+				boxIndex += instanceCount;
+
+				if (!visible)
+				{
+					cullingStatistics.culledCount++;
+					continue;
+				}
+			}
+			cullingStatistics.visibleCount++;
+
+			// View space distance of the mesh's center, roughly front to back inside a state group
+			// Taken from the snapshot's view, the camera members belong to the main thread
+			const glm::vec4 center = modelMatrix * glm::vec4(pMesh->GetBounds().center, 1.f);
+			const float depth = -(m_UboViewProjection.view * center).z;
+
+			m_DrawList.Add(formatId, formatId, pMesh->GetTexId(), depth / m_FarPlane, &model, pMesh,
+				transformIndex, instanceCount, firstInstance);
+		}
+	}
+
+	// GPU counts come back once the frame's timeline value was reached, so they are from the last frame that used this frame slot
+	const CullingMode cullingMode = GetCullingMode();
+	if (cullingMode == CullingMode::Gpu || cullingMode == CullingMode::GpuOcclusion)
 	{
-		throw std::runtime_error("Failed to create command pool");
+		const GpuCullingStatistics gpuStatistics = m_GpuCulling.GetStatistics(m_CurrentFrame);
+		cullingStatistics.culledCount = gpuStatistics.frustumCulledCount;
+		cullingStatistics.occludedCount = gpuStatistics.occludedCount;
 	}
-}
 
-void VulkanRenderer::CreateCommandBuffers()
-{
-	m_CommandBuffers.resize(m_SwapchainFramebuffers.size());
+	m_CullingStatistics = cullingStatistics;
 
-	VkCommandBufferAllocateInfo cbAllocInfo{};
-	cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cbAllocInfo.commandPool = m_GraphicsCommandPool;
-	cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;		// Primary is buffer you submit directly to queue, can not be called by other buffers.
-																// Secondary can't be called directly but can be executed by other buffers.
+	m_DrawList.Sort();
+	m_DrawList.BuildBatches();
+	WriteIndirectDraws();
+}
 
-	cbAllocInfo.commandBufferCount = static_cast<uint32_t>(m_SwapchainFramebuffers.size());
+void VulkanRenderer::WriteIndirectDraws()
+{
+	m_DrawData.clear();
+	m_IndirectCommands.clear();
 
-	// Allocate command buffers and give reference to commandBuffers
-	const VkResult result = vkAllocateCommandBuffers(m_MainDevice.logicalDevice, &cbAllocInfo, m_CommandBuffers.data());
-	if (result != VK_SUCCESS)
+	// Draw i of the sorted list is indirect command i and draw data i
+	const std::vector<DrawItem>& items = m_DrawList.GetItems();
+	const std::vector<DrawBatch>& batches = m_DrawList.GetBatches();
+	for (uint32_t batchIndex{}; batchIndex < static_cast<uint32_t>(batches.size()); ++batchIndex)
 	{
-		throw std::runtime_error("Error allocating command buffers");
+		const DrawBatch& batch = batches[batchIndex];
+		for (uint32_t i = batch.firstDraw; i < batch.firstDraw + batch.drawCount; ++i)
+		{
+			const DrawItem& item = items[i];
+
+			VkDrawIndexedIndirectCommand command{};
+			command.indexCount = item.pMesh->GetIndexCount();
+			command.instanceCount = item.instanceCount;
+			command.firstIndex = item.pMesh->GetFirstIndex();
+			command.vertexOffset = item.pMesh->GetVertexOffset();
+			command.firstInstance = item.firstInstance;
+			m_IndirectCommands.push_back(command);
+
+			DrawData drawData{};
+			drawData.transformIndex = item.transformIndex;
+			drawData.textureIndex = static_cast<uint32_t>(item.textureId);
+			drawData.batchIndex = batchIndex;
+			drawData.batchFirstDraw = batch.firstDraw;
+			drawData.quantization = item.pMesh->GetQuantization();
+			drawData.boundingSphere = glm::vec4(item.pMesh->GetBounds().center, item.pMesh->GetBounds().radius);
+			m_DrawData.push_back(drawData);
+		}
 	}
+
+	// Whole arrays are copied into this frame's slices at once
+	m_TransformDynamicOffset = m_TransformRing.Push(m_Transforms.data(), sizeof(ObjectTransform) * m_Transforms.size());
+	m_DrawDataDynamicOffset = m_DrawDataRing.Push(m_DrawData.data(), sizeof(DrawData) * m_DrawData.size());
+	m_IndirectOffset = m_IndirectRing.Push(m_IndirectCommands.data(), sizeof(VkDrawIndexedIndirectCommand) * m_IndirectCommands.size());
 }
 
-void VulkanRenderer::CreateSynchronization()
+void VulkanRenderer::RecordDrawBatch(VkCommandBuffer commandBuffer, uint32_t batchIndex, const DrawBatch& batch, bool culled, uint32_t cullPhase,
+	DrawListStatistics* statistics)
 {
-	m_ImagesAvailable.resize(MAX_FRAME_DRAWS);
-	m_RendersFinished.resize(MAX_FRAME_DRAWS);
-	m_DrawFences.resize(MAX_FRAME_DRAWS);
+	const uint32_t firstDraw = batch.firstDraw;
+	const uint32_t drawCount = batch.drawCount;
+	const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (culled)
+	{
+		// Visible draws were compacted to the front of the batch's range, the cull pass wrote how many there are
+		DrawPushConstants pushConstants{ firstDraw };
+		vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+		vkCmdDrawIndexedIndirectCount(
+			commandBuffer,
+			m_GpuCulling.GetCommandBuffer(),
+			m_GpuCulling.GetCommandOffset(m_CurrentFrame, cullPhase) + stride * firstDraw,
+			m_GpuCulling.GetCountBuffer(),
+			m_GpuCulling.GetCountOffset(m_CurrentFrame, cullPhase) + sizeof(uint32_t) * batchIndex,
+			drawCount,
+			static_cast<uint32_t>(stride)
+		);
+		statistics->indirectCalls++;
+		return;
+	}
 
-	// Semaphore creation information
-	VkSemaphoreCreateInfo semaphoreCreateInfo{};
-	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	const VkDeviceSize batchOffset = m_IndirectOffset + stride * firstDraw;
 
-	// Fence creation information
-	VkFenceCreateInfo fenceCreateInfo{};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	if (m_MultiDrawIndirectEnabled)
+	{
+		// Whole batch in one call, shaders add gl_DrawID to the batch's first draw
+		DrawPushConstants pushConstants{ firstDraw };
+		vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+		vkCmdDrawIndexedIndirect(commandBuffer, m_IndirectRing.GetBuffer(), batchOffset, drawCount, static_cast<uint32_t>(stride));
+		statistics->indirectCalls++;
+		return;
+	}
 
-	for (size_t i{}; i < MAX_FRAME_DRAWS; ++i)
+	// Without multi draw gl_DrawID is always 0, every draw pushes its own index
+	for (uint32_t i{}; i < drawCount; ++i)
 	{
-		if (vkCreateSemaphore(m_MainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &m_ImagesAvailable[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(m_MainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &m_RendersFinished[i]) != VK_SUCCESS || 
-			vkCreateFence(m_MainDevice.logicalDevice, &fenceCreateInfo, nullptr, &m_DrawFences[i]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to create semaphore or fence");
-		}
+		DrawPushConstants pushConstants{ firstDraw + i };
+		vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+		vkCmdDrawIndexedIndirect(commandBuffer, m_IndirectRing.GetBuffer(), batchOffset + stride * i, 1, static_cast<uint32_t>(stride));
+		statistics->indirectCalls++;
 	}
 }
 
-void VulkanRenderer::CreateUniformBuffers()
+void VulkanRenderer::RecordBatches(VkCommandBuffer commandBuffer, uint32_t firstBatch, uint32_t batchCount, bool culled, uint32_t cullPhase,
+	DrawListStatistics* statistics)
 {
-	// ViewProjection buffer size
-	VkDeviceSize vpBufferSize = sizeof(UboViewProjection);
+	// Pipelines leave viewport and scissor dynamic, so they don't depend on the swapchain size
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)m_SwapchainExtent.width;
+	viewport.height = (float)m_SwapchainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0,0 };
+	scissor.extent = m_SwapchainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// Uniform set is shared by every draw, frames only differ in the dynamic offsets (in binding order).
+	// When culled, draw data of the visible draws comes from the output of the cull phase
+	const uint32_t drawDataOffset = culled ? m_GpuCulling.GetDrawDataOffset(m_CurrentFrame, cullPhase) : m_DrawDataDynamicOffset;
+	const std::array<uint32_t, 3> dynamicOffsets = { m_VPDynamicOffset, m_TransformDynamicOffset, drawDataOffset };
+	vkCmdBindDescriptorSets(
+		commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		m_PipelineLayout,
+		0,
+		1,
+		culled ? &m_CulledDescriptorSet : &m_DescriptorSet,
+		static_cast<uint32_t>(dynamicOffsets.size()),
+		dynamicOffsets.data()			// Frame's position in the rings
+	);
 
-	// Model buffer size
-	//VkDeviceSize modelBufferSize = m_ModelUniformAllignment * MAX_OBJECTS;
+	// Every texture at once, draws index it with their texture id
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 1, 1, &m_TextureDescriptorSet, 0, nullptr);
+	statistics->textureBinds++;
 
-	// One uniform buffer for each image (and by extension, command buffer)
-	// To prevent race conditions
-	m_VPUniformBuffer.resize(m_SwapchainImages.size());
-	m_VPUniformBufferMemory.resize(m_SwapchainImages.size());
+	// Draws pick their instances through firstInstance, the whole ring is bound once
+	const VkBuffer instanceBuffer = m_InstanceRing.GetBuffer();
+	const VkDeviceSize instanceBufferOffset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, &instanceBuffer, &instanceBufferOffset);
 
-	//m_ModelDynamicUniformBuffer.resize(m_SwapchainImages.size());
-	//m_ModelDynamicUniformBufferMemory.resize(m_SwapchainImages.size());
-	
+	// Batches are runs of sorted draws sharing state, only emit what differs from the previous batch
+	uint32_t boundPipeline{ ~0u };
+	uint32_t boundGeometry{ ~0u };
 
-	// Create uniform buffers
-	for (size_t i{}; i < m_SwapchainImages.size(); ++i)
-	{
-		CreateBuffer(
-			m_MainDevice.physicalDevice,
-			m_MainDevice.logicalDevice,
-			vpBufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&m_VPUniformBuffer[i],
-			&m_VPUniformBufferMemory[i]
-		);
+	const std::vector<DrawBatch>& batches = m_DrawList.GetBatches();
+	for (uint32_t i = firstBatch; i < firstBatch + batchCount; ++i)
+	{
+		const DrawBatch& batch = batches[i];
 
-		/*CreateBuffer(
-			m_MainDevice.physicalDevice,
-			m_MainDevice.logicalDevice,
-			modelBufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&m_ModelDynamicUniformBuffer[i],
-			&m_ModelDynamicUniformBufferMemory[i]
-		);*/
+		if (batch.pipelineId != boundPipeline)
+		{
+			// Each vertex format has its own pipeline (input layout), layouts are compatible so bound sets stay valid
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipelines[batch.pipelineId]);
+			boundPipeline = batch.pipelineId;
+			statistics->pipelineBinds++;
+		}
+		else
+		{
+			statistics->skippedBinds++;
+		}
+
+		if (batch.geometryId != boundGeometry)
+		{
+			// All meshes of a format share one vertex and index buffer
+			m_GeometryBuffers[batch.geometryId].Bind(commandBuffer);
+			boundGeometry = batch.geometryId;
+			statistics->geometryBinds++;
+		}
+		else
+		{
+			statistics->skippedBinds++;
+		}
+
+		RecordDrawBatch(commandBuffer, i, batch, culled, cullPhase, statistics);
 	}
 }
 
-void VulkanRenderer::CreateDescriptorPool()
+void VulkanRenderer::RecordSecondaryCommands(VkCommandBuffer commandBuffer, uint32_t thread, const VkRenderPassBeginInfo& renderPassBeginInfo,
+	uint32_t firstBatch, uint32_t batchCount, bool culled, uint32_t cullPhase, bool reusable)
 {
-	// CREATE UNIFORM DESCRIPTOR POOL
-
-	// Type of descriptors and how many descriptors (combined makes pool size)
-	// ViewProjection pool
-	VkDescriptorPoolSize vpPoolSize{};
-	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	vpPoolSize.descriptorCount = static_cast<uint32_t>(m_VPUniformBuffer.size());
+	// Runs on a recording thread, only touches the thread's own command buffer (and pool) and statistics
 
-	// Model pool dynamic (For reference)
-	/*VkDescriptorPoolSize modelPoolSize{};
-	modelPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	modelPoolSize.descriptorCount = static_cast<uint32_t>(m_ModelDynamicUniformBuffer.size());*/
-
-	// List of pool sizes
-	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {
-		vpPoolSize, /*modelPoolSize*/
-	};
+	// Continues the primary's render pass, state isn't inherited so each secondary binds what it needs
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPassBeginInfo.renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = renderPassBeginInfo.framebuffer;
 
-	VkDescriptorPoolCreateInfo poolCreateInfo{};
-	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolCreateInfo.maxSets = static_cast<uint32_t>(m_SwapchainImages.size());					// Maximum number of descriptor sets that can be created from pool
-	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());				// Amount of pool sizes being passed
-	poolCreateInfo.pPoolSizes = descriptorPoolSizes.data();										// Pool sizes to create pool with
+	// Reusable ones are executed again by the primary they were recorded for
+	VkCommandBufferBeginInfo commandBufferBeginInfo{};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	if (!reusable)
+	{
+		commandBufferBeginInfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	}
+	commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
 
-	VkResult result = vkCreateDescriptorPool(m_MainDevice.logicalDevice , &poolCreateInfo, nullptr, &m_DescriptorPool);
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
 	if (result != VK_SUCCESS)
 	{
-		throw std::runtime_error("Failed to create descriptor pool");
+		throw std::runtime_error("Error recording command buffer");
 	}
 
-	// CREATE SAMPLER DESCRIPTOR POOL
-	// Texture sampler pool
-	VkDescriptorPoolSize samplerPoolSize{};
-	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerPoolSize.descriptorCount = MAX_OBJECTS;
-
-	VkDescriptorPoolCreateInfo samplerPoolCreateInfo{};
-	samplerPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	samplerPoolCreateInfo.maxSets = MAX_OBJECTS;
-	samplerPoolCreateInfo.poolSizeCount = 1;
-	samplerPoolCreateInfo.pPoolSizes = &samplerPoolSize;
+	DrawListStatistics statistics{};
+	statistics.secondaryCommandBuffers = 1;
+	RecordBatches(commandBuffer, firstBatch, batchCount, culled, cullPhase, &statistics);
+	m_RecordingStatistics[thread] = statistics;
 
-	result = vkCreateDescriptorPool(m_MainDevice.logicalDevice, &samplerPoolCreateInfo, nullptr, &m_SamplerDescriptorPool);
+	result = vkEndCommandBuffer(commandBuffer);
 	if (result != VK_SUCCESS)
 	{
-		throw std::runtime_error("Failed to create descriptor pool");
+		throw std::runtime_error("Error to stop recording command buffer");
 	}
 }
 
-void VulkanRenderer::CreateTextureSampler()
+void VulkanRenderer::RecordRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo& renderPassBeginInfo, bool culled, uint32_t cullPhase,
+	const VkCommandBuffer* pSecondaryCommandBuffers, bool reusable, DrawListStatistics* statistics)
 {
-	// Sampler creation info
-	VkSamplerCreateInfo samplerCreateInfo{};
-	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;								// How to render when image is magnified on screen
-	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;								// How to render when image is minified on screen
-	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;			// How to handle texture wrap in U (x) direction
-	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;			// How to handle texture wrap in V (y) direction
-	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;			// How to handle texture wrap in W (z) direction
-	samplerCreateInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;			// Border beyond texture (only works for border clamp)
-	samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;						// Coords Element of [0-1]
-	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;				// Mipmap interpolation mode
-	samplerCreateInfo.mipLodBias = 0.0f;										// Level of detail bias for mip level
-	samplerCreateInfo.minLod = 0.0f;											// Minimum level of detail to pick mip level
-	samplerCreateInfo.maxLod = 0.0f;											// Maximum level of detail to pick mip level
-	samplerCreateInfo.anisotropyEnable = VK_TRUE;								// Enable Anisotropy
-	samplerCreateInfo.maxAnisotropy = 16;										// Anisotropy sample level
-	
-	VkResult result = vkCreateSampler(m_MainDevice.logicalDevice, &samplerCreateInfo, nullptr, &m_TextureSampler);
-	if (result != VK_SUCCESS)
+	// Split the batches in contiguous ranges of about equal draw count, one per recording thread
+	const std::vector<DrawBatch>& batches = m_DrawList.GetBatches();
+	const uint32_t batchCount = static_cast<uint32_t>(batches.size());
+	const uint32_t drawCount = static_cast<uint32_t>(m_DrawList.GetItems().size());
+	const uint32_t threadCount = std::min(m_RecordingWorkers.GetThreadCount(), batchCount);
+
+	std::vector<uint32_t> firstBatches(threadCount + 1, batchCount);
+	for (uint32_t thread{}, batch{}; thread < threadCount; ++thread)
 	{
-		throw std::runtime_error("Failed to create texture sampler");
+		firstBatches[thread] = batch;
+
+		// Leave at least one batch for each following thread
+		const uint32_t drawTarget = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * (thread + 1) / threadCount);
+		const uint32_t batchLimit = batchCount - (threadCount - thread - 1);
+		do
+		{
+			batch++;
+		} while (batch < batchLimit && batches[batch].firstDraw < drawTarget);
 	}
-}				
 
-void VulkanRenderer::CreateDescriptorSets()
-{
-	// Resize descriptor size so one for every buffer
-	m_DescriptorSets.resize(m_SwapchainImages.size());
+	m_RecordingWorkers.ParallelFor(threadCount, [&](uint32_t thread)
+	{
+		RecordSecondaryCommands(pSecondaryCommandBuffers[thread], thread, renderPassBeginInfo, firstBatches[thread],
+			firstBatches[thread + 1] - firstBatches[thread], culled, cullPhase, reusable);
+	});
 
-	std::vector<VkDescriptorSetLayout> setLayouts(m_SwapchainImages.size(), m_DescriptorSetLayout);
+	// Begin render pass, draws come from the secondary command buffers
+	const VkSubpassContents subpassContents = threadCount > 0 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, subpassContents);
 
-	// Descriptor set allocation info
-	VkDescriptorSetAllocateInfo setAllocInfo{};
-	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	setAllocInfo.descriptorPool = m_DescriptorPool;										// Pool to allocate descriptor set from
-	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(m_SwapchainImages.size());	// Number of sets to allocate
-	setAllocInfo.pSetLayouts = setLayouts.data();										// Layouts to use to allocate sets (1:1 relationship)
-	
-	VkResult result = vkAllocateDescriptorSets(m_MainDevice.logicalDevice, &setAllocInfo, m_DescriptorSets.data());
-	if (result != VK_SUCCESS)
+	if (threadCount > 0)
 	{
-		throw std::runtime_error("Error allocating descriptor set");
-	}
-
-	// Update all descriptor set buffer bindings
-	for (size_t i = 0; i < m_SwapchainImages.size(); i++)
-	{
-		// Buffer info and data offset info
-		// ViewProjection descriptor
-		VkDescriptorBufferInfo vpBufferInfo{};
-		vpBufferInfo.buffer = m_VPUniformBuffer[i];						// Buffer to get data from
-		vpBufferInfo.offset = 0;										// Position of start of data
-		vpBufferInfo.range = sizeof(UboViewProjection);					// Size of data
-
-		// Data about connection between binding and buffer
-		VkWriteDescriptorSet vpSetWrite{};
-		vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		vpSetWrite.dstSet = m_DescriptorSets[i];						// Descriptor set to update
-		vpSetWrite.dstBinding = 0;										// Binding to update (matches with binding on layout/shader)
-		vpSetWrite.dstArrayElement = 0;									// Index in array to update
-		vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;	// Type of descriptor
-		vpSetWrite.descriptorCount = 1;									// Amount to update
-		vpSetWrite.pBufferInfo = &vpBufferInfo;							// Buffer information data to bind
-
-		// Model descriptor
-		// Model buffer binding info
-		/*VkDescriptorBufferInfo modelBufferInfo{};
-		modelBufferInfo.buffer = m_ModelDynamicUniformBuffer[i];
-		modelBufferInfo.offset = 0;
-		modelBufferInfo.range = m_ModelUniformAllignment;
-
-		VkWriteDescriptorSet modelSetWrite{};
-		modelSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		modelSetWrite.dstSet = m_DescriptorSets[i];
-		modelSetWrite.dstBinding = 1;
-		modelSetWrite.dstArrayElement = 0;
-		modelSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-		modelSetWrite.descriptorCount = 1;
-		modelSetWrite.pBufferInfo = &modelBufferInfo;*/
-
-		// List of descriptor write sets
-		std::vector<VkWriteDescriptorSet> setWrites = {
-			vpSetWrite, /*modelSetWrite*/
-		};
+		vkCmdExecuteCommands(commandBuffer, threadCount, pSecondaryCommandBuffers);
 
-		// Update descriptor sets with new buffer binding info
-		vkUpdateDescriptorSets(
-			m_MainDevice.logicalDevice, 
-			static_cast<uint32_t>(setWrites.size()), 
-			setWrites.data(), 
-			0, 
-			nullptr
-		);
+		for (uint32_t thread{}; thread < threadCount; ++thread)
+		{
+			*statistics += m_RecordingStatistics[thread];
+		}
 	}
+
+	// End render pass
+	vkCmdEndRenderPass(commandBuffer);
 }
 
-void VulkanRenderer::UpdateUniformBuffers(uint32_t imageIndex)
+void VulkanRenderer::RecordFrameWork(VkCommandBuffer commandBuffer)
 {
-	// Copy VP data
-	void* data;
-	vkMapMemory(m_MainDevice.logicalDevice, m_VPUniformBufferMemory[imageIndex], 0, sizeof(UboViewProjection), 0, &data);
-	memcpy(data, &m_UboViewProjection, sizeof(UboViewProjection));
-	vkUnmapMemory(m_MainDevice.logicalDevice, m_VPUniformBufferMemory[imageIndex]);
+	// Take ownership of finished uploads from the transfer queue family (must be outside render pass)
+	m_TransferContext.RecordAcquireBarriers(commandBuffer);
+
+	// Clear the depth pyramid before the first frame tests against it
+	if (m_DepthPyramid.IsInitialized())
+	{
+		m_DepthPyramid.RecordInitialization(commandBuffer);
+	}
 
-	// Dynamic uniform buffer, here for reference
-	// 
-	//// Copy Model data
-	//for (size_t i{}; i < m_MeshList.size(); i++)
-	//{
-	//	Model* thisModel = (Model*)((uint64_t)m_ModelTransferSpace + (i * m_ModelUniformAllignment));
-	//	*thisModel = m_MeshList[i].GetModel();
-	//}
+	// Move geometry down into holes left by unloaded meshes, ranges moved away from are freed once this frame completed
+	for (auto& geometryBuffer : m_GeometryBuffers)
+	{
+		if (!geometryBuffer.IsInitialized())
+		{
+			continue;
+		}
 
-	//// Map the list of model data
-	//vkMapMemory(m_MainDevice.logicalDevice, m_ModelDynamicUniformBufferMemory[imageIndex], 0, m_ModelUniformAllignment * m_MeshList.size(), 0, &data);
-	//memcpy(data, m_ModelTransferSpace, m_ModelUniformAllignment * m_MeshList.size());
-	//vkUnmapMemory(m_MainDevice.logicalDevice, m_ModelDynamicUniformBufferMemory[imageIndex]);
+		std::vector<GeometryRange> retiredRanges{};
+		geometryBuffer.RecordCompaction(commandBuffer, &m_TransferContext, &retiredRanges);
+		for (const auto& range : retiredRanges)
+		{
+			m_DeletionQueue.Push(m_FrameCount + 1, 0, [pGeometryBuffer = &geometryBuffer, range]()
+			{
+				pGeometryBuffer->FreeRange(range);
+			});
+		}
+	}
 }
 
-void VulkanRenderer::RecordCommands(uint32_t currentImage)
+DrawListStatistics VulkanRenderer::RecordDrawCommands(VkCommandBuffer commandBuffer, uint32_t currentImage, bool culled, const VkCommandBuffer* pSecondaryCommandBuffers,
+	bool reusable)
 {
-	VkCommandBufferBeginInfo commandBufferBeginInfo{};
-	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
 	std::array<VkClearValue, 2> clearValues = {};
 	clearValues[0].color = { 0.8f, 0.1f, 0.2f, 1.0f };
 	clearValues[1].depthStencil.depth = 1.f;
@@ -1195,91 +2744,164 @@ void VulkanRenderer::RecordCommands(uint32_t currentImage)
 
 	renderpassBeginInfo.framebuffer = m_SwapchainFramebuffers[currentImage];
 
+	const bool occlusion = culled && GetCullingMode() == CullingMode::GpuOcclusion;
+
+	// Cull the frame's draws before the render pass, visible ones are drawn with indirect count draws
+	if (culled)
+	{
+		m_GpuCulling.RecordCulling(
+			commandBuffer,
+			m_CurrentFrame,
+			0,
+			occlusion,
+			m_DrawList.GetBatches(),
+			m_TransformDynamicOffset,
+			m_DrawDataDynamicOffset,
+			m_IndirectOffset,
+			m_VPDynamicOffset
+		);
+	}
+
+	DrawListStatistics statistics{};
+
+	// Every render pass is recorded by the worker pool, pSecondaryCommandBuffers holds one secondary per recording thread
+	// for each cull phase
+	const uint32_t threadCount = m_RecordingWorkers.GetThreadCount();
+	if (occlusion)
+	{
+		// Draws visible against last frame's pyramid first, their depth builds this frame's pyramid
+		renderpassBeginInfo.renderPass = m_OcclusionRenderPasses[0];
+		RecordRenderPass(commandBuffer, renderpassBeginInfo, true, 0, pSecondaryCommandBuffers, reusable, &statistics);
+
+		m_DepthPyramid.RecordBuild(commandBuffer);
+
+		// Then the draws the old pyramid hid but the new one doesn't, on top of the first pass
+		m_GpuCulling.RecordCulling(
+			commandBuffer,
+			m_CurrentFrame,
+			1,
+			occlusion,
+			m_DrawList.GetBatches(),
+			m_TransformDynamicOffset,
+			m_DrawDataDynamicOffset,
+			m_IndirectOffset,
+			m_VPDynamicOffset
+		);
+
+		renderpassBeginInfo.renderPass = m_OcclusionRenderPasses[1];
+		RecordRenderPass(commandBuffer, renderpassBeginInfo, true, 1, pSecondaryCommandBuffers + threadCount, reusable, &statistics);
+
+		return statistics;
+	}
+
+	RecordRenderPass(commandBuffer, renderpassBeginInfo, culled, 0, pSecondaryCommandBuffers, reusable, &statistics);
+
+	return statistics;
+}
+
+uint32_t VulkanRenderer::RecordCommands(uint32_t currentImage, std::array<VkCommandBuffer, 2>* commandBuffers)
+{
+	// Reused command buffers only hold the draws, the rest of the frame gets its own command buffer
+	FrameContext& frame = m_Frames[m_CurrentFrame];
+	const VkCommandBuffer frameCommandBuffer = frame.commandBuffer;
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo{};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
 	// Start recording
-	VkResult result = vkBeginCommandBuffer(m_CommandBuffers[currentImage], &commandBufferBeginInfo);
+	VkResult result = vkBeginCommandBuffer(frameCommandBuffer, &commandBufferBeginInfo);
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Error recording command buffer");
 	}
 
-	// Begin render pass
-	vkCmdBeginRenderPass(m_CommandBuffers[currentImage], &renderpassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	RecordFrameWork(frameCommandBuffer);
+
+	BuildDrawList();
+
+	const CullingMode cullingMode = GetCullingMode();
+	const bool culled = cullingMode == CullingMode::Gpu || cullingMode == CullingMode::GpuOcclusion;
+
+	DrawListStatistics statistics{};
+	uint32_t commandBufferCount{};
+	if (!m_CommandReuseEnabled)
+	{
+		// Everything is rerecorded every frame
+		statistics = RecordDrawCommands(frameCommandBuffer, currentImage, culled, frame.secondaryCommandBuffers.data(), false);
+		m_CommandReuseStatistics.recordedCount++;
+	}
+
+	// End recording
+	result = vkEndCommandBuffer(frameCommandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Error to stop recording command buffer");
+	}
+	(*commandBuffers)[commandBufferCount++] = frameCommandBuffer;
 
+	if (m_CommandReuseEnabled)
 	{
-		// Bind pipeline to be used in render pass (could use different pipelines here e.g. other shading)
-		vkCmdBindPipeline(m_CommandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
+		// Offsets are recorded into the commands, they only match when the frame wrote the same amount of data to the rings
+		const std::array<uint32_t, 4> offsets = { m_VPDynamicOffset, m_TransformDynamicOffset, m_DrawDataDynamicOffset, m_IndirectOffset };
+
+		RecordedCommands& recorded = frame.recordedCommands[currentImage];
+		const VkCommandBuffer reusableCommandBuffer = frame.reusableCommandBuffers[currentImage];
 
-		for (size_t j{}; j < m_ModelList.size(); j++)
+		if (recorded.version != m_CommandsVersion || recorded.culled != culled || recorded.offsets != offsets ||
+			recorded.batches != m_DrawList.GetBatches())
 		{
-			MeshModel thisModel = m_ModelList[j];
-			glm::mat4 modelValue = thisModel.GetModel();
-
-			vkCmdPushConstants(
-				m_CommandBuffers[currentImage],
-				m_PipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT, // Stage to push constants to
-				0,
-				sizeof(Model),
-				&modelValue
-			);
-
-			for (size_t k{}; k < thisModel.GetMeshCount(); ++k)
+			// Not one time submit, waiting on the frame's timeline value makes sure it is no longer pending when submitted again.
+			// Its secondaries are kept with it, per swapchain image
+			commandBufferBeginInfo.flags = 0;
+			result = vkBeginCommandBuffer(reusableCommandBuffer, &commandBufferBeginInfo);
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("Error recording command buffer");
+			}
+
+			const size_t secondaryCount = CULL_PHASE_COUNT * frame.reusableCommandPools.size();
+			recorded.statistics = RecordDrawCommands(reusableCommandBuffer, currentImage, culled,
+				&frame.reusableSecondaryCommandBuffers[currentImage * secondaryCount], true);
+
+			result = vkEndCommandBuffer(reusableCommandBuffer);
+			if (result != VK_SUCCESS)
 			{
-				const VkBuffer vertexBuffers[] = {  thisModel.GetMesh(k)->GetVertexBuffer() };			// Buffers to bind
-				const VkDeviceSize offsets[] = { 0 };														// Offsets into buffers being bound
-				vkCmdBindVertexBuffers(m_CommandBuffers[currentImage], 0, 1, vertexBuffers, offsets);
-
-				// Bind mesh index buffer with 0 offset and using uint32_t
-				vkCmdBindIndexBuffer(m_CommandBuffers[currentImage],  thisModel.GetMesh(k)->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-
-				// Dynamic offset amount
-				// uint32_t dynamicOffset = static_cast<uint32_t>(m_ModelUniformAllignment) * j;
-
-				Model model =  thisModel.GetMesh(k)->GetModel();
-
-				std::array<VkDescriptorSet, 2> descriptorSetGroup{ m_DescriptorSets[currentImage], m_SamplerDescriptorSets[ thisModel.GetMesh(k)->GetTexId()] };
-
-				// Bind descriptor sets
-				vkCmdBindDescriptorSets(
-					m_CommandBuffers[currentImage],
-					VK_PIPELINE_BIND_POINT_GRAPHICS,
-					m_PipelineLayout,
-					0,
-					static_cast<uint32_t>(descriptorSetGroup.size()),
-					descriptorSetGroup.data(),
-					0,
-					nullptr
-				);
-
-				// Execute pipeline (will run through this x amount of times)
-				vkCmdDrawIndexed(m_CommandBuffers[currentImage],  thisModel.GetMesh(k)->GetIndexCount(), 1, 0, 0, 0);
+				throw std::runtime_error("Error to stop recording command buffer");
 			}
+
+			recorded.version = m_CommandsVersion;
+			recorded.culled = culled;
+			recorded.offsets = offsets;
+			recorded.batches = m_DrawList.GetBatches();
+			m_CommandReuseStatistics.recordedCount++;
+		}
+		else
+		{
+			m_CommandReuseStatistics.reusedCount++;
 		}
-	}
 
-	// End render pass
-	vkCmdEndRenderPass(m_CommandBuffers[currentImage]);
+		statistics = recorded.statistics;
+		(*commandBuffers)[commandBufferCount++] = reusableCommandBuffer;
+	}
 
-	// End recording
-	result = vkEndCommandBuffer(m_CommandBuffers[currentImage]);
-	if (result != VK_SUCCESS)
+	// Draws and instances change without rerecording, count them every frame
+	for (const auto& item : m_DrawList.GetItems())
 	{
-		throw std::runtime_error("Error to stop recording command buffer");
+		statistics.drawCount++;
+		statistics.instanceCount += item.instanceCount;
 	}
+
+	m_DrawStatistics = statistics;
+
+	return commandBufferCount;
 }
 
-/*
-void VulkanRenderer::AllocateDynamicBufferTransferSpace()
+void VulkanRenderer::InvalidateCommands()
 {
-	// Not needed anymore (dynamic uniform buffer) here for reference
-	//// here be magic: TODO: look this up later
-	//// Calculate alignment of model data
-	//m_ModelUniformAllignment = (sizeof(Model) + m_MinUniformBufferOffset - 1) & ~(m_MinUniformBufferOffset - 1);
-
-	//// Create space in memory to hold dynamic buffer that is aligned to our required alignment and holds max objects.
-	//m_ModelTransferSpace = (Model*)_aligned_malloc(m_ModelUniformAllignment * MAX_OBJECTS, m_ModelUniformAllignment);
+	// Every reusable command buffer was recorded with an older version, each is rerecorded when next used
+	m_CommandsVersion++;
 }
-*/
 
 void VulkanRenderer::GetPhysicalDevice()
 {
@@ -1394,6 +3016,20 @@ bool VulkanRenderer::CheckDeviceSuitable(VkPhysicalDevice device)
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
+	// Indirect drawing needs draw parameters in shaders
+	VkPhysicalDeviceVulkan11Features vulkan11Features{};
+	vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+
+	// Textures are one descriptor array, indexed per draw and written while in use, submits signal timeline semaphores
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan11Features.pNext = &vulkan12Features;
+
+	VkPhysicalDeviceFeatures2 deviceFeatures2{};
+	deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures2.pNext = &vulkan11Features;
+	vkGetPhysicalDeviceFeatures2(device, &deviceFeatures2);
+
 	const QueueFamilyIndices indices = GetQueueFamilies(device);
 	const bool extensionsSupported = CheckDeviceExtensionSupport(device);
 
@@ -1405,7 +3041,30 @@ bool VulkanRenderer::CheckDeviceSuitable(VkPhysicalDevice device)
 	}
 
 	// Only suitable if all extensions are available and if it has the right queue's
-	return indices.IsValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy;
+	return indices.IsValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy &&
+		deviceFeatures.drawIndirectFirstInstance && vulkan11Features.shaderDrawParameters &&
+		vulkan12Features.runtimeDescriptorArray && vulkan12Features.descriptorBindingPartiallyBound &&
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind && vulkan12Features.descriptorBindingUpdateUnusedWhilePending &&
+		vulkan12Features.shaderSampledImageArrayNonUniformIndexing && vulkan12Features.timelineSemaphore;
+}
+
+bool VulkanRenderer::CheckDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName)
+{
+	uint32_t extensionCount{};
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+	for (const auto& extension : extensions)
+	{
+		if (strcmp(extension.extensionName, extensionName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
 }
 
 bool VulkanRenderer::CheckDeviceExtensionSupport(VkPhysicalDevice device)
@@ -1469,16 +3128,35 @@ VkSurfaceFormatKHR VulkanRenderer::ChooseBestSurfaceFormat(const std::vector<VkS
 
 VkPresentModeKHR VulkanRenderer::ChooseBestPresentationMode(const std::vector<VkPresentModeKHR>& presentationModes)
 {
-	// Look for mailbox presentation mode
+	VkPresentModeKHR requestedMode{ VK_PRESENT_MODE_FIFO_KHR };
+	switch (m_PresentMode)
+	{
+	case PresentMode::Fifo:
+		requestedMode = VK_PRESENT_MODE_FIFO_KHR;
+		break;
+	case PresentMode::FifoRelaxed:
+		requestedMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+		break;
+	case PresentMode::Mailbox:
+		requestedMode = VK_PRESENT_MODE_MAILBOX_KHR;
+		break;
+	case PresentMode::Immediate:
+		requestedMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+		break;
+	}
+
+	// Look for the requested presentation mode
 	for (const auto& presentationMode: presentationModes)
 	{
-		if (presentationMode == VK_PRESENT_MODE_MAILBOX_KHR)
+		if (presentationMode == requestedMode)
 		{
+			m_ActivePresentMode = m_PresentMode;
 			return presentationMode;
 		}
 	}
 
 	// Fifo always has to be available as stated in the vulkan specification
+	m_ActivePresentMode = PresentMode::Fifo;
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -1492,13 +3170,8 @@ VkExtent2D VulkanRenderer::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& surf
 	else
 	{
 		// If value can vary, need to set manually
-		int width, height;
-		glfwGetFramebufferSize(m_pWindow->GetWindow(), &width, &height);
-
 		// Create new extent using window size
-		VkExtent2D newExtent = {};
-		newExtent.width = static_cast<uint32_t>(width);
-		newExtent.height = static_cast<uint32_t>(height);
+		VkExtent2D newExtent = m_FramebufferExtent;
 
 		// Surface also defines max and min, so make sure within boundaries by clamping values
 		newExtent.width = std::clamp(newExtent.width, surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
@@ -1613,6 +3286,20 @@ QueueFamilyIndices VulkanRenderer::GetQueueFamilies(VkPhysicalDevice device)
 		i++;
 	}
 
+	// Prefer a transfer-only family (DMA engine) so uploads run next to rendering,
+	// fall back to the graphics family which always supports transfers
+	indices.transferFamily = indices.graphicsFamily;
+	for (int32_t j{}; j < static_cast<int32_t>(queueFamilyList.size()); ++j)
+	{
+		const VkQueueFlags queueFlags = queueFamilyList[j].queueFlags;
+		if (queueFamilyList[j].queueCount > 0 && (queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+			!(queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+		{
+			indices.transferFamily = j;
+			break;
+		}
+	}
+
 	return indices;
 }
 
@@ -1677,51 +3364,33 @@ VkImageView VulkanRenderer::CreateImageView(VkImage image, VkFormat format, VkIm
 	return imageView;
 }
 
-int VulkanRenderer::CreateTextureDescriptor(VkImageView textureImage)
+void VulkanRenderer::WriteTextureDescriptor(int textureId, VkImageView textureImage)
 {
-	VkDescriptorSet descriptorSet{};
-
-	// Descriptor set allocation info
-	VkDescriptorSetAllocateInfo setAllocInfo{ };
-	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	setAllocInfo.descriptorPool = m_SamplerDescriptorPool;
-	setAllocInfo.descriptorSetCount = 1;
-	setAllocInfo.pSetLayouts = &m_SamplerSetLayout;
-
-	// Allocate descriptor sets
-	VkResult result = vkAllocateDescriptorSets(m_MainDevice.logicalDevice, &setAllocInfo, &descriptorSet);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate descriptor set");
-	}
-
 	// Texture image info
 	VkDescriptorImageInfo imageInfo{};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;	// Image layout when in use
 	imageInfo.imageView = textureImage;									// Image to bind to set
 	imageInfo.sampler = m_TextureSampler;								// Sampler to bind
 
-	// Descriptor write info
+	// Descriptor write info, only the texture's own array element
 	VkWriteDescriptorSet descriptorWrite{};
 	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstSet = m_TextureDescriptorSet;
 	descriptorWrite.dstBinding = 0;
-	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.dstArrayElement = static_cast<uint32_t>(textureId);
 	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	descriptorWrite.descriptorCount = 1;
 	descriptorWrite.pImageInfo = &imageInfo;
 
-	// Update new descriptor set
+	// Update after bind, command buffers already using the set stay valid
 	vkUpdateDescriptorSets(m_MainDevice.logicalDevice, 1, &descriptorWrite, 0, nullptr);
-
-	// Add descriptor set to list
-	m_SamplerDescriptorSets.push_back(descriptorSet);
-
-	return m_SamplerDescriptorSets.size() - 1;
 }
 
-void VulkanRenderer::CreateMeshModel(std::string modelFile)
+int VulkanRenderer::CreateMeshModel(std::string modelFile, const MeshImportSettings& settings)
 {
+	const VertexFormat vertexFormat = settings.vertexFormat;
+	PrepareVertexFormat(vertexFormat);
+
 	// Import model scene
 	Assimp::Importer importer{};
 	const aiScene* scene = importer.ReadFile(modelFile, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
@@ -1740,10 +3409,10 @@ void VulkanRenderer::CreateMeshModel(std::string modelFile)
 	// Loop over texture names and create textures for them
 	for (size_t i{}; i < textureNames.size(); ++i)
 	{
-		// If mat had no texture, set 0 to indicate no texture, text 0 will be reserved for default texture
+		// If mat had no texture, use the default (white) texture
 		if (textureNames[i].empty())
 		{
-			mat2Tex[i] = 0;
+			mat2Tex[i] = DEFAULT_TEXTURE_ID;
 		}
 		else
 		{
@@ -1752,13 +3421,54 @@ void VulkanRenderer::CreateMeshModel(std::string modelFile)
 		}
 	}
 
-	// Load in all meshes
-	std::vector<Mesh> modelMeshes = MeshModel::LoadNode(m_MainDevice.physicalDevice, m_MainDevice.logicalDevice,
-		m_GraphicsQueue, m_GraphicsCommandPool, scene->mRootNode, scene, mat2Tex);
+	// Load in all meshes (uploads are only recorded)
+	std::vector<Mesh> modelMeshes = MeshModel::LoadNode(&m_GeometryBuffers[static_cast<size_t>(vertexFormat)], &m_TransferContext, settings,
+		scene->mRootNode, scene, mat2Tex);
+
+	// Submit textures and meshes of the whole model as one batch, model isn't drawn until it has completed
+	MeshModel meshModel = MeshModel(modelMeshes, vertexFormat);
+	meshModel.SetUploadToken(m_TransferContext.Flush());
+	meshModel.AddInstance(0, glm::mat4(1.f));
+
+	// Hold a reference on every (still loaded) texture the meshes use, shared ones included. The default texture is never unloaded
+	std::vector<int> textureIds{};
+	for (const int textureId : mat2Tex)
+	{
+		if (textureId == DEFAULT_TEXTURE_ID || textureId >= static_cast<int>(m_TextureImages.size()) || m_TextureImages[textureId] == VK_NULL_HANDLE ||
+			std::find(textureIds.begin(), textureIds.end(), textureId) != textureIds.end())
+		{
+			continue;
+		}
+
+		m_TextureRefCounts[textureId]++;
+		textureIds.push_back(textureId);
+	}
+	meshModel.SetTextureIds(textureIds);
+
+	InvalidateCommands();
 
-	// Create mesh model and add to mesh
-	MeshModel meshModel = MeshModel(modelMeshes);
-	m_ModelList.push_back(meshModel);
+	// Reuse id of an unloaded model if there is one
+	int modelId{};
+	if (!m_FreeModelSlots.empty())
+	{
+		modelId = m_FreeModelSlots.back();
+		m_FreeModelSlots.pop_back();
+		m_ModelList[modelId] = meshModel;
+	}
+	else
+	{
+		modelId = static_cast<int>(m_ModelList.size());
+		m_ModelList.push_back(meshModel);
+	}
+
+	// The simulation starts out with the same single instance
+	if (m_ModelInstanceIds.size() <= static_cast<size_t>(modelId))
+	{
+		m_ModelInstanceIds.resize(modelId + 1);
+	}
+	m_ModelInstanceIds[modelId] = ModelInstanceIds{ true, { true }, {} };
+
+	return modelId;
 }
 
 VkShaderModule VulkanRenderer::CreateShaderModule(const std::vector<char>& code)
@@ -1779,7 +3489,8 @@ VkShaderModule VulkanRenderer::CreateShaderModule(const std::vector<char>& code)
 	return shaderModule;
 }
 
-VkImage VulkanRenderer::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory)
+VkImage VulkanRenderer::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags,
+	Allocation* imageAllocation, MemoryCategory category, bool dedicated)
 {
 	// Create image
 	VkImageCreateInfo imageCreateInfo{};
@@ -1808,91 +3519,98 @@ VkImage VulkanRenderer::CreateImage(uint32_t width, uint32_t height, VkFormat fo
 	VkMemoryRequirements memoryRequirements{};
 	vkGetImageMemoryRequirements(m_MainDevice.logicalDevice, image, &memoryRequirements);
 
-	VkMemoryAllocateInfo memoryAllocInfo{};
-	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocInfo.allocationSize = memoryRequirements.size;
-	memoryAllocInfo.memoryTypeIndex = FindMemoryTypeIndex(m_MainDevice.physicalDevice, memoryRequirements.memoryTypeBits, propFlags);
-
-	result = vkAllocateMemory(m_MainDevice.logicalDevice, &memoryAllocInfo, nullptr, imageMemory);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create memory for given image");
-	}
+	// Linear images share the buffer side of bufferImageGranularity
+	const AllocationType allocationType = tiling == VK_IMAGE_TILING_LINEAR ? AllocationType::Buffer : AllocationType::Image;
+	*imageAllocation = m_Allocator.Allocate(memoryRequirements, propFlags, allocationType, category, dedicated);
 
 	// Connect memory to image
-	vkBindImageMemory(m_MainDevice.logicalDevice, image, *imageMemory, 0);
+	vkBindImageMemory(m_MainDevice.logicalDevice, image, imageAllocation->memory, imageAllocation->offset);
 
 	return image;
 }
 
-int VulkanRenderer::CreateTextureImage(std::string filename)
+VkImage VulkanRenderer::CreateTextureImage(std::string filename, Allocation* imageAllocation)
 {
 	// Load in the image file
 	int width{}, height{};
 	VkDeviceSize imageSize{};
 	stbi_uc* imageData = LoadTextureFile(filename, &width, &height, &imageSize);
 
-	// Create staging buffer to hold loaded data, ready to copy to device
-	VkBuffer imageStagingbuffer{};
-	VkDeviceMemory imageStagingBufferMemory{};
-	CreateBuffer(
-		m_MainDevice.physicalDevice,
-		m_MainDevice.logicalDevice,
-		imageSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&imageStagingbuffer,
-		&imageStagingBufferMemory
-	);
+	// Create image to hold final texture
+	VkImage texImage = CreateImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, imageAllocation, MemoryCategory::Texture);
 
-	// Copy image data to staging buffer
-	void* data{};
-	vkMapMemory(m_MainDevice.logicalDevice, imageStagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, imageData, static_cast<size_t>(imageSize));
-	vkUnmapMemory(m_MainDevice.logicalDevice, imageStagingBufferMemory);
+	// Stage pixels in the transfer ring and record copy + transitions to shader readable layout
+	m_TransferContext.UploadToImage(texImage, imageData, width, height, 4);
 
-	// Free original image data
+	// Pixels live in the staging ring now, free original image data
 	stbi_image_free(imageData);
 
-	// Create image to hold final texture
-	VkImage texImage{};
-	VkDeviceMemory textImageMemory{};
-	texImage = CreateImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &textImageMemory);
+	return texImage;
+}
+
+int VulkanRenderer::CreateTexture(std::string filename)
+{
+	// Texture ids are elements of the texture array
+	if (m_FreeTextureSlots.empty() && m_TextureImages.size() >= m_MaxTextures)
+	{
+		throw std::runtime_error("Texture array is full");
+	}
 
-	// Transition image to be DST for copy operation
-	TransitionImageLayout(m_MainDevice.logicalDevice, m_GraphicsQueue, m_GraphicsCommandPool, texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	// Create texture image
+	Allocation texImageAllocation{};
+	VkImage texImage = CreateTextureImage(filename, &texImageAllocation);
+
+	return AddTexture(texImage, texImageAllocation);
+}
 
-	// Copy data to image
-	CopyImageBuffer(m_MainDevice.logicalDevice, m_GraphicsQueue, m_GraphicsCommandPool, imageStagingbuffer, texImage, width, height);
+int VulkanRenderer::AddTexture(VkImage image, const Allocation& imageAllocation)
+{
+	// Create image view
+	VkImageView imageView = CreateImageView(image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
 
-	// Transition image to be shader readable for shader usage
-	TransitionImageLayout(m_MainDevice.logicalDevice, m_GraphicsQueue, m_GraphicsCommandPool, texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	// Texture id indexes all texture lists, take the slot of an unloaded texture if there is one
+	int textureId{};
+	if (!m_FreeTextureSlots.empty())
+	{
+		textureId = m_FreeTextureSlots.back();
+		m_FreeTextureSlots.pop_back();
+	}
+	else
+	{
+		textureId = static_cast<int>(m_TextureImages.size());
+		m_TextureImages.emplace_back();
+		m_TextureImageAllocations.emplace_back();
+		m_TextureImageViews.emplace_back();
+		m_TextureRefCounts.emplace_back();
+		m_TextureUploadTokens.emplace_back();
+	}
 
-	// Add texture data to vector for reference
-	m_TextureImages.push_back(texImage);
-	m_TextureImageMemory.push_back(textImageMemory);
+	m_TextureImages[textureId] = image;
+	m_TextureImageAllocations[textureId] = imageAllocation;
+	m_TextureImageViews[textureId] = imageView;
+	m_TextureRefCounts[textureId] = 0;
+	m_TextureUploadTokens[textureId] = m_TransferContext.GetRecordingToken();
 
-	vkDestroyBuffer(m_MainDevice.logicalDevice, imageStagingbuffer, nullptr);
-	vkFreeMemory(m_MainDevice.logicalDevice, imageStagingBufferMemory, nullptr);
+	WriteTextureDescriptor(textureId, imageView);
 
-	// Return index of new texture image
-	return m_TextureImages.size() - 1;
+	return textureId;
 }
 
-int VulkanRenderer::CreateTexture(std::string filename)
+void VulkanRenderer::CreateDefaultTexture()
 {
-	// Create texture image and get array index
-	int textureImageLoc = CreateTextureImage(filename);
+	// First texture, so it gets DEFAULT_TEXTURE_ID and the array element materials without a texture map to is always written
+	const std::array<stbi_uc, 4> whitePixel = { 255, 255, 255, 255 };
 
-	// Create image view and add to list
-	VkImageView imageView = CreateImageView(m_TextureImages[textureImageLoc], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
-	m_TextureImageViews.push_back(imageView);
+	Allocation imageAllocation{};
+	VkImage image = CreateImage(1, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &imageAllocation, MemoryCategory::Texture);
+	m_TransferContext.UploadToImage(image, whitePixel.data(), 1, 1, 4);
 
-	// Create texture descriptor
-	int descriptorLoc = CreateTextureDescriptor(imageView);
+	AddTexture(image, imageAllocation);
 
-	return descriptorLoc;
+	// Models loaded later wait on their own (later) upload, which covers this one
+	m_TransferContext.Flush();
 }
 
 stbi_uc* VulkanRenderer::LoadTextureFile(std::string& filename, int* width, int* height, VkDeviceSize* imageSize)
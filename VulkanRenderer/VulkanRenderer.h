@@ -14,36 +14,179 @@
 #include <vector>
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <thread>
 
 #include "stb_image.h"
 #include "Utilities.h"
 #include "Mesh.h"
 #include "MeshModel.h"
+#include "MemoryAllocator.h"
+#include "TransferContext.h"
+#include "TimelineSemaphore.h"
+#include "UniformRing.h"
+#include "GeometryBuffer.h"
+#include "DeletionQueue.h"
+#include "VertexFormat.h"
+#include "DrawList.h"
+#include "GpuCulling.h"
+#include "DepthPyramid.h"
+#include "FrustumCuller.h"
+#include "WorkerPool.h"
+#include "TripleBuffer.h"
 
 class Window;
 
+// Where draws outside the view frustum (or hidden behind others) are dropped
+enum class CullingMode
+{
+	None,
+	Cpu,			// SIMD box tests while building the draw list, works everywhere
+	Gpu,			// Compute pass before rendering, falls back to Cpu when the device can't draw indirect count
+	GpuOcclusion	// Gpu plus two phase occlusion culling against a depth pyramid, renders in two render passes
+};
+
+// How presented images reach the display, the swapchain falls back to Fifo (always supported) when the surface lacks the mode
+enum class PresentMode
+{
+	Fifo,			// Vsync, images queue for their vblank: no tearing, every queued image adds a refresh of latency
+	FifoRelaxed,	// Fifo, but an image that missed its vblank is shown right away and tears instead of waiting a refresh
+	Mailbox,		// Vsync, a new image replaces the queued one: no tearing and low latency, renders frames never shown
+	Immediate		// No vsync, lowest latency, tears
+};
+
+// How often frames had to record their draws, counted since Init
+struct CommandReuseStatistics
+{
+	uint64_t recordedCount{};		// Frames that (re)recorded their command buffer
+	uint64_t reusedCount{};			// Frames that submitted a command buffer recorded by an earlier frame
+};
+
+// Swapchain recreations (resized window or out of date surface), counted since Init
+struct SwapchainStatistics
+{
+	uint64_t recreatedCount{};
+	double lastRecreateMilliseconds{};			// CPU time of the last recreation, the hitch it adds to its frame
+	double maxRecreateMilliseconds{};
+	double lastResizeLatencyMilliseconds{};		// From noticing the resize to presenting the first image at the new size
+};
+
+// Latency of the last frames, counted from Update reading the input the frame's camera is built from
+struct LatencyStatistics
+{
+	double inputToPresentSubmitMilliseconds{};	// Last frame, until vkQueuePresentKHR returned (queued, not on screen yet)
+	double inputToPresentedMilliseconds{};		// Last frame vkWaitForPresentKHR saw on screen
+	double inputToRenderedMilliseconds{};		// Last finished frame, until its graphics timeline value was seen reached
+	uint64_t presentedFrameCount{};				// Frames measured on screen so far, stays 0 without VK_KHR_present_wait
+	bool presentWaitEnabled{ false };			// Presented latency is measured
+};
+
+// Statistics of the newest frame Draw finished, handed back with every frame so the simulation thread can read them
+struct FrameStatistics
+{
+	DrawListStatistics draw{};
+	CullingStatistics culling{};
+	CommandReuseStatistics commandReuse{};
+	SwapchainStatistics swapchain{};
+	LatencyStatistics latency{};
+};
+
 class VulkanRenderer final
 {
 public:
 	VulkanRenderer() = default;
 	~VulkanRenderer() = default;
 
-	int Init(Window* window);
+	// framesInFlight (1 to MAX_FRAMES_IN_FLIGHT) is how many frames the CPU may record ahead of the GPU:
+	// fewer means less input latency, more keeps the GPU busy when frame times vary
+	int Init(Window* window, uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT);
+	// Update, UpdateModel, the instance functions and UnloadMeshModel change the next snapshot, Draw renders the newest published one
 	void Update(float deltaTime);
 	void UpdateModel(int modelId, glm::mat4 newModel);
 	void Draw();
 	void Cleanup();
 
+	// Hands camera, model transforms, framebuffer size and requests to Draw. Blocks while the previous snapshot wasn't
+	// taken yet, so the simulation runs at most one frame ahead of the renderer
+	void PublishSnapshot();
+
+	// Calls Draw on its own thread for every published snapshot, simulating the next frame overlaps recording and
+	// submitting this one. While it runs only the snapshot functions, RequestSwapchainRecreation, RequestMemoryReport
+	// and GetFrameStatistics may be called, everything else (loading, settings) before Start or after Stop
+	void StartRenderThread();
+	void StopRenderThread();					// Rethrows what the render thread failed with
+	// Valid until the next call, pIsNew tells whether a frame finished since the last call
+	const FrameStatistics& GetFrameStatistics(bool* pIsNew = nullptr);
+	void RequestMemoryReport();					// Printed by the next Draw
+
+	// Recreates the swapchain before the next frame (requested with the next snapshot), the window calls it when its
+	// framebuffer was resized. Draw also does when acquire or present report the swapchain out of date or suboptimal
+	void RequestSwapchainRecreation();
+	SwapchainStatistics GetSwapchainStatistics() const;
+
+	// Can be called before Init, afterwards the swapchain is recreated with the new mode before the next frame
+	void SetPresentMode(PresentMode presentMode);
+	PresentMode GetPresentMode() const;			// Mode actually used
+
+	// Blocks until the GPU finished every submitted frame, so the next frame doesn't queue behind earlier ones.
+	// Just in time pacing calls it before sampling input, trading GPU idle time for latency
+	void WaitForRenderedFrames();
+	LatencyStatistics GetLatencyStatistics() const;
+
+	// Returns id to pass to UpdateModel/UnloadMeshModel, ids of unloaded models get reused
+	// settings pick vertex format (compact formats trade precision for fetch bandwidth) and import time optimizations
+	// The model starts with one instance (id 0) at identity
+	int CreateMeshModel(std::string modelFile, const MeshImportSettings& settings = {});
+
+	// Draw more copies of a loaded model, all instances of a mesh are one draw call.
+	// Instance transforms are applied before the model transform set with UpdateModel. Changes are drawn from the next snapshot on
+	InstanceId AddInstance(int modelId, const glm::mat4& transform);
+	void UpdateInstance(int modelId, InstanceId instanceId, const glm::mat4& transform);
+	void RemoveInstance(int modelId, InstanceId instanceId);
+
+	// Stop drawing the model from the next snapshot on, its geometry and textures are destroyed once no frame in flight uses them
+	void UnloadMeshModel(int modelId);
+
+	// Release one reference on a texture, it is destroyed (deferred) when the last one is gone. DEFAULT_TEXTURE_ID is rejected
+	void UnloadTexture(int textureId);
+
+	AllocatorStatistics GetMemoryStatistics() const;
+	MemoryBudget GetMemoryBudget() const;		// Per-heap budget/usage and per-category renderer usage
+	void PrintMemoryBudget() const;
+
+	// Draws and bind work of the last recorded frame
+	DrawListStatistics GetDrawStatistics() const;
+
+	void SetCullingMode(CullingMode cullingMode);
+	CullingMode GetCullingMode() const;			// Mode actually used
+
+	// Meshes culled in the last recorded frame, counts of GPU culling are from the last frame that used its frame slot
+	CullingStatistics GetCullingStatistics() const;
+
+	// Keep command buffers of earlier frames and submit them again while the draws keep the same batches.
+	// Camera, transforms, instances and indirect commands are read from buffers written every frame, so only
+	// loading or unloading models, new pipelines (or draws culled on the CPU) cause a rerecord
+	void SetCommandReuse(bool enabled);
+	bool IsCommandReuseEnabled() const;
+	CommandReuseStatistics GetCommandReuseStatistics() const;
+
 private:
 	glm::vec3 m_CameraPos{ 0,0,10 };
 	glm::vec3 m_CameraFront{ 0,0,1 };
 	glm::vec3 m_CameraUp{ 0,1,0 };
 	float m_CameraYaw{-90.f};
 	float m_CameraPitch{};
+	float m_NearPlane{ 0.1f };		// Camera above is simulation side, Draw gets its view through the snapshot
+	float m_FarPlane{ 100.f };
 
 	Window* m_pWindow;
 
-	uint32_t m_CurrentFrame{};
+	uint32_t m_FramesInFlight{ DEFAULT_FRAMES_IN_FLIGHT };
+	uint32_t m_CurrentFrame{};				// Frame context being recorded, cycles through m_FramesInFlight
+	uint64_t m_FrameCount{};				// Frames submitted so far, also the last value the graphics timeline was signalled with
 
 	// Scene objects
 	std::vector<Mesh> m_MeshList{};
@@ -52,6 +195,7 @@ private:
 	struct UboViewProjection {
 		glm::mat4 projection;
 		glm::mat4 view;
+		glm::mat4 previousViewProjection;		// Last frame's camera, only the cull shader reads it
 	} m_UboViewProjection;
 
 	// Vulkan components
@@ -63,54 +207,154 @@ private:
 	} m_MainDevice;
 	VkQueue m_GraphicsQueue{};
 	VkQueue m_PresentationQueue{};
+	VkQueue m_TransferQueue{};				// Same as graphics queue if there is no dedicated transfer family
+	TimelineSemaphore m_GraphicsTimeline{};	// Frame n's submit signals n, so its value is the number of frames that finished
 	VkSurfaceKHR m_Surface{};
 	VkSwapchainKHR m_Swapchain{};
 	VkSampler m_TextureSampler{};
 
-	// These 3 will ALWAYS use the same index.
-	// So getting a command at index 0 will get the frame buffer at index 0 and the swapchain at index 0
+	// Sub-allocator every buffer and image gets its memory from
+	MemoryAllocator m_Allocator{};
+	bool m_MemoryBudgetEnabled{ false };			// VK_EXT_memory_budget enabled on the device
+	bool m_PresentWaitEnabled{ false };				// VK_KHR_present_id and VK_KHR_present_wait enabled, presents carry the frame's submit value as id
+	PFN_vkWaitForPresentKHR m_pfnWaitForPresent{};
+	bool m_MultiDrawIndirectEnabled{ false };		// Otherwise batches are drawn one indirect command per call
+	bool m_GpuCullingSupported{ false };			// drawIndirectCount enabled and graphics queue runs compute
+	CullingMode m_CullingMode{ CullingMode::GpuOcclusion };
+
+	// Batches resource uploads into few submits instead of one blocking submit per copy
+	TransferContext m_TransferContext{};
+
+	// Vertex and index data of every mesh, one buffer pair per vertex format (created when first used), bound once per format
+	std::array<GeometryBuffer, static_cast<size_t>(VertexFormat::Count)> m_GeometryBuffers{};
+
+	// Sorted draws of the frame being recorded
+	DrawList m_DrawList{};
+	DrawListStatistics m_DrawStatistics{};
+
+	// World bounds of every mesh instance when culling on the CPU
+	FrustumCuller m_FrustumCuller{};
+	CullingStatistics m_CullingStatistics{};
+
+	// Unloaded resources waiting for the frames that might still use them
+	DeletionQueue m_DeletionQueue{};
+
+	// These 2 will ALWAYS use the same index.
+	// So getting a frame buffer at index 0 will get the swapchain image at index 0
 	std::vector<SwapchainImage> m_SwapchainImages{};
 	std::vector<VkFramebuffer> m_SwapchainFramebuffers{};
-	std::vector<VkCommandBuffer> m_CommandBuffers{};
+	std::vector<uint64_t> m_SwapchainImageValues{};				// Graphics timeline value of the last frame rendering to each image, 0 when none did yet
+
+	// Draws are recorded in parallel into secondary command buffers, per frame in flight one pool per thread for the ones
+	// rerecorded every frame and one for the secondaries of the reusable draws
+	WorkerPool m_RecordingWorkers{};
+	std::vector<DrawListStatistics> m_RecordingStatistics{};		// Per thread, summed after recording
+
+	// What a reusable command buffer was recorded with, it is rerecorded as soon as any of it differs
+	struct RecordedCommands
+	{
+		uint64_t version{ ~0ull };					// m_CommandsVersion when recorded, ~0 when never recorded
+		bool culled{ false };
+		std::array<uint32_t, 4> offsets{};			// VP, transform, draw data and indirect ring offsets
+		std::vector<DrawBatch> batches{};
+		DrawListStatistics statistics{};			// Bind work, counted once when recorded
+	};
+
+	// Everything one frame in flight records and submits with, reused once the graphics timeline reached its submit.
+	// The frame's slices of the rings (uniforms, instances, indirect draws, cull outputs) are picked with the same index,
+	// descriptor sets are shared and select the slices with dynamic offsets
+	struct FrameContext
+	{
+		VkCommandPool commandPool{};								// Reset as a whole (with the recording pools) every frame
+		VkCommandBuffer commandBuffer{};							// Frame work, and the draws when they aren't reused
+		std::vector<VkCommandPool> recordingCommandPools{};			// Per recording thread
+		std::vector<VkCommandBuffer> secondaryCommandBuffers{};		// Per cull phase and recording thread
+
+		// Reusable draws per swapchain image (framebuffer), from m_GraphicsCommandPool so they survive the pool resets.
+		// Their secondaries come from per thread pools that are never reset, per swapchain image, cull phase and thread
+		std::vector<VkCommandBuffer> reusableCommandBuffers{};
+		std::vector<VkCommandPool> reusableCommandPools{};
+		std::vector<VkCommandBuffer> reusableSecondaryCommandBuffers{};
+		std::vector<RecordedCommands> recordedCommands{};
+
+		// Binary, swapchain acquire and present can't use timeline semaphores
+		VkSemaphore imageAvailable{};
+		VkSemaphore renderFinished{};
+		uint64_t submitValue{};										// Graphics timeline value of the frame's last submit
+
+		std::chrono::high_resolution_clock::time_point inputTime{};	// Input the frame was built from
+		bool latencyPending{ false };								// Submitted, rendered latency not measured yet
+		bool presentPending{ false };								// Presented with submitValue as id, not seen on screen yet
+	};
+	std::vector<FrameContext> m_Frames{};
+
+	// Work that differs every frame (acquiring uploads, compaction) goes into the frame's own command buffer, submitted
+	// before the reusable one
+	bool m_CommandReuseEnabled{ true };
+	uint64_t m_CommandsVersion{};										// Bumped by changes no recording can detect on its own
+	CommandReuseStatistics m_CommandReuseStatistics{};
 
 	// Depth stencil
 	VkImage m_DepthBufferImage{};
-	VkDeviceMemory m_DepthBufferImageMemory{};
+	Allocation m_DepthBufferImageAllocation{};
 	VkImageView m_DepthBufferImageView{};
 	VkFormat m_DepthFormat{};
 
 	// - Descriptor
 	VkDescriptorSetLayout m_DescriptorSetLayout{};
-	VkDescriptorSetLayout m_SamplerSetLayout{};
+	VkDescriptorSetLayout m_TextureSetLayout{};
 
 	VkPushConstantRange m_PushConstantRange{};
 
 	VkDescriptorPool m_DescriptorPool{};
-	VkDescriptorPool m_SamplerDescriptorPool{};
-	std::vector<VkDescriptorSet> m_DescriptorSets{};
-	std::vector<VkDescriptorSet> m_SamplerDescriptorSets{};
-
-	std::vector<VkBuffer> m_VPUniformBuffer{};
-	std::vector<VkDeviceMemory> m_VPUniformBufferMemory{};
-
-	std::vector<VkBuffer> m_ModelDynamicUniformBuffer{};
-	std::vector<VkDeviceMemory> m_ModelDynamicUniformBufferMemory{};
-
-
-	// VkDeviceSize m_MinUniformBufferOffset{};
-	// size_t m_ModelUniformAllignment{};
-	// Model* m_ModelTransferSpace{};
+	VkDescriptorPool m_TextureDescriptorPool{};
+	VkDescriptorSet m_DescriptorSet{};							// Uniform set, frames differ only in dynamic offset
+
+	// Bindless texture array, bound once per command buffer. Element i is texture id i, written when the texture is created
+	// (update after bind) and left stale once unloaded, partially bound so unused elements don't have to be valid
+	VkDescriptorSet m_TextureDescriptorSet{};
+	uint32_t m_MaxTextures{};									// MAX_TEXTURES within the device limits
+
+	// Per-frame constants, sliced per frame in flight
+	UniformRing m_UniformRing{};
+	uint32_t m_VPDynamicOffset{};
+
+	// Instance transforms of the frame's draws, bound as vertex buffer at INSTANCE_BINDING
+	UniformRing m_InstanceRing{};
+
+	// Indirect draws of the frame: model transforms and per-draw data (storage buffers) and the draw commands
+	UniformRing m_TransformRing{};
+	UniformRing m_DrawDataRing{};
+	UniformRing m_IndirectRing{};
+	uint32_t m_TransformDynamicOffset{};
+	uint32_t m_DrawDataDynamicOffset{};
+	uint32_t m_IndirectOffset{};
+	std::vector<ObjectTransform> m_Transforms{};					// Filled while building the draw list, written with one copy
+	std::vector<DrawData> m_DrawData{};
+	std::vector<VkDrawIndexedIndirectCommand> m_IndirectCommands{};
+
+	// Culls the frame's indirect draws on the GPU, draws then read the visible draws through m_CulledDescriptorSet
+	GpuCulling m_GpuCulling{};
+	VkDescriptorSet m_CulledDescriptorSet{};
+
+	// Occlusion culling: built from the first render pass's depth, tested by the second cull phase and the next frame's first
+	DepthPyramid m_DepthPyramid{};
 
 	// - Assets
 	std::vector<VkImage> m_TextureImages{};
-	std::vector<VkDeviceMemory> m_TextureImageMemory{};
+	std::vector<Allocation> m_TextureImageAllocations{};
 	std::vector<VkImageView> m_TextureImageViews{};
+	std::vector<uint32_t> m_TextureRefCounts{};				// Models using the texture
+	std::vector<TransferToken> m_TextureUploadTokens{};
+	std::vector<int> m_FreeTextureSlots{};
 	std::vector<MeshModel> m_ModelList{};
+	std::vector<int> m_FreeModelSlots{};					// Unloaded model ids, their MeshModel is empty
 
 	// - Pipeline
-	VkPipeline m_GraphicsPipeline{};
+	std::array<VkPipeline, static_cast<size_t>(VertexFormat::Count)> m_GraphicsPipelines{};		// Per vertex format, created when first used
 	VkPipelineLayout m_PipelineLayout{};
 	VkRenderPass m_RenderPass{};
+	std::array<VkRenderPass, CULL_PHASE_COUNT> m_OcclusionRenderPasses{};		// Per cull phase, compatible with m_RenderPass
 
 	// - Pools
 	VkCommandPool m_GraphicsCommandPool{};
@@ -119,10 +363,78 @@ private:
 	VkFormat m_SwapchainImageFormat{};
 	VkExtent2D m_SwapchainExtent{};
 
-	// - Synchronization
-	std::vector<VkSemaphore> m_ImagesAvailable{};
-	std::vector<VkSemaphore> m_RendersFinished{};
-	std::vector<VkFence> m_DrawFences{};
+	// Swapchain and everything sized by it are replaced at the start of the next frame, the old ones are destroyed through the
+	// deletion queue once the frames in flight that use them finished
+	bool m_SwapchainOutOfDate{ false };
+	bool m_ResizeLatencyPending{ false };									// Recreated, waiting for the first present
+	std::chrono::high_resolution_clock::time_point m_ResizeRequestTime{};	// First request since the last recreation
+	SwapchainStatistics m_SwapchainStatistics{};
+	VkExtent2D m_FramebufferExtent{};				// Window framebuffer of the newest snapshot, GLFW can't be asked off the main thread
+
+	PresentMode m_PresentMode{ PresentMode::Mailbox };			// Requested
+	PresentMode m_ActivePresentMode{ PresentMode::Fifo };		// Used by the current swapchain
+
+	// Input to present latency
+	std::chrono::high_resolution_clock::time_point m_InputTime{};			// When Update last read the input
+	LatencyStatistics m_LatencyStatistics{};
+
+	// Scene changes the render side replays in order, ids were already handed out by the simulation
+	enum class SceneCommandType
+	{
+		AddInstance,
+		UpdateInstance,
+		RemoveInstance,
+		UnloadModel
+	};
+
+	struct SceneCommand
+	{
+		SceneCommandType type{};
+		int modelId{};
+		InstanceId instanceId{ INVALID_INSTANCE_ID };
+		glm::mat4 transform{ 1.f };
+	};
+
+	// Everything the simulation changes per frame, Draw applies the newest one before recording
+	struct SceneSnapshot
+	{
+		uint64_t sequence{};											// Publish count
+		glm::mat4 view{ 1.f };
+		std::vector<std::optional<glm::mat4>> modelTransforms{};		// Per model id, empty until UpdateModel was called
+		std::vector<SceneCommand> commands{};							// Since the previous snapshot, each snapshot is applied before the next is published
+		VkExtent2D framebufferExtent{};
+		std::chrono::high_resolution_clock::time_point inputTime{};
+
+		// Counted, so requests in skipped snapshots aren't lost
+		uint64_t swapchainRequestCount{};
+		std::chrono::high_resolution_clock::time_point swapchainRequestTime{};		// First request since the previous snapshot
+		uint64_t memoryReportCount{};
+	};
+
+	// - Simulation side
+	SceneSnapshot m_PendingSnapshot{};			// Copied on publish, so it keeps the transforms of models not updated since
+	bool m_SwapchainRequestPending{ false };
+
+	// Instance ids per model id as the simulation sees them, ahead of m_ModelList by the commands not applied yet
+	struct ModelInstanceIds
+	{
+		bool isLoaded{ false };
+		std::vector<bool> isUsed{};
+		std::vector<InstanceId> freeIds{};
+	};
+	std::vector<ModelInstanceIds> m_ModelInstanceIds{};
+
+	// - Handoff
+	TripleBuffer<SceneSnapshot> m_Snapshots{};
+	TripleBuffer<FrameStatistics> m_FrameStatistics{};
+	std::atomic<uint64_t> m_AppliedSnapshotSequence{};		// Newest snapshot Draw took
+
+	// - Render side
+	uint64_t m_AppliedSwapchainRequestCount{};
+	uint64_t m_AppliedMemoryReportCount{};
+	std::thread m_RenderThread{};
+	std::atomic<bool> m_StopRenderThread{ false };
+	std::exception_ptr m_RenderThreadException{};
 
 	const std::vector<const char*> m_ValidationLayers = {
 		"VK_LAYER_KHRONOS_validation"
@@ -138,28 +450,58 @@ private:
 	void CreateDebugMessenger();
 	void CreateSwapchain();
 	void CreateRenderPass();
+	void CreateOcclusionRenderPasses();
 	void CreateDescriptorSetLayout();
 	void CreatePushConstantRange();
-	void CreateGraphicsPipeline();
+	void CreatePipelineLayout();
+	void CreateGraphicsPipeline(VertexFormat vertexFormat);
+	void PrepareVertexFormat(VertexFormat vertexFormat);
 	void CreateDepthBufferImage();
 	void CreateFrameBuffers();
 	void CreateCommandPool();
+	void CreateTransferContext();
 	void CreateCommandBuffers();
+	void CreateReusableCommandBuffers();
+	void CreateRecordingThreads();
 	void CreateSynchronization();
 	void CreateTextureSampler();
 	
 	void CreateUniformBuffers();
+	void CreateGpuCulling();
+	void CreateDepthPyramid();
 	void CreateDescriptorPool();
 	void CreateDescriptorSets();
 
-	void UpdateUniformBuffers(uint32_t imageIndex);
+	void UpdateUniformBuffers();
+	void UpdateProjection();
+	bool RecreateSwapchain();			// False while the window has no area (minimized)
+	void MeasureLatency();
+	void MarkSwapchainOutOfDate(std::chrono::high_resolution_clock::time_point requestTime);
+	void WaitForAppliedSnapshot();
+	void ApplySnapshot();
+	void ApplySceneCommand(const SceneCommand& command);
+	ModelInstanceIds& GetModelInstanceIds(int modelId);
+	void PublishFrameStatistics();
+	void RenderThreadMain();
 
 	// - Record functions
-	void RecordCommands(uint32_t currentImage);
+	bool IsModelDrawable(MeshModel& model);
+	void BuildDrawList();
+	void WriteIndirectDraws();
+	void RecordDrawBatch(VkCommandBuffer commandBuffer, uint32_t batchIndex, const DrawBatch& batch, bool culled, uint32_t cullPhase,
+		DrawListStatistics* statistics);
+	void RecordBatches(VkCommandBuffer commandBuffer, uint32_t firstBatch, uint32_t batchCount, bool culled, uint32_t cullPhase,
+		DrawListStatistics* statistics);
+	void RecordSecondaryCommands(VkCommandBuffer commandBuffer, uint32_t thread, const VkRenderPassBeginInfo& renderPassBeginInfo,
+		uint32_t firstBatch, uint32_t batchCount, bool culled, uint32_t cullPhase, bool reusable);
+	void RecordRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo& renderPassBeginInfo, bool culled, uint32_t cullPhase,
+		const VkCommandBuffer* pSecondaryCommandBuffers, bool reusable, DrawListStatistics* statistics);
+	void RecordFrameWork(VkCommandBuffer commandBuffer);
+	DrawListStatistics RecordDrawCommands(VkCommandBuffer commandBuffer, uint32_t currentImage, bool culled, const VkCommandBuffer* pSecondaryCommandBuffers,
+		bool reusable);
+	uint32_t RecordCommands(uint32_t currentImage, std::array<VkCommandBuffer, 2>* commandBuffers);		// Returns number to submit
+	void InvalidateCommands();
 
-	// - Allocate functions
-	//void AllocateDynamicBufferTransferSpace();
-	
 	// - Destroy functions
 	void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator);
 
@@ -175,6 +517,7 @@ private:
 	bool CheckInstanceExtensionSupport(std::vector<const char*>* checkExtensions);
 	bool CheckDeviceSuitable(VkPhysicalDevice device);
 	bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+	bool CheckDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName);
 
 	// -- Choose functions
 	VkSurfaceFormatKHR ChooseBestSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats);
@@ -199,14 +542,16 @@ private:
 		VkImageTiling tiling, 
 		VkImageUsageFlags useFlags, 
 		VkMemoryPropertyFlags propFlags,
-		VkDeviceMemory *imageMemory
+		Allocation* imageAllocation,
+		MemoryCategory category,
+		bool dedicated = false
 	);
 
-	int CreateTextureImage(std::string filename);
+	VkImage CreateTextureImage(std::string filename, Allocation* imageAllocation);
 	int CreateTexture(std::string filename);
-	int CreateTextureDescriptor(VkImageView textureImage);
-
-	void CreateMeshModel(std::string modelFile);
+	int AddTexture(VkImage image, const Allocation& imageAllocation);
+	void CreateDefaultTexture();
+	void WriteTextureDescriptor(int textureId, VkImageView textureImage);
 
 	// -- Loader functions
 	stbi_uc* LoadTextureFile(std::string& filename, int* width, int* height, VkDeviceSize* imageSize);
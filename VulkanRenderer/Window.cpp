@@ -12,7 +12,7 @@ Window::Window(std::string& wName, uint32_t windowWidth, uint32_t windowHeight)
 
 	// Disable default API
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	// Create window
 	//const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
@@ -26,6 +26,17 @@ Window::~Window()
 	glfwTerminate();
 }
 
+void Window::FramebufferSizeCallback(GLFWwindow* window, int, int)
+{
+	VulkanRenderer* pRenderer = static_cast<VulkanRenderer*>(glfwGetWindowUserPointer(window));
+	pRenderer->RequestSwapchainRecreation();
+}
+
+void Window::SetFramePacing(FramePacing pacing, double targetFrameRate)
+{
+	m_FramePacer.Init(pacing, targetFrameRate);
+}
+
 void Window::Init(VulkanRenderer& renderer)
 {
 	float angle = 0.0f;
@@ -41,13 +52,42 @@ void Window::Init(VulkanRenderer& renderer)
 	InputHandler::CreateInstance(m_pWindow, keys);
 	glfwSetInputMode(m_pWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+	// Renderer recreates its swapchain at the start of the next frame
+	glfwSetWindowUserPointer(m_pWindow, &renderer);
+	glfwSetFramebufferSizeCallback(m_pWindow, FramebufferSizeCallback);
+
+	// This thread simulates the next frame while the render thread records and submits the last one. Just in time frames
+	// sample input right before recording instead, so they draw on this thread
+	const bool renderThread = m_RenderThreadEnabled && m_FramePacer.GetPacing() != FramePacing::JustInTime;
+	if (renderThread)
+	{
+		renderer.StartRenderThread();
+	}
+
 	while (!glfwWindowShouldClose(m_pWindow))
 	{
-		const auto start = std::chrono::high_resolution_clock::now();
+		// Nothing stays queued on the GPU, the input sampled next is the one the next image shows
+		if (m_FramePacer.GetPacing() == FramePacing::JustInTime)
+		{
+			renderer.WaitForRenderedFrames();
+		}
+
+		// Waits for the frame's start when paced, the time between frame starts animates the scene
+		m_DeltaTime = m_FramePacer.BeginFrame();
 
 		// Fetch events every frame
 		glfwPollEvents();
 
+		// Minimized windows have nothing to draw to, sleep until something happens instead of spinning
+		int width{};
+		int height{};
+		glfwGetFramebufferSize(m_pWindow, &width, &height);
+		if (width == 0 || height == 0)
+		{
+			glfwWaitEvents();
+			continue;
+		}
+
 		angle += 5.f * m_DeltaTime;
 		m_Distance += 1.f * m_DeltaTime;
 		
@@ -59,23 +99,76 @@ void Window::Init(VulkanRenderer& renderer)
 
 		renderer.Update(m_DeltaTime);
 		renderer.UpdateModel(0, firstModel);
-		renderer.Draw();
+		renderer.PublishSnapshot();
+		if (!renderThread)
+		{
+			renderer.Draw();
+		}
+
+		m_FramePacer.EndFrame();
+
+		// Counted once per presented frame, the render thread may not have finished one since the last loop
+		bool newStatistics{};
+		const FrameStatistics statistics = renderer.GetFrameStatistics(&newStatistics);
+		const LatencyStatistics& latencyStatistics = statistics.latency;
+		const bool newLatency = latencyStatistics.presentWaitEnabled ? latencyStatistics.presentedFrameCount != m_PresentedFrameCount : newStatistics;
+		if (newLatency)
+		{
+			const double latency = latencyStatistics.presentWaitEnabled ? latencyStatistics.inputToPresentedMilliseconds
+				: latencyStatistics.inputToPresentSubmitMilliseconds;
+			m_PresentedFrameCount = latencyStatistics.presentedFrameCount;
+			m_LatencySumMilliseconds += latency;
+			m_LatencyMaxMilliseconds = std::max(m_LatencyMaxMilliseconds, latency);
+			++m_LatencyFrameCount;
+		}
 
-		const auto end = std::chrono::high_resolution_clock::now();
-		m_DeltaTime = std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
-		
 		m_ElapsedMilliSeconds += m_DeltaTime;
+		m_LongestFrame = std::max(m_LongestFrame, m_DeltaTime);
 
 		if (m_ElapsedMilliSeconds >= m_FPSIntervalMilliseconds)
 		{
 			std::cout << "----------------------------------------------" << '\n';
 			std::cout << "Time since last frame: " << m_DeltaTime << "ms" << '\n';
 			std::cout << "FPS: " << 1.0 / m_DeltaTime << '\n';
+			std::cout << "Longest frame: " << m_LongestFrame * 1000.f << "ms" << '\n';
+			const double averageLatency = m_LatencyFrameCount > 0 ? m_LatencySumMilliseconds / m_LatencyFrameCount : 0.0;
+			std::cout << (latencyStatistics.presentWaitEnabled ? "Input to present: " : "Input to present submit: ") << averageLatency
+				<< "ms (max " << m_LatencyMaxMilliseconds << "ms), input to rendered: " << latencyStatistics.inputToRenderedMilliseconds << "ms";
+			if (m_FramePacer.GetPacing() == FramePacing::JustInTime)
+			{
+				std::cout << ", predicted frame work: " << m_FramePacer.GetPredictedWorkMilliseconds() << "ms";
+			}
+			std::cout << '\n';
+
+			const DrawListStatistics& drawStatistics = statistics.draw;
+			const CullingStatistics& cullingStatistics = statistics.culling;
+			std::cout << "Meshes visible: " << cullingStatistics.visibleCount << ", culled: " << cullingStatistics.culledCount << ", occluded: " << cullingStatistics.occludedCount << '\n';
+			std::cout << "Draws: " << drawStatistics.drawCount << " (" << drawStatistics.indirectCalls << " indirect calls), instances: " << drawStatistics.instanceCount << ", binds skipped: " << drawStatistics.skippedBinds << ", secondary command buffers: " << drawStatistics.secondaryCommandBuffers << '\n';
+			const CommandReuseStatistics& reuseStatistics = statistics.commandReuse;
+			std::cout << "Command buffers recorded: " << reuseStatistics.recordedCount << ", reused: " << reuseStatistics.reusedCount << '\n';
+			const SwapchainStatistics& swapchainStatistics = statistics.swapchain;
+			if (swapchainStatistics.recreatedCount > 0)
+			{
+				std::cout << "Swapchain recreated: " << swapchainStatistics.recreatedCount << " times, last took " << swapchainStatistics.lastRecreateMilliseconds
+					<< "ms (max " << swapchainStatistics.maxRecreateMilliseconds << "ms), resize to present: " << swapchainStatistics.lastResizeLatencyMilliseconds << "ms" << '\n';
+			}
 			std::cout << "----------------------------------------------" << '\n';
 			m_ElapsedMilliSeconds = 0;
+			m_LongestFrame = 0;
+			m_LatencySumMilliseconds = 0;
+			m_LatencyMaxMilliseconds = 0;
+			m_LatencyFrameCount = 0;
+		}
+
+		m_MemoryReportElapsedSeconds += m_DeltaTime;
+		if (m_MemoryReportElapsedSeconds >= m_MemoryReportIntervalSeconds)
+		{
+			renderer.RequestMemoryReport();
+			m_MemoryReportElapsedSeconds = 0;
 		}
 	}
 
+	renderer.StopRenderThread();
 	InputHandler::Destroy();
 }
 
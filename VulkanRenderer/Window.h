@@ -9,6 +9,7 @@
 
 #include "VulkanRenderer.h"
 #include "InputHandler.h"
+#include "FramePacer.h"
 
 class Window
 {
@@ -17,9 +18,17 @@ public:
 	~Window();
 
 	void Init(VulkanRenderer& renderer);
+
+	// Call before Init, frames start as soon as the renderer lets them otherwise
+	void SetFramePacing(FramePacing pacing, double targetFrameRate);
+
+	// Call before Init, draws on a render thread one frame behind the simulation unless disabled (or pacing just in time)
+	void SetRenderThread(bool enabled) { m_RenderThreadEnabled = enabled; }
 	GLFWwindow* GetWindow() const { return m_pWindow; }
 
 private:
+	static void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
+
 	GLFWwindow* m_pWindow{ };
 	InputHandler* m_pInputHandler{};
 
@@ -32,5 +41,19 @@ private:
 	double m_ElapsedMilliSeconds{};
 	float m_DeltaTime{};
 	double m_FPSIntervalMilliseconds{1.0};
+	float m_LongestFrame{};						// Worst frame time (seconds) since the last report, shows hitches (resizes) the average hides
+
+	FramePacer m_FramePacer{};
+	bool m_RenderThreadEnabled{ true };
+
+	// Input to present latency since the last report, until on screen when the device can tell, otherwise until present submit
+	double m_LatencySumMilliseconds{};
+	double m_LatencyMaxMilliseconds{};
+	uint32_t m_LatencyFrameCount{};
+	uint64_t m_PresentedFrameCount{};			// Last LatencyStatistics::presentedFrameCount counted
+
+	// Periodic memory budget dump (seconds)
+	double m_MemoryReportElapsedSeconds{};
+	double m_MemoryReportIntervalSeconds{10.0};
 };
 
@@ -0,0 +1,99 @@
+#include "WorkerPool.h"
+
+void WorkerPool::Init(uint32_t workerCount)
+{
+	m_Stopping = false;
+	for (uint32_t i{}; i < workerCount; ++i)
+	{
+		m_Workers.emplace_back(&WorkerPool::WorkerLoop, this);
+	}
+}
+
+void WorkerPool::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_WorkAvailable.notify_all();
+
+	for (auto& worker : m_Workers)
+	{
+		worker.join();
+	}
+	m_Workers.clear();
+}
+
+void WorkerPool::ParallelFor(uint32_t jobCount, const std::function<void(uint32_t)>& job)
+{
+	if (jobCount == 0)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_pJob = &job;
+	m_JobCount = jobCount;
+	m_NextJob = 0;
+	m_CompletedJobs = 0;
+	m_Exception = nullptr;
+	m_WorkAvailable.notify_all();
+
+	// Help out instead of only waiting
+	while (m_NextJob < m_JobCount)
+	{
+		RunJob(lock);
+	}
+
+	m_WorkDone.wait(lock, [this]() { return m_CompletedJobs == m_JobCount; });
+	m_pJob = nullptr;
+
+	if (m_Exception)
+	{
+		std::rethrow_exception(m_Exception);
+	}
+}
+
+void WorkerPool::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_WorkAvailable.wait(lock, [this]() { return m_Stopping || (m_pJob != nullptr && m_NextJob < m_JobCount); });
+		if (m_Stopping)
+		{
+			return;
+		}
+
+		RunJob(lock);
+	}
+}
+
+void WorkerPool::RunJob(std::unique_lock<std::mutex>& lock)
+{
+	const uint32_t jobIndex = m_NextJob++;
+	const std::function<void(uint32_t)>* pJob = m_pJob;
+
+	// Jobs run unlocked, only picking and completing them is serialized
+	lock.unlock();
+	std::exception_ptr exception{};
+	try
+	{
+		(*pJob)(jobIndex);
+	}
+	catch (...)
+	{
+		exception = std::current_exception();
+	}
+	lock.lock();
+
+	if (exception && !m_Exception)
+	{
+		m_Exception = exception;
+	}
+
+	if (++m_CompletedJobs == m_JobCount)
+	{
+		m_WorkDone.notify_all();
+	}
+}
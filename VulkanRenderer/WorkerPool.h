@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run the jobs of a ParallelFor, the calling thread takes jobs as well.
+// Workers sleep on a condition variable in between, only one ParallelFor runs at a time.
+class WorkerPool final
+{
+public:
+	WorkerPool() = default;
+	~WorkerPool() = default;
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	void Init(uint32_t workerCount);
+	void Destroy();
+
+	// Workers plus the calling thread
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+	// Calls job(i) for every i in [0, jobCount) and returns once all are done,
+	// the first exception a job threw is rethrown here
+	void ParallelFor(uint32_t jobCount, const std::function<void(uint32_t)>& job);
+
+private:
+	std::vector<std::thread> m_Workers{};
+
+	std::mutex m_Mutex{};
+	std::condition_variable m_WorkAvailable{};
+	std::condition_variable m_WorkDone{};
+
+	// Current ParallelFor, guarded by m_Mutex
+	const std::function<void(uint32_t)>* m_pJob{};
+	uint32_t m_JobCount{};
+	uint32_t m_NextJob{};
+	uint32_t m_CompletedJobs{};
+	std::exception_ptr m_Exception{};
+	bool m_Stopping{ false };
+
+	void WorkerLoop();
+	void RunJob(std::unique_lock<std::mutex>& lock);
+};
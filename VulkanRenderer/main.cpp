@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <stdexcept>
 #include <iostream>
 
@@ -7,14 +8,72 @@
 #include "Window.h"
 #include "VulkanRenderer.h"
 
-int main()
+int main(int argc, char* argv[])
 {
 	std::string windowName = "Vulkan renderer";
 
+	// Latency against throughput:
+	// "--frames-in-flight N", "--present-mode fifo|fifo-relaxed|mailbox|immediate",
+	// "--fps-limit N" (frames start at a fixed rate), "--just-in-time" (input sampled as late as the frame allows)
+	// and "--single-thread" (simulate and draw on one thread)
+	uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	PresentMode presentMode = PresentMode::Mailbox;
+	double fpsLimit = 0.0;
+	bool justInTime = false;
+	bool singleThread = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--just-in-time")
+		{
+			justInTime = true;
+		}
+		else if (argument == "--single-thread")
+		{
+			singleThread = true;
+		}
+		else if (i + 1 < argc && argument == "--frames-in-flight")
+		{
+			framesInFlight = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (i + 1 < argc && argument == "--fps-limit")
+		{
+			fpsLimit = std::strtod(argv[++i], nullptr);
+		}
+		else if (i + 1 < argc && argument == "--present-mode")
+		{
+			const std::string mode = argv[++i];
+			if (mode == "fifo")
+			{
+				presentMode = PresentMode::Fifo;
+			}
+			else if (mode == "fifo-relaxed")
+			{
+				presentMode = PresentMode::FifoRelaxed;
+			}
+			else if (mode == "immediate")
+			{
+				presentMode = PresentMode::Immediate;
+			}
+			else if (mode == "mailbox")
+			{
+				presentMode = PresentMode::Mailbox;
+			}
+			else
+			{
+				std::cerr << "Unknown present mode " << mode << ", using mailbox" << '\n';
+			}
+		}
+	}
+
 	Window window = Window{ windowName, 640 * 2, 480 * 2 };
 	VulkanRenderer renderer = VulkanRenderer{};
 
-	if(renderer.Init(&window) == EXIT_FAILURE)
+	renderer.SetPresentMode(presentMode);
+	window.SetRenderThread(!singleThread);
+	window.SetFramePacing(justInTime ? FramePacing::JustInTime : fpsLimit > 0.0 ? FramePacing::Limited : FramePacing::Unlimited, fpsLimit);
+
+	if(renderer.Init(&window, framesInFlight) == EXIT_FAILURE)
 	{
 		return EXIT_FAILURE;
 	}